@@ -1,52 +1,83 @@
 #include "Agent.h"
+#include "Log.h"
+#include "VectorBatch.h"
+
+//scratch arrays for the batched kernels, one set per thread
+struct AgentBatch {
+  std::vector<int> slot;
+  //other agents: meToYou, their velocity, and the per-pair results
+  std::vector<float> mx, my, ovx, ovy, tx, ty, dist, velDot, meDot;
+  //candidate agents: distance between centers
+  std::vector<float> gap;
+  //walls: normal, then the avoidance direction
+  std::vector<float> wx, wy;
+
+  void resize( int n ){
+    slot.resize( n );
+    mx.resize( n ); my.resize( n );
+    ovx.resize( n ); ovy.resize( n );
+    tx.resize( n ); ty.resize( n );
+    dist.resize( n ); velDot.resize( n ); meDot.resize( n );
+    gap.resize( n );
+    wx.resize( n ); wy.resize( n );
+  }
+};
+static thread_local AgentBatch batch;
 
 Agent::Agent(){
   myType = AGENT;
-  stopping = false; 
-  waiting = false; 
-  isColliding = false; 
+  ownStore = new AgentStore();
+  store = ownStore;
+  id = store->add();
+}
+
+Agent::Agent( Json::Value a ){
+  ownStore = new AgentStore();
+  store = ownStore;
+  init( a );
+}
+
+Agent::Agent( Json::Value a, AgentStore * s ){
+  ownStore = NULL;
+  store = s;
+  init( a );
 }
 
-Agent::Agent( Json::Value a ) : attractor(a["attractor"]) {
+void Agent::init( Json::Value a ){
   myType = AGENT;
-  stopping = false;
-  waiting = false; 
-  isColliding = false; 
-  
-  v2fMult(force, 0.0, force);
-
-  v2fMult(vel, 0.0, vel);
-  v2fMult(repelForce, 0.0, repelForce);
-  v2fMult(norm, 0.0, norm);
-  Beta = 0.0;
-
-  attractorWeight = a["atWeight"].asDouble();
-  wallWeight = a["waWeight"].asDouble();
-  obstacleWeight = a["obWeight"].asDouble();
-  fallenWeight = a["faWeight"].asDouble();
-  agentWeight = a["agWeight"].asDouble();
-  acceleration = a["accel"].asDouble();
-  maxVelocity = a["maxVel"].asDouble();
-  vislong = a["visDist"].asDouble();
-  viswide = a["visWid"].asDouble();
-
-  radius = a["radius"].asDouble();
+  id = store->add();
+  //a fresh slot is all zeros: not stopping, waiting, colliding or panicked,
+  //and no force, velocity, repulsion or norm
+
+  store->attractorWeight[id] = a["atWeight"].asDouble();
+  store->wallWeight[id] = a["waWeight"].asDouble();
+  store->obstacleWeight[id] = a["obWeight"].asDouble();
+  store->fallenWeight[id] = a["faWeight"].asDouble();
+  store->agentWeight[id] = a["agWeight"].asDouble();
+  store->acceleration[id] = a["accel"].asDouble();
+  store->maxVelocity[id] = a["maxVel"].asDouble();
+  store->visLong[id] = a["visDist"].asDouble();
+  store->visWide[id] = a["visWid"].asDouble();
+
+  store->radius[id] = a["radius"].asDouble();
   
-  personalSpace = a["pspace"].asDouble();
+  store->personalSpace[id] = a["pspace"].asDouble();
 
   mesh = a["mesh"].asString();
 
-  //not quite sure how to specify attractor
-  //for now we'll just have a CrowdObject contained in the agent
-  // attractor is now initialized in the initialization list
-  pos[0] = a["pos"][0u].asDouble();
-  pos[1] = a["pos"][1u].asDouble();
-  if(a.isMember("norm")){
-    norm[0] = a["norm"][0u].asDouble();
-    norm[1] = a["norm"][1u].asDouble();
+  //the attractor is only ever used for its position
+  const Json::Value & at = a["attractor"];
+  if( at.isObject() && at.isMember("pos") && at["pos"].isArray() && at["pos"].size() >= 2 ){
+    store->ax[id] = at["pos"][0u].asDouble();
+    store->ay[id] = at["pos"][1u].asDouble();
   }
 
-  panic = false;
+  store->x[id] = a["pos"][0u].asDouble();
+  store->y[id] = a["pos"][1u].asDouble();
+  if(a.isMember("norm")){
+    store->nx[id] = a["norm"][0u].asDouble();
+    store->ny[id] = a["norm"][1u].asDouble();
+  }
 
   if(a.isMember( "liveValues" ) == true && a["liveValues"].asBool() == true){
     //all in-progress data will be reported to JSON object
@@ -55,18 +86,20 @@ Agent::Agent( Json::Value a ) : attractor(a["attractor"]) {
 }
 
 Agent::~Agent(){
-
+  delete ownStore;
 }
 
 void Agent::print(){
+  v2f pos;
+  store->getPos( id, pos );
   v2fPrint( "position: ", pos);
   return;
 
 }
 Json::Value Agent::getJson(){
   Json::Value v;
-  v["atWeight"] = attractorWeight;
-  v["waWeight"] = wallWeight;
+  v["atWeight"] = store->attractorWeight[id];
+  v["waWeight"] = store->wallWeight[id];
   return v;
 }
 
@@ -74,49 +107,74 @@ int Agent::getType(){
   return myType;
 }
 
+//this and the other queries below answer other objects, so they read the
+//published state while the store is frozen
 void Agent::getVelocity( v2f ret ){
-  v2fCopy( vel , ret );
+  store->getSeenVel( id, ret );
 }
 
 void Agent::setVelocity( v2f set ){
-  v2fCopy( set, vel);
+  store->setVel( id, set );
 }
 
 float Agent::getSpeed( ){
+  v2f vel;
+  store->getVel( id, vel );
   return v2fLen( vel );
 }
 
-void Agent::getNorm( v2f get ){
-  v2f s;
+void Agent::ownNorm( v2f get ){
+  v2f s, norm;
   getDirection( s );
-  v2fCopy(s, norm);
-  v2fNormalize(norm, norm);
+  v2fNormalize(s, norm);
+  store->setNorm( id, norm );
   v2fCopy(norm, get);
 
 }
+
+void Agent::getNorm( v2f get ){
+  if( !store->isFrozen() ){
+    ownNorm( get );
+    return;
+  }
+  //asked by another object during a double-buffered step: work it out from
+  //the published velocity and leave our slot alone
+  v2f vel, norm;
+  store->getSeenVel( id, vel );
+  if( v2fLen( vel ) >= 0.0 + MY_EPSILON )
+    v2fNormalize( vel, norm );
+  else
+    store->getNorm( id, norm );
+  v2fNormalize( norm, get );
+}
 void Agent::getDirection( v2f get ){
+  v2f norm;
   if( this->getSpeed() >= 0.0 + MY_EPSILON ){
+    v2f vel;
+    store->getVel( id, vel );
     v2fNormalize( vel, norm );
+    store->setNorm( id, norm );
   }
+  store->getNorm( id, norm );
   v2fCopy(norm, get);
   return;
 }
 
 float Agent::getPersonalSpace(){
-  return personalSpace;
+  return store->personalSpace[id];
 }
 
 float Agent::getRadius(){
-  return radius;
+  return store->radius[id];
 }
 
 void Agent::getPos( v2f ret){ 
-  v2fCopy( pos, ret );
+  store->getSeenPos( id, ret );
   return;
 }
 
 void Agent::setPos( v2f set ){
-  v2fCopy( set, pos );
+  store->setPos( id, set );
   return;
 }
 
@@ -129,9 +187,11 @@ bool Agent::isVisible( v2f objPos, v2f objDir, float vislength, float viswidth )
 
   //the technical procedure is out of geometric tools for computer games
   //compute effective pos /radius/ along the normal line (to avoid looking behind oneself 
+  v2f pos;
+  store->getSeenPos( id, pos );
   float d = ptToLineDist( pos, objPos, objDir, vislength);
 
-  float er = radius + viswidth;
+  float er = store->radius[id] + viswidth;
   if( d <= er )
     return true;
 
@@ -140,13 +200,16 @@ bool Agent::isVisible( v2f objPos, v2f objDir, float vislength, float viswidth )
 }
 
 float Agent::getDistance( v2f objPos ){
-  v2f diff;
+  v2f diff, pos;
+  store->getSeenPos( id, pos );
   v2fSub( objPos, pos, diff );
-  return v2fLen(diff) - radius;
+  return v2fLen(diff) - store->radius[id];
 }
 
 //returns the vector to get from objPos to position of the object
 void Agent::getDirection( v2f objPos, v2f res ){
+  v2f pos;
+  store->getSeenPos( id, pos );
   v2fSub( objPos, pos, res );
   return;
 }
@@ -165,6 +228,13 @@ void Agent::calculateRepelForce(){
     lambda is set to 0.3 if there are collisions with other obstacles to give preference to avoiding walls and obstacles over agents
    */
 
+  float radius = store->radius[id];
+  float personalSpace = store->personalSpace[id];
+  v2f pos, vel;
+  store->getPos( id, pos );
+  store->getVel( id, vel );
+  std::vector<CrowdObject *> & collideObjects = store->colliders[id];
+
   float lambda = 1.0;
   v2f forceFromAgents, forceFromWalls;
   v2fMult( forceFromAgents, 0.0, forceFromAgents);
@@ -172,7 +242,7 @@ void Agent::calculateRepelForce(){
 
   for( std::vector<CrowdObject *>::iterator c = collideObjects.begin();
        c != collideObjects.end();
-       c++){
+       c++ ){
     switch( (*c)->getType()){
       case AGENT: {
 	/*i is this agent, j is the other agent
@@ -206,7 +276,7 @@ void Agent::calculateRepelForce(){
 	//set lambda to 0.3 to give precendence to avoiding any agents
 	float k = (radius + personalSpace - (*c)->getDistance(pos)) / (*c)->getDistance(pos);
 	//k is sometimes memory-corrupt
-	std::cout << "cdist: " << (*c)->getDistance(pos) << "\n";
+	LOG_DEBUG( "cdist: " << (*c)->getDistance(pos) );
 	v2f norm;
 	v2f currentforce;
 	(*c)->getNorm( norm );
@@ -230,13 +300,18 @@ void Agent::calculateRepelForce(){
   /* carry out the overarching computation */
   //  v2fPrint( "agent forces: ",  forceFromAgents);
   //  v2fPrint( "force from walls: ",  forceFromWalls);
-  if( v2fDot(vel, forceFromAgents) < 0 && ! panic ){
-    stopping = true;
-    stoptime = std::rand() % 50;
+  if( v2fDot(vel, forceFromAgents) < 0 && ! store->panic[id] ){
+    store->stopping[id] = true;
+    //the shared generator's draw depends on the order agents are processed
+    //in, so double-buffered steps use the agent's own generator
+    store->stoptime[id] = ( store->isFrozen() ? store->random( id ) : store->random() ) % 50;
     v2fMult(vel, 0.0, vel);
+    store->setVel( id, vel );
   }
+  v2f repelForce;
   v2fMult(forceFromAgents, lambda,forceFromAgents);
   v2fAdd(forceFromWalls, forceFromAgents, repelForce);
+  store->setRepel( id, repelForce );
   //  v2fPrint( "repulsion forces: ", repelForce);
 }
 
@@ -249,41 +324,12 @@ void crossAndRecross( v2f v1, v2f v2, v2f ret){
 
 }
 
-void Agent::calcAgentForce( CrowdObject * a , v2f ret){
-  v2f meToYou;
-  v2f tforce;
-  v2f otherVel;
-  a->getDirection( pos, meToYou );
-  a->getVelocity(otherVel);
-
-  crossAndRecross( meToYou, vel, tforce);
-  v2fNormalize( tforce , tforce );
-
-  float distweight, dirweight;
-  distweight = pow( v2fLen(meToYou) - vislong, 2);
-
-  if( v2fDot( vel, otherVel ) > 0 ) {
-    dirweight = 1.2;
-  } else {
-    dirweight = 2.4;
-  }
-  //add in a slight right-bias if you are headed toward an agent with a direct oncoming or directly same-direction as you
-  std::cout << "ang: " << v2fDot( vel, otherVel );
-  if( abs( v2fDot(vel, otherVel) ) <= MY_EPSILON && abs( v2fDot(vel, meToYou)) <= MY_EPSILON){
-    v2f rforce;
-    v2fTangent( vel, rforce );
-    //tforce should be zero here
-    v2fAdd(tforce, rforce, 0.2, tforce);
-  }
-
-  v2fMult(tforce , distweight * dirweight, ret);
-  return;
-}
-
 //application of the HiDAC algorithm to an agent
 void Agent::calculateForces (){
-  //calculate perceived density
-  float perceivedDensity = 1.0;
+  v2f pos, vel, force;
+  store->getPos( id, pos );
+  store->getVel( id, vel );
+  store->getForce( id, force );
 
   //running total vector
   v2f rt;
@@ -293,55 +339,106 @@ void Agent::calculateForces (){
   v2fCopy(force, rt);
 
   //Force towards attractor
-  v2f dtoattractor;
+  v2f attractor, dtoattractor;
   //a problem is that with just the attractor the agent will 'pace' back and forth over it
-  attractor.getDirection( pos, dtoattractor );
-  v2fMult(dtoattractor, attractorWeight, dtoattractor);
+  store->getAttractor( id, attractor );
+  v2fSub( attractor, pos, dtoattractor );
+  v2fMult(dtoattractor, store->attractorWeight[id], dtoattractor);
   v2fAdd( rt, dtoattractor, rt);
 
 
+  //gather the visible agents and walls, and run the vector math for all of
+  //them at once: for an agent, the direction to it crossed and recrossed
+  //with our velocity and normalized, its distance and the two dot products
+  //the weights below need; for a wall, its normal crossed and recrossed
+  //with our velocity and normalized
+  std::vector<CrowdObject *> & visObjects = store->visible[id];
+  AgentBatch & b = batch;
+  b.resize( visObjects.size() );
+  int na = 0, nw = 0;
+  for( size_t k = 0; k < visObjects.size(); k++ ){
+    v2f t;
+    switch( visObjects[k]->getType() ){
+    case AGENT :
+      visObjects[k]->getDirection( pos, t );
+      b.mx[na] = t[0];
+      b.my[na] = t[1];
+      visObjects[k]->getVelocity( t );
+      b.ovx[na] = t[0];
+      b.ovy[na] = t[1];
+      b.slot[k] = na++;
+      break;
+    case WALL :
+      visObjects[k]->getNorm( t );
+      b.wx[nw] = t[0];
+      b.wy[nw] = t[1];
+      b.slot[k] = nw++;
+      break;
+    default:
+      break;
+    }
+  }
+  v2fBatchCrossAndRecross( b.mx.data(), b.my.data(), vel, b.tx.data(), b.ty.data(), na );
+  v2fBatchNormalize( b.tx.data(), b.ty.data(), b.tx.data(), b.ty.data(), na );
+  v2fBatchLen( b.mx.data(), b.my.data(), b.dist.data(), na );
+  v2fBatchDot( b.ovx.data(), b.ovy.data(), vel, b.velDot.data(), na );
+  v2fBatchDot( b.mx.data(), b.my.data(), vel, b.meDot.data(), na );
+  v2fBatchCrossAndRecross( b.wx.data(), b.wy.data(), vel, b.wx.data(), b.wy.data(), nw );
+  v2fBatchNormalize( b.wx.data(), b.wy.data(), b.wx.data(), b.wy.data(), nw );
+
   //foreach object in visObjects
-  std::vector<CrowdObject *>::iterator it;
   v2f tempForce;
   
   //declared for use in switch
-  float distweight;
-  float dcrossv;
-  v2f otherVel;
   v2f n;
-  for( it = visObjects.begin() ; 
-       it != visObjects.end();
-       it++ ){
+  for( size_t k = 0; k < visObjects.size(); k++ ){
+    CrowdObject * o = visObjects[k];
     v2fMult( tempForce, 0.0, tempForce);
-    switch( (*it)->getType() ){
+    switch( o->getType() ){
     case AGENT : { 
-      v2f dtoa;
-      //this is called for on page 102, but does not seem to be a part of the algorithm
-      /*      (*it)->getDirection( pos, dtoa );
-      (*it)->getVelocity( otherVel);
-      if( v2fLen(dtoa) < vislength - 1.5 && v2fDot(vel, otherVel) < 0.0){
-      } else{*/
-	calcAgentForce((*it), tempForce);
-	v2fMult( tempForce, agentWeight, tempForce);
-	//      }
+      //page 102 also calls for ignoring oncoming agents that are close and
+      //headed our way, but that does not seem to be a part of the algorithm
+      int j = b.slot[k];
+      v2f tforce;
+      tforce[0] = b.tx[j];
+      tforce[1] = b.ty[j];
+
+      float distweight, dirweight;
+      distweight = pow( b.dist[j] - store->visLong[id], 2);
+
+      if( b.velDot[j] > 0 ) {
+	dirweight = 1.2;
+      } else {
+	dirweight = 2.4;
+      }
+      //add in a slight right-bias if you are headed toward an agent with a direct oncoming or directly same-direction as you
+      LOG_DEBUG( "ang: " << b.velDot[j] );
+      if( abs( b.velDot[j] ) <= MY_EPSILON && abs( b.meDot[j] ) <= MY_EPSILON){
+	v2f rforce;
+	v2fTangent( vel, rforce );
+	//tforce should be zero here
+	v2fAdd(tforce, rforce, 0.2, tforce);
+      }
+
+      v2fMult(tforce , distweight * dirweight, tempForce);
+      v2fMult( tempForce, store->agentWeight[id], tempForce);
       break;
     }
     case WALL : {
       //avoidance force for wall is wallnormal cross velocity cross wallnormal, normalized
-
-      (*it)->getNorm(n);
-      crossAndRecross(n, vel, tempForce); 
-      v2fNormalize(tempForce, tempForce);
-      v2fMult( tempForce, wallWeight, tempForce );
+      int j = b.slot[k];
+      tempForce[0] = b.wx[j];
+      tempForce[1] = b.wy[j];
+      v2fMult( tempForce, store->wallWeight[id], tempForce );
       break; 
     }
     case OBSTACLE : {
       //for now, obstacles work the same as walls, perhaps in the future that will change
-      (*it)->getDirection(pos, n);
+      o->getDirection(pos, n);
       crossAndRecross(n, vel, tempForce);
       
       v2fNormalize(tempForce, tempForce);
-      v2fMult(tempForce, obstacleWeight, tempForce);
+      v2fMult(tempForce, store->obstacleWeight[id], tempForce);
       break;
     }
       //fallen_agent case not implemented
@@ -358,100 +455,109 @@ void Agent::calculateForces (){
 
   //normalize force
   v2fNormalize(force, force);
+  store->setForce( id, force );
 
   
   //calculate repulsionForces (they will be added later)
-  if( isColliding ){
+  if( store->colliding[id] ){
     calculateRepelForce();
   } 
 }
 
-//stub function
-void Agent::computeFallen( v2f ret ){
-  v2fMult(ret , 0.0, ret);
-  
-  //if close enough to a fallen agent, should set the float Beta with the distance to a fallen agent. For now, set to zero
-  Beta = 0.0;
-}
-
-float Agent::computeAlpha( ){
-  if( v2fLen(repelForce) > 0.0 || stopping || waiting )
-    return 0.0;
-  else 
-    return 1.0;
-}
-
-float Agent::computeVel( float deltaT ){
-  if (v2fLen(vel) == maxVelocity)
-    return getSpeed();
-  else 
-    return getSpeed() + acceleration*deltaT;
-}
-
 void Agent::applyForces( float deltaT ){
-  //start with the current position = pos
-  v2f oldPos; 
-  v2fCopy(pos, oldPos);
-
-  //compute normal movement forces
-  v2f fallen;
-  computeFallen(fallen);
-  v2f normalMove, movement;
-
-  float moveFactor = computeAlpha() * computeVel(deltaT) * deltaT;
-  v2fMult(force, (1.0 - Beta), normalMove);
-  v2fMult(fallen, Beta, fallen);
-  v2fAdd(fallen, normalMove, movement);
-
-  v2fMult(movement, moveFactor, movement);
-
-
-  //add to repulsive Forces
-  v2fAdd(movement, repelForce, movement);
-  //this is the sum of forces for this move, store it in force for the computation on the next step
-  v2fCopy( movement, force );
-  v2fAdd(movement, pos, pos);
-
-  //update velocity value after updating position
-  v2fSub( pos, oldPos, vel );
-  v2fNormalize( vel, norm);
+  store->applyForces( id, deltaT );
 }
 
 //functions to update visibility and collision vectors
 void Agent::checkCollide( CrowdObject * c ){
-  v2f wallVec;
-  c->getDirection( pos, wallVec);
+  v2f pos;
+  store->getPos( id, pos );
 
-  if(c->getDistance( pos ) < radius ){
-    collideObjects.push_back( c );
-    isColliding = true;
+  if(c->getDistance( pos ) < store->radius[id] ){
+    store->colliders[id].push_back( c );
+    store->colliding[id] = true;
   }
 }
 
 void Agent::checkVisible( CrowdObject * c ){
-  v2f n; 
-  getNorm( n );
+  v2f n, pos; 
+  ownNorm( n );
+  store->getPos( id, pos );
   //don't want to look behind ourself, so we'll pass in our position moved forward by our radius
   v2f ep;
+  float radius = store->radius[id];
   v2fAdd( pos, n, radius, ep);
-  if( c->isVisible(ep, n, vislong - radius, viswide) ){
-    visObjects.push_back( c );
+  if( c->isVisible(ep, n, store->visLong[id] - radius, store->visWide[id]) ){
+    store->visible[id].push_back( c );
   } 
 
 }
 
-//function to 'reset' at the end of a simulation step 
-void Agent::reset(){
-  isColliding = false;
-  stoptime--;
-  if(stoptime == 0){
-    stopping = false;
+void Agent::checkAgents( const std::vector<int> & slots, Agent * const * agents ){
+  //pull the candidates' positions out of the store, skipping ourself
+  AgentBatch & b = batch;
+  b.resize( slots.size() );
+  int n = 0;
+  for( size_t k = 0; k < slots.size(); k++ ){
+    int s = slots[k];
+    if( s == id )
+      continue;
+    b.slot[n] = s;
+    b.mx[n] = store->seenX( s );
+    b.my[n] = store->seenY( s );
+    n++;
   }
-  visObjects.clear();
-  collideObjects.clear();
-  v2f zero;
-  v2fMult( zero, 0.0, zero );
-  v2fCopy(zero, repelForce);
+  if( n == 0 )
+    return;
+
+  //the tests Agent::isVisible and Agent::getDistance would run for each
+  //candidate, done for all of them at once
+  v2f nrm, pos, ep;
+  ownNorm( nrm );
+  store->getPos( id, pos );
+  float radius = store->radius[id];
+  float viswide = store->visWide[id];
+  v2fAdd( pos, nrm, radius, ep );
+  v2fBatchPtToLineDist( b.mx.data(), b.my.data(), ep, nrm, store->visLong[id] - radius,
+			b.dist.data(), n );
+  v2fBatchDist( b.mx.data(), b.my.data(), pos, b.gap.data(), n );
+
+  for( int k = 0; k < n; k++ ){
+    int s = b.slot[k];
+    if( b.dist[k] <= store->radius[s] + viswide )
+      store->visible[id].push_back( agents[s] );
+    if( b.gap[k] - store->radius[s] < radius ){
+      store->colliders[id].push_back( agents[s] );
+      store->colliding[id] = true;
+    }
+  }
+}
 
+void Agent::getVisionBounds( float pad, v2f lo, v2f hi ){
+  //same rectangle checkVisible hands to isVisible
+  v2f n, ep, far, pos;
+  ownNorm( n );
+  store->getPos( id, pos );
+  float radius = store->radius[id];
+  v2fAdd( pos, n, radius, ep );
+  v2fAdd( ep, n, store->visLong[id] - radius, far );
+
+  float grow = store->visWide[id] + pad + MY_EPSILON;
+  lo[0] = fminf( ep[0], far[0] ) - grow;
+  lo[1] = fminf( ep[1], far[1] ) - grow;
+  hi[0] = fmaxf( ep[0], far[0] ) + grow;
+  hi[1] = fmaxf( ep[1], far[1] ) + grow;
+}
 
+void Agent::getCollideBounds( float pad, v2f lo, v2f hi ){
+  float grow = store->radius[id] + pad + MY_EPSILON;
+  lo[0] = store->x[id] - grow;
+  lo[1] = store->y[id] - grow;
+  hi[0] = store->x[id] + grow;
+  hi[1] = store->y[id] + grow;
+}
+
+//function to 'reset' at the end of a simulation step 
+void Agent::reset(){
+  store->reset( id );
 }
@@ -3,6 +3,7 @@
 
 
 #include "CrowdObject.h"
+#include "AgentStore.h"
 #include <math.h>
 #include <cmath>
 #include <vector>
@@ -12,74 +13,38 @@
 #include "constants.h"
 #include "Wall.h"
 
+/* An Agent is a handle onto one slot of an AgentStore, which holds all of its
+ * simulation state (position, velocity, forces, weights, timers...). Agents
+ * built by a CrowdWorld share the world's store; an agent built on its own
+ * allocates a private single-slot store.
+ */
 class Agent : public CrowdObject { 
  private:
-  //weights - avoidance weights
-  float attractorWeight;
-  float wallWeight;
-  float obstacleWeight;
-  float agentWeight;
+  AgentStore * store;
+  int id;
 
-  float fallenWeight;
+  //private store of an agent that was not given one
+  AgentStore * ownStore;
 
-  float personalSpace;
-
-  float acceleration;
-  float maxVelocity;
-
-  //the "size" of the agent
-  float radius; 
-
-  //states whether an agent is colliding with another
-  bool isColliding;
-  std::vector<CrowdObject *> collideObjects;
-
-  //lists of visible objects
-  //should probably be pointers, will change when needed 
-  std::vector<CrowdObject *> visObjects;
-
-  //whether agent is stopping or waiting. 
-  bool stopping; 
-  int stoptime;
-  bool waiting; 
-
-  //whether agent is panicked - idea: make quantitative
-  bool panic;
-
-  //fallen-agent-avoidance parameter
-  float Beta;
-
-  //position - will assume continuous for now
-  v2f pos;
-
-  //velocity
-  v2f vel;
+  std::string mesh;
 
-  //norm and it's setter method are inherited from CrowdObject
-  //need to copy something into norm
-  v2f force;
+  void init( Json::Value a );
 
-  
-  //this is needed for repulsion forces. Until those are implemented it will be set to <0.0, 0.0> in calculateForces
-  v2f repelForce;
+  //this is needed for repulsion forces. Computed in calculateForces when colliding
   void calculateRepelForce();
 
-  //vision range - to calculate a vision rectangle, look out vislong units along velocity vector, then look by viswide / 2 units. 
-  float vislong;
-  float viswide;
+  //getNorm for the agent's own use: refreshes the stored facing from the
+  //current velocity
+  void ownNorm( v2f get );
 
-  std::string mesh;
-
-  //Attractor
-  CrowdObject attractor;
-  
-  float computeVel( float deltaT);
-  float computeAlpha( );
-  void computeFallen( v2f ret);
+  Agent( const Agent & );
+  Agent & operator=( const Agent & );
 
  public: 
   Agent();
   Agent(Json::Value a);
+  //allocates the agent's slot in s
+  Agent(Json::Value a, AgentStore * s);
   ~Agent();
   Json::Value getJson();
   void print();
@@ -91,7 +56,12 @@ class Agent : public CrowdObject {
 
   float getPersonalSpace();
   float getRadius();
-  float getMaxVelocity() const { return maxVelocity; }
+  float getMaxVelocity() const { return store->maxVelocity[id]; }
+  float getVisDist() const { return store->visLong[id]; }
+  float getVisWidth() const { return store->visWide[id]; }
+
+  AgentStore * getStore() { return store; }
+  int getId() const { return id; }
 
   void getPos( v2f ret );
   void setPos( v2f set );
@@ -106,7 +76,6 @@ class Agent : public CrowdObject {
   float getDistance( v2f pos );
   void getDirection( v2f pos, v2f res);
  
-  void calcAgentForce( CrowdObject * a , v2f ret);
   void calculateForces( );
 
   void applyForces( float deltaT );
@@ -114,6 +83,16 @@ class Agent : public CrowdObject {
   //functions to update visibility and collision vectors
   void checkCollide( CrowdObject * c );
   void checkVisible( CrowdObject * c );
+  //checkVisible and checkCollide against many agents of this agent's store
+  //at once. slots are store indices (this agent's own slot is skipped) and
+  //agents[s] is the Agent in slot s
+  void checkAgents( const std::vector<int> & slots, Agent * const * agents );
+
+  //axis-aligned boxes around the vision rectangle and the collision circle,
+  //grown by pad (the largest radius any tested object can have). Anything
+  //checkVisible/checkCollide can accept lies inside these boxes
+  void getVisionBounds( float pad, v2f lo, v2f hi );
+  void getCollideBounds( float pad, v2f lo, v2f hi );
 
   //function to 'reset' at the end of a simulation step 
   void reset();
@@ -0,0 +1,186 @@
+#include "AgentStore.h"
+
+//xorshift32 step; s must not be zero
+static unsigned int nextRandom( unsigned int & s ){
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+AgentStore::AgentStore(){
+  frozen = false;
+  sharedRng = 1;
+}
+
+int AgentStore::add(){
+  int i = x.size();
+
+  x.push_back( 0.0 ); y.push_back( 0.0 );
+  vx.push_back( 0.0 ); vy.push_back( 0.0 );
+  nx.push_back( 0.0 ); ny.push_back( 0.0 );
+  fx.push_back( 0.0 ); fy.push_back( 0.0 );
+  rx.push_back( 0.0 ); ry.push_back( 0.0 );
+  ax.push_back( 0.0 ); ay.push_back( 0.0 );
+
+  attractorWeight.push_back( 0.0 );
+  wallWeight.push_back( 0.0 );
+  obstacleWeight.push_back( 0.0 );
+  agentWeight.push_back( 0.0 );
+  fallenWeight.push_back( 0.0 );
+
+  radius.push_back( 0.0 );
+  personalSpace.push_back( 0.0 );
+  acceleration.push_back( 0.0 );
+  maxVelocity.push_back( 0.0 );
+  visLong.push_back( 0.0 );
+  visWide.push_back( 0.0 );
+  beta.push_back( 0.0 );
+
+  colliding.push_back( false );
+  stopping.push_back( false );
+  waiting.push_back( false );
+  panic.push_back( false );
+  stoptime.push_back( 0 );
+
+  visible.push_back( std::vector<CrowdObject *>() );
+  colliders.push_back( std::vector<CrowdObject *>() );
+
+  rng.push_back( 0 );
+  seedRandom( i, i );
+
+  px.push_back( 0.0 ); py.push_back( 0.0 );
+  pvx.push_back( 0.0 ); pvy.push_back( 0.0 );
+  return i;
+}
+
+void AgentStore::clear(){
+  x.clear(); y.clear();
+  vx.clear(); vy.clear();
+  nx.clear(); ny.clear();
+  fx.clear(); fy.clear();
+  rx.clear(); ry.clear();
+  ax.clear(); ay.clear();
+  attractorWeight.clear();
+  wallWeight.clear();
+  obstacleWeight.clear();
+  agentWeight.clear();
+  fallenWeight.clear();
+  radius.clear();
+  personalSpace.clear();
+  acceleration.clear();
+  maxVelocity.clear();
+  visLong.clear();
+  visWide.clear();
+  beta.clear();
+  colliding.clear();
+  stopping.clear();
+  waiting.clear();
+  panic.clear();
+  stoptime.clear();
+  visible.clear();
+  colliders.clear();
+  rng.clear();
+  px.clear(); py.clear();
+  pvx.clear(); pvy.clear();
+  sharedRng = 1;
+  frozen = false;
+}
+
+void AgentStore::publish(){
+  px.assign( x.begin(), x.end() );
+  py.assign( y.begin(), y.end() );
+  pvx.assign( vx.begin(), vx.end() );
+  pvy.assign( vy.begin(), vy.end() );
+  frozen = true;
+}
+
+void AgentStore::release(){
+  frozen = false;
+}
+
+void AgentStore::seedRandom( int i, unsigned int seed ){
+  //spread consecutive seeds apart; xorshift must not start at zero
+  unsigned int s = ( seed + 1 ) * 2654435761u;
+  rng[i] = s ? s : 1;
+}
+
+int AgentStore::random( int i ){
+  return nextRandom( rng[i] ) >> 1;
+}
+
+int AgentStore::random(){
+  return nextRandom( sharedRng ) >> 1;
+}
+
+void AgentStore::applyForces( int i, float deltaT ){
+  v2f pos, vel, force, repelForce;
+  getPos( i, pos );
+  getVel( i, vel );
+  getForce( i, force );
+  getRepel( i, repelForce );
+
+  //start with the current position = pos
+  v2f oldPos;
+  v2fCopy( pos, oldPos );
+
+  //compute normal movement forces. Fallen agents are not implemented, so the
+  //fallen-agent force and Beta are both zero
+  v2f fallen;
+  v2fMult( fallen, 0.0, fallen );
+  beta[i] = 0.0;
+  v2f normalMove, movement;
+
+  //alpha: no voluntary movement while being pushed, stopping or waiting
+  float alpha = ( v2fLen( repelForce ) > 0.0 || stopping[i] || waiting[i] ) ? 0.0 : 1.0;
+  float speed = v2fLen( vel );
+  if( speed != maxVelocity[i] )
+    speed = speed + acceleration[i] * deltaT;
+
+  float moveFactor = alpha * speed * deltaT;
+  v2fMult( force, (1.0 - beta[i]), normalMove );
+  v2fMult( fallen, beta[i], fallen );
+  v2fAdd( fallen, normalMove, movement );
+
+  v2fMult( movement, moveFactor, movement );
+
+  //add to repulsive Forces
+  v2fAdd( movement, repelForce, movement );
+  //this is the sum of forces for this move, store it in force for the computation on the next step
+  v2fCopy( movement, force );
+  v2fAdd( movement, pos, pos );
+
+  //update velocity value after updating position
+  v2f norm;
+  v2fSub( pos, oldPos, vel );
+  v2fNormalize( vel, norm );
+
+  setPos( i, pos );
+  setVel( i, vel );
+  setForce( i, force );
+  setNorm( i, norm );
+}
+
+void AgentStore::reset( int i ){
+  colliding[i] = false;
+  stoptime[i]--;
+  if( stoptime[i] == 0 ){
+    stopping[i] = false;
+  }
+  visible[i].clear();
+  colliders[i].clear();
+  rx[i] = 0.0;
+  ry[i] = 0.0;
+}
+
+void AgentStore::applyForces( float deltaT ){
+  int n = size();
+  for( int i = 0; i < n; i++ )
+    applyForces( i, deltaT );
+}
+
+void AgentStore::reset(){
+  int n = size();
+  for( int i = 0; i < n; i++ )
+    reset( i );
+}
@@ -0,0 +1,126 @@
+#ifndef _AGENT_STORE_H_
+#define _AGENT_STORE_H_
+
+#include "constants.h"
+#include <vector>
+
+class CrowdObject;
+
+/* AgentStore holds the simulation state of a set of agents as parallel
+ * arrays, one entry per agent. It is the authoritative copy of that state:
+ * an Agent is only a handle (store, slot index) onto it.
+ *
+ * Keeping each field in its own contiguous array lets the per-step kernels
+ * (integration, reset, broadphase build) stream through memory in order
+ * instead of chasing one heap object per agent.
+ */
+class AgentStore {
+ public:
+  //kinematic state
+  std::vector<float> x, y;          //position
+  std::vector<float> vx, vy;        //velocity
+  std::vector<float> nx, ny;        //facing (last non-zero direction of travel)
+  std::vector<float> fx, fy;        //force, carried over from the last step
+  std::vector<float> rx, ry;        //repulsion force of the current step
+
+  //attractor position
+  std::vector<float> ax, ay;
+
+  //avoidance weights
+  std::vector<float> attractorWeight;
+  std::vector<float> wallWeight;
+  std::vector<float> obstacleWeight;
+  std::vector<float> agentWeight;
+  std::vector<float> fallenWeight;
+
+  //per-agent parameters
+  std::vector<float> radius;
+  std::vector<float> personalSpace;
+  std::vector<float> acceleration;
+  std::vector<float> maxVelocity;
+  std::vector<float> visLong;       //vision rectangle length
+  std::vector<float> visWide;       //vision rectangle half-width
+  std::vector<float> beta;          //fallen-agent-avoidance parameter
+
+  //per-step flags and timers
+  std::vector<unsigned char> colliding;
+  std::vector<unsigned char> stopping;
+  std::vector<unsigned char> waiting;
+  std::vector<unsigned char> panic;
+  std::vector<int> stoptime;
+
+  //objects found by the visibility and collision checks this step
+  std::vector< std::vector<CrowdObject *> > visible;
+  std::vector< std::vector<CrowdObject *> > colliders;
+
+  //per-agent random number generator state (xorshift32, never zero)
+  std::vector<unsigned int> rng;
+  //state of the generator shared by every agent, for single threaded steps
+  unsigned int sharedRng;
+
+  //the previous-state buffer: position and velocity as published at the
+  //start of a double-buffered step
+  std::vector<float> px, py;
+  std::vector<float> pvx, pvy;
+
+  AgentStore();
+
+  /* Double buffering. Between publish() and release() the store is frozen:
+   * what other agents see of a slot (the seen* accessors) is the state
+   * copied at publish(), while each agent keeps reading and writing its own
+   * slot directly. No agent can then observe another's update from the same
+   * step, so agents can be processed in any order, or concurrently. When
+   * not frozen the seen* accessors read the live state.
+   */
+  void publish();
+  void release();
+  bool isFrozen() const { return frozen; }
+
+  float seenX( int i ) const { return frozen ? px[i] : x[i]; }
+  float seenY( int i ) const { return frozen ? py[i] : y[i]; }
+  void getSeenPos( int i, v2f r ) const { r[0] = seenX( i ); r[1] = seenY( i ); }
+  void getSeenVel( int i, v2f r ) const {
+    r[0] = frozen ? pvx[i] : vx[i];
+    r[1] = frozen ? pvy[i] : vy[i];
+  }
+  const float * seenXs() const { return frozen ? px.data() : x.data(); }
+  const float * seenYs() const { return frozen ? py.data() : y.data(); }
+
+  //next value of slot i's own generator, in [0, 2^31)
+  int random( int i );
+  void seedRandom( int i, unsigned int seed );
+  //next value of the shared generator, in [0, 2^31)
+  int random();
+
+  //appends a zeroed slot and returns its index
+  int add();
+  int size() const { return x.size(); }
+  void clear();
+
+  //v2f views of one slot
+  void getPos( int i, v2f r ) const { r[0] = x[i]; r[1] = y[i]; }
+  void setPos( int i, v2f v ) { x[i] = v[0]; y[i] = v[1]; }
+  void getVel( int i, v2f r ) const { r[0] = vx[i]; r[1] = vy[i]; }
+  void setVel( int i, v2f v ) { vx[i] = v[0]; vy[i] = v[1]; }
+  void getNorm( int i, v2f r ) const { r[0] = nx[i]; r[1] = ny[i]; }
+  void setNorm( int i, v2f v ) { nx[i] = v[0]; ny[i] = v[1]; }
+  void getForce( int i, v2f r ) const { r[0] = fx[i]; r[1] = fy[i]; }
+  void setForce( int i, v2f v ) { fx[i] = v[0]; fy[i] = v[1]; }
+  void getRepel( int i, v2f r ) const { r[0] = rx[i]; r[1] = ry[i]; }
+  void setRepel( int i, v2f v ) { rx[i] = v[0]; ry[i] = v[1]; }
+  void getAttractor( int i, v2f r ) const { r[0] = ax[i]; r[1] = ay[i]; }
+
+  //moves agent i along its force and repulsion for one step
+  void applyForces( int i, float deltaT );
+  //clears the per-step state of agent i
+  void reset( int i );
+
+  //the same over every slot, in order
+  void applyForces( float deltaT );
+  void reset();
+
+ private:
+  bool frozen;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "BufferedWriter.h"
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+//longest output of to_chars for a long long or a float
+static const size_t numberBytes = 32;
+
+BufferedWriter::BufferedWriter( size_t capacity ){
+  fd = -1;
+  buffer.resize( capacity < numberBytes ? numberBytes : capacity );
+  used = 0;
+  failed = false;
+}
+
+BufferedWriter::~BufferedWriter(){
+  close();
+}
+
+bool BufferedWriter::open( const std::string & name ){
+  close();
+  path = name;
+  error.clear();
+  failed = false;
+  fd = ::open( name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( fd < 0 ){
+    error = name + ": " + strerror( errno );
+    failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool BufferedWriter::close(){
+  if( fd < 0 )
+    return !failed;
+  drain();
+  if( ::close( fd ) != 0 && !failed ){
+    error = path + ": " + strerror( errno );
+    failed = true;
+  }
+  fd = -1;
+  return !failed;
+}
+
+void BufferedWriter::drain(){
+  writeOut( &buffer[0], used );
+  used = 0;
+}
+
+void BufferedWriter::writeOut( const char * data, size_t n ){
+  while( !failed && n > 0 ){
+    ssize_t done = ::write( fd, data, n );
+    if( done < 0 && errno == EINTR )
+      continue;
+    if( done < 0 ){
+      error = path + ": " + strerror( errno );
+      failed = true;
+      break;
+    }
+    data += done;
+    n -= done;
+  }
+}
+
+void BufferedWriter::write( const char * data, size_t n ){
+  if( buffer.size() - used < n ){
+    drain();
+    //pieces as big as the buffer go straight out
+    if( n >= buffer.size() ){
+      writeOut( data, n );
+      return;
+    }
+  }
+  memcpy( &buffer[used], data, n );
+  used += n;
+}
+
+void BufferedWriter::putInt( long long v ){
+  reserve( numberBytes );
+  char * start = &buffer[used];
+  used = std::to_chars( start, start + numberBytes, v ).ptr - &buffer[0];
+}
+
+void BufferedWriter::putFloat( float v ){
+  reserve( numberBytes );
+  char * start = &buffer[used];
+  used = std::to_chars( start, start + numberBytes, v ).ptr - &buffer[0];
+}
@@ -0,0 +1,59 @@
+#ifndef _BUFFERED_WRITER_H_
+#define _BUFFERED_WRITER_H_
+
+#include <string>
+#include <vector>
+
+/* BufferedWriter writes a file through one fixed buffer handed straight to
+ * write(2), so output of any length takes the same memory and every system
+ * call moves a large block. Numbers are formatted in place in the buffer
+ * with std::to_chars; floats come out in the shortest form that reads back
+ * as the same float.
+ *
+ * Errors stick: after a failed write the rest is skipped and close()
+ * returns false, so callers only check once at the end.
+ */
+class BufferedWriter {
+ private:
+  int fd;
+  std::vector<char> buffer;
+  size_t used;
+  bool failed;
+  std::string path;
+  std::string error;
+
+  void drain();
+  void writeOut( const char * data, size_t n );
+  //makes room for n more bytes
+  void reserve( size_t n ){
+    if( buffer.size() - used < n )
+      drain();
+  }
+
+  BufferedWriter( const BufferedWriter & );
+  BufferedWriter & operator=( const BufferedWriter & );
+
+ public:
+  explicit BufferedWriter( size_t capacity = 1 << 20 );
+  ~BufferedWriter();
+
+  //creates or truncates path; false with getError() set if it cannot
+  bool open( const std::string & path );
+  //writes what is buffered and closes; false if anything failed
+  bool close();
+
+  void put( char c ){
+    reserve( 1 );
+    buffer[used++] = c;
+  }
+  void write( const char * data, size_t n );
+  void write( const std::string & s ){ write( s.data(), s.size() ); }
+  void putInt( long long v );
+  //non-finite values are written as inf, -inf or nan
+  void putFloat( float v );
+
+  bool good() const { return !failed; }
+  const std::string & getError() const { return error; }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "Checkpoint.h"
+#include "BufferedWriter.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+static const char checkpointMagic[8] = { 'C', 'R', 'W', 'D', 'S', 'N', 'A', 'P' };
+static const uint32_t checkpointVersion = 1;
+static const size_t columnAlign = 64;
+
+//the columns of a checkpoint, in file order. Anything added here changes
+//the layout and needs a new checkpointVersion
+static std::vector<float> AgentStore::* const floatColumns[] = {
+  &AgentStore::x, &AgentStore::y,
+  &AgentStore::vx, &AgentStore::vy,
+  &AgentStore::nx, &AgentStore::ny,
+  &AgentStore::fx, &AgentStore::fy,
+  &AgentStore::rx, &AgentStore::ry,
+  &AgentStore::ax, &AgentStore::ay,
+  &AgentStore::attractorWeight,
+  &AgentStore::wallWeight,
+  &AgentStore::obstacleWeight,
+  &AgentStore::agentWeight,
+  &AgentStore::fallenWeight,
+  &AgentStore::radius,
+  &AgentStore::personalSpace,
+  &AgentStore::acceleration,
+  &AgentStore::maxVelocity,
+  &AgentStore::visLong,
+  &AgentStore::visWide,
+  &AgentStore::beta
+};
+static std::vector<unsigned char> AgentStore::* const flagColumns[] = {
+  &AgentStore::colliding,
+  &AgentStore::stopping,
+  &AgentStore::waiting,
+  &AgentStore::panic
+};
+
+static const size_t floatCount = sizeof( floatColumns ) / sizeof( floatColumns[0] );
+static const size_t flagCount = sizeof( flagColumns ) / sizeof( flagColumns[0] );
+
+static size_t aligned( size_t n ){
+  return ( n + columnAlign - 1 ) / columnAlign * columnAlign;
+}
+
+//calls column( offset, data, bytes ) for each column of store in file
+//order, and returns the size of the file
+template <class Store, class Column>
+static size_t forEachColumn( Store & store, size_t agents, Column column ){
+  size_t at = aligned( sizeof( CheckpointHeader ) );
+  for( size_t c = 0; c < floatCount; c++ ){
+    column( at, ( store.*floatColumns[c] ).data(), agents * sizeof( float ) );
+    at = aligned( at + agents * sizeof( float ) );
+  }
+  for( size_t c = 0; c < flagCount; c++ ){
+    column( at, ( store.*flagColumns[c] ).data(), agents );
+    at = aligned( at + agents );
+  }
+  column( at, store.stoptime.data(), agents * sizeof( int ) );
+  at = aligned( at + agents * sizeof( int ) );
+  column( at, store.rng.data(), agents * sizeof( unsigned int ) );
+  at = aligned( at + agents * sizeof( unsigned int ) );
+  return at;
+}
+
+CheckpointWriter::CheckpointWriter(){
+}
+
+CheckpointWriter::~CheckpointWriter(){
+  finish();
+}
+
+bool CheckpointWriter::save( const std::string & name, const AgentStore & store,
+			     int64_t step, double time ){
+  if( !finish() )
+    return false;
+  size_t agents = store.size();
+  //the first pass only sizes the image
+  image.assign( forEachColumn( store, agents, []( size_t, const void *, size_t ){} ), 0 );
+
+  CheckpointHeader h;
+  memset( &h, 0, sizeof( h ) );
+  memcpy( h.magic, checkpointMagic, sizeof( checkpointMagic ) );
+  h.version = checkpointVersion;
+  h.agents = agents;
+  h.step = step;
+  h.time = time;
+  h.sharedRng = store.sharedRng;
+  h.bytes = image.size();
+  memcpy( &image[0], &h, sizeof( h ) );
+  forEachColumn( store, agents, [this]( size_t at, const void * data, size_t n ){
+      if( n > 0 )
+	memcpy( &image[at], data, n );
+    } );
+
+  path = name;
+  writer = std::thread( &CheckpointWriter::writeImage, this );
+  return true;
+}
+
+bool CheckpointWriter::finish(){
+  if( writer.joinable() )
+    writer.join();
+  return error.empty();
+}
+
+void CheckpointWriter::writeImage(){
+  std::string partial = path + ".part";
+  BufferedWriter out;
+  if( out.open( partial ) )
+    out.write( &image[0], image.size() );
+  if( !out.close() ){
+    error = out.getError();
+    remove( partial.c_str() );
+    return;
+  }
+  if( rename( partial.c_str(), path.c_str() ) != 0 )
+    error = path + ": " + strerror( errno );
+}
+
+bool loadCheckpoint( const std::string & path, AgentStore & store,
+		     int64_t & step, double & time, std::string & error ){
+  MappedFile file;
+  if( !file.open( path ) ){
+    error = file.getError();
+    return false;
+  }
+  const char * base = file.data();
+  CheckpointHeader h;
+  if( file.size() < sizeof( h ) || memcmp( base, checkpointMagic, sizeof( checkpointMagic ) ) != 0 ){
+    error = path + ": not a checkpoint";
+    return false;
+  }
+  memcpy( &h, base, sizeof( h ) );
+  if( h.version != checkpointVersion ){
+    error = path + ": unsupported checkpoint version";
+    return false;
+  }
+  size_t agents = store.size();
+  if( h.agents != agents ){
+    error = path + ": checkpoint has a different number of agents than the scene";
+    return false;
+  }
+  if( h.bytes != file.size() ||
+      forEachColumn( store, agents, []( size_t, void *, size_t ){} ) != file.size() ){
+    error = path + ": checkpoint is truncated";
+    return false;
+  }
+
+  forEachColumn( store, agents, [base]( size_t at, void * data, size_t n ){
+      if( n > 0 )
+	memcpy( data, base + at, n );
+    } );
+  store.sharedRng = h.sharedRng;
+  step = h.step;
+  time = h.time;
+  return true;
+}
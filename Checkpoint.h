@@ -0,0 +1,74 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include "AgentStore.h"
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A checkpoint is a binary snapshot of everything in an AgentStore that
+ * carries over from one step to the next: kinematics, the force and
+ * repulsion of the last step, attractors, weights and parameters, the
+ * stopping and waiting flags and timers, and the random generators, along
+ * with the step count and simulation time it was taken at.
+ *
+ * Layout, version 1, in the byte order of the machine that wrote it:
+ *
+ *   CheckpointHeader, padded to 64 bytes
+ *   one column per store array, in the order of the tables in
+ *   Checkpoint.cpp, each agents entries long and starting on a 64 byte
+ *   boundary
+ *
+ * The walls and other objects are not in it: a checkpoint is restored into
+ * a world built from the same scene, which must have as many agents.
+ */
+struct CheckpointHeader {
+  char magic[8];             //"CRWDSNAP"
+  uint32_t version;
+  uint32_t agents;
+  int64_t step;
+  double time;
+  uint32_t sharedRng;
+  uint32_t reserved;
+  uint64_t bytes;            //size of the whole file
+};
+
+/* CheckpointWriter takes a copy of the store on the calling thread, which
+ * is one memcpy per column, and writes it out on a thread of its own. The
+ * file appears under its name only once it is complete (it is written next
+ * to it and renamed), so an interrupted run never leaves half a checkpoint
+ * behind. A save issued while the last is still being written waits for it.
+ */
+class CheckpointWriter {
+ private:
+  std::vector<char> image;
+  std::string path;
+  std::string error;
+  std::thread writer;
+
+  void writeImage();
+
+  CheckpointWriter( const CheckpointWriter & );
+  CheckpointWriter & operator=( const CheckpointWriter & );
+
+ public:
+  CheckpointWriter();
+  ~CheckpointWriter();
+
+  //snapshots store; false if the last save had failed
+  bool save( const std::string & path, const AgentStore & store,
+	     int64_t step, double time );
+  //waits for the save in flight; false if it could not be written
+  bool finish();
+
+  bool isBusy() const { return writer.joinable(); }
+  const std::string & getError() const { return error; }
+};
+
+//maps the checkpoint at path and copies it over store, filling in the step
+//and time it was taken at. On failure store is untouched and error says why
+bool loadCheckpoint( const std::string & path, AgentStore & store,
+		     int64_t & step, double & time, std::string & error );
+
+#endif
@@ -1,4 +1,5 @@
 #include "CrowdObject.h"
+#include "Log.h"
 
 CrowdObject::CrowdObject( ){
 
@@ -43,7 +44,7 @@ CrowdObject::CrowdObject( const Json::Value& c){
 
 //all methods of CrowdObject will be overridden. 
 bool CrowdObject::isVisible( v2f pos, v2f dir, float vislength, float viswidth){
-  std::cout << "crap!\n";
+  LOG_DEBUG( "crap!" );
   return false; 
 }
 
@@ -57,7 +58,7 @@ void CrowdObject::getNorm( v2f ret ){
 float CrowdObject::getDistance( v2f otherPos ){
   v2f v;
   getDirection( otherPos, v);
-  std::cout << "BAD THINGS!\n";
+  LOG_DEBUG( "BAD THINGS!" );
   return v2fLen( v );
 }
 
@@ -74,6 +75,6 @@ int CrowdObject::getType(){
 
 
 void CrowdObject::getVelocity(v2f ret){
-  std::cout << "Crap!\n";
+  LOG_DEBUG( "Crap!" );
   v2fMult( ret, 0.0, ret );
 }
@@ -1,7 +1,76 @@
 #include "CrowdWorld.h"
+#include "Profiler.h"
+#include <algorithm>
+#ifndef HEADLESS
+#include "Render.h"
+#endif
 
+//the default world draws nothing until something is added to it
 CrowdWorld::CrowdWorld(){
-  Render * r = Render::getInstance();
+  setHeadless( false );
+  indexedObjects = 0;
+  initPipeline( Json::Value() );
+}
+
+void CrowdWorld::setHeadless( bool on ){
+#ifdef HEADLESS
+  headless = true;
+#else
+  headless = on;
+#endif
+}
+
+void CrowdWorld::drawAgent( Agent * a ){
+#ifndef HEADLESS
+  if( !headless ){
+    Render * r = Render::getInstance();
+    r->drawThis(a, a->getMesh());
+  }
+#endif
+}
+
+void CrowdWorld::drawWall( Wall * w ){
+#ifndef HEADLESS
+  if( !headless ){
+    Render * r = Render::getInstance();
+    r->drawThis(w, "wall.mesh");
+  }
+#endif
+}
+
+//"threads" (default 1) and "doubleBuffered" (default false) select the step pipeline
+void CrowdWorld::initPipeline( const Json::Value& w ){
+  scheduler = NULL;
+  doubleBuffered = false;
+  scratch.resize( 1 );
+  if( w.isObject() ){
+    setDoubleBuffered( w.get( "doubleBuffered", false ).asBool() );
+    setThreads( w.get( "threads", 1 ).asInt() );
+  }
+}
+
+void CrowdWorld::setThreads( int threads ){
+  delete scheduler;
+  scheduler = NULL;
+  if( threads != 1 ){
+    scheduler = new TaskScheduler( threads );
+    //agents can only be processed concurrently when they don't see each
+    //other's updates
+    doubleBuffered = true;
+  }
+  scratch.resize( getThreads() );
+}
+
+void CrowdWorld::setDoubleBuffered( bool on ){
+  //a parallel step needs the double buffer
+  doubleBuffered = on || scheduler != NULL;
+}
+
+void CrowdWorld::parallelFor( int n, const TaskScheduler::RangeBody & body ){
+  if( scheduler )
+    scheduler->parallelFor( n, body );
+  else
+    body( 0, n, 0 );
 }
 
 //adds the new CrowdObject(s) to the end of the vector
@@ -24,8 +93,7 @@ void CrowdWorld::createNewObject(const Json::Value& v){
     
     objectList.push_back( w1 );
     objectList.push_back( w2 );
-    Render * r = Render::getInstance();
-    r->drawThis(w1, "wall.mesh");
+    drawWall( w1 );
     return;
   }
   if (s.compare(ag) == 0){
@@ -37,16 +105,29 @@ void CrowdWorld::createNewObject(const Json::Value& v){
 
 }
 
-CrowdWorld::CrowdWorld( const Json::Value& w ){
+CrowdWorld::CrowdWorld( const Json::Value& w ) : CrowdWorld( w, true ){
+}
 
-  Render * r = Render::getInstance();
+Agent * CrowdWorld::addAgent( const Json::Value & v ){
+  Agent * a = new Agent( v, &agentStore );
+  agentList.push_back( a );
+  drawAgent( a );
+  return a;
+}
+
+CrowdWorld::CrowdWorld( const Json::Value& w, bool loadAgents ){
+
+  //"headless": true keeps the world away from the renderer entirely
+  setHeadless( w.get( "headless", false ).asBool() );
+#ifndef HEADLESS
+  if( !headless )
+    Render::getInstance();
+#endif
+  initPipeline( w );
   //loading from file
-  int numAgents = w["agents"].size();
-  for(int i = 0; i < numAgents ; i++ ){
-    Agent * a = new Agent(w["agents"][i]);
-    agentList.push_back( a );
-    r->drawThis(a, a->getMesh());
-  }
+  int numAgents = loadAgents ? w["agents"].size() : 0;
+  for(int i = 0; i < numAgents ; i++ )
+    addAgent( w["agents"][i] );
 
   int numObjects = w["objects"].size();
   for(int i = 0; i < numObjects ; i++){
@@ -56,59 +137,154 @@ CrowdWorld::CrowdWorld( const Json::Value& w ){
 
   //end loading
 
-
+  //walls never move, so their index is built once here
+  indexedObjects = 0;
+  rebuildObjectIndex();
 }
 
 CrowdWorld::~CrowdWorld(){
-  Render * r = Render::getInstance();
-  r->destroyInstance();
+  delete scheduler;
+#ifndef HEADLESS
+  if( !headless ){
+    Render * r = Render::getInstance();
+    r->destroyInstance();
+  }
+#endif
 }
 
 
 
+float CrowdWorld::rebuildAgentGrid(){
+  //cells are sized from the largest interaction range so that each query
+  //only touches a handful of cells around the agent
+  float maxRadius = 0.0;
+  float maxReach = 0.0;
+  int n = agentStore.size();
+  for( int i = 0; i < n; i++ ){
+    maxRadius = fmaxf( maxRadius, agentStore.radius[i] );
+    maxReach = fmaxf( maxReach, agentStore.visLong[i] );
+  }
+  maxReach = fmaxf( maxReach, 2.0 * maxRadius );
+
+  agentGrid.setCellSize( maxReach );
+  if( n > 0 )
+    agentGrid.build( agentStore.seenXs(), agentStore.seenYs(), n );
+  else
+    agentGrid.build( NULL, NULL, 0 );
+  return maxRadius;
+}
+
+void CrowdWorld::rebuildObjectIndex(){
+  if( indexedObjects == objectList.size() )
+    return;
+
+  wallIndex.build( objectList );
+  looseObjects.clear();
+  for( size_t i = 0; i < objectList.size(); i++ ){
+    if( objectList[i]->getType() != WALL )
+      looseObjects.push_back( i );
+  }
+  indexedObjects = objectList.size();
+}
+
 //updates each agent with visibility and collision information
 void CrowdWorld::updateAgents(){
-  for( std::vector<Agent *>::iterator a = agentList.begin();
-       a != agentList.end();
-       a++ ){
-    //contains some inneficiency
-    for( std::vector<Agent *>::iterator b = agentList.begin();
-	 b != agentList.end();
-	 b++ ){
-      if (a != b) {
-	(*a)->checkVisible(*b);
-	(*a)->checkCollide(*b);
-      }
-    }
-    for( std::vector<CrowdObject *>::iterator c = objectList.begin(); 
-	 c != objectList.end();
-	 c++ ){
-      
-      (* a)->checkVisible(* c);
-      (* a)->checkCollide(* c);
+  PROFILE_PHASE( "CrowdWorld::updateAgents" );
+  //freeze this step's state; it is released at the end of stepWorld
+  if( doubleBuffered )
+    agentStore.publish();
 
-    }
+  float maxRadius = rebuildAgentGrid();
+  rebuildObjectIndex();
 
+  //each agent only writes its own lists, so this is safe in either mode
+  if( !scheduler ){
+    for( size_t i = 0; i < agentList.size(); i++ )
+      queryAgent( i, maxRadius, scratch[0] );
+    return;
+  }
+  agentGrid.cellOrder( agentOrder );
+  parallelFor( agentOrder.size(), [&]( int begin, int end, int worker ){
+      for( int k = begin; k < end; k++ )
+	queryAgent( agentOrder[k], maxRadius, scratch[worker] );
+    } );
+}
+
+void CrowdWorld::queryAgent( int i, float maxRadius, QueryScratch & q ){
+  Agent * a = agentList[i];
+
+  //gather the agents whose cells overlap our vision rectangle or our
+  //collision circle. Sorting keeps the checks in agentList order, so the
+  //visible and colliding lists come out exactly as a full scan would
+  v2f lo, hi;
+  q.candidates.clear();
+  a->getVisionBounds( maxRadius, lo, hi );
+  agentGrid.query( lo, hi, q.candidates );
+  a->getCollideBounds( maxRadius, lo, hi );
+  agentGrid.query( lo, hi, q.candidates );
+  std::sort( q.candidates.begin(), q.candidates.end() );
+  q.candidates.erase( std::unique( q.candidates.begin(), q.candidates.end() ),
+		      q.candidates.end() );
+
+  //agentList[j] is slot j of agentStore
+  a->checkAgents( q.candidates, agentList.data() );
+
+  //walls come from the index, the few other objects are always tested.
+  //Walls have no radius, so the boxes need no padding
+  q.objCandidates.assign( looseObjects.begin(), looseObjects.end() );
+  a->getVisionBounds( 0.0, lo, hi );
+  wallIndex.query( lo, hi, q.objCandidates );
+  a->getCollideBounds( 0.0, lo, hi );
+  wallIndex.query( lo, hi, q.objCandidates );
+  std::sort( q.objCandidates.begin(), q.objCandidates.end() );
+  q.objCandidates.erase( std::unique( q.objCandidates.begin(), q.objCandidates.end() ),
+			 q.objCandidates.end() );
+
+  for( std::vector<int>::iterator c = q.objCandidates.begin();
+       c != q.objCandidates.end();
+       c++ ){
+    a->checkVisible( objectList[*c] );
+    a->checkCollide( objectList[*c] );
   }
 }
 
 //calcs forces for each agent
 void CrowdWorld::calcForces(){
-  for( std::vector<Agent * >::iterator it = agentList.begin();
-       it != agentList.end();
-       it++ ){
-    (*it)->calculateForces();
+  PROFILE_PHASE( "CrowdWorld::calcForces" );
+  if( !doubleBuffered ){
+    //agents see the velocities of the ones before them, so order matters
+    for( std::vector<Agent * >::iterator it = agentList.begin();
+	 it != agentList.end();
+	 it++ ){
+      (*it)->calculateForces();
+    }
+    return;
   }
+
+  //agentOrder is still in cell order from updateAgents
+  if( agentOrder.size() != agentList.size() )
+    agentOrder.clear();
+  if( agentOrder.empty() ){
+    for( size_t i = 0; i < agentList.size(); i++ )
+      agentOrder.push_back( i );
+  }
+  parallelFor( agentOrder.size(), [&]( int begin, int end, int worker ){
+      for( int k = begin; k < end; k++ )
+	agentList[ agentOrder[k] ]->calculateForces();
+    } );
 }
   
 //applies forces for each agent
 void CrowdWorld::stepWorld( float deltaT ){
-  for( std::vector<Agent *>::iterator it = agentList.begin();
-       it != agentList.end();
-       it++ ){
-    (* it)->applyForces(deltaT);
-    (* it)->reset();
-  }
+  PROFILE_PHASE( "CrowdWorld::stepWorld" );
+  //every agent lives in agentStore, so this runs straight down its arrays
+  parallelFor( agentStore.size(), [&]( int begin, int end, int worker ){
+      for( int i = begin; i < end; i++ ){
+	agentStore.applyForces( i, deltaT );
+	agentStore.reset( i );
+      }
+    } );
+  agentStore.release();
 }
 
 void CrowdWorld::print(){
@@ -121,8 +297,39 @@ void CrowdWorld::print(){
 }
 
 void CrowdWorld::render(){
+#ifndef HEADLESS
+  if( headless )
+    return;
   Render * r = Render::getInstance();
   //requires a float, but that shouldn't affect anything
   r->update(0.1);
+#endif
+}
+
+bool CrowdWorld::startRecording( const std::string & path, int every ){
+  return recorder.open( path, agentList.size(), every );
+}
+
+bool CrowdWorld::stopRecording(){
+  return recorder.close();
+}
+
+bool CrowdWorld::saveCheckpoint( const std::string & path, int64_t step, double time ){
+  if( !checkpoints.save( path, agentStore, step, time ) ){
+    checkpointError = checkpoints.getError();
+    return false;
+  }
+  return true;
+}
+
+bool CrowdWorld::finishCheckpoint(){
+  if( !checkpoints.finish() ){
+    checkpointError = checkpoints.getError();
+    return false;
+  }
+  return true;
+}
 
+bool CrowdWorld::restoreCheckpoint( const std::string & path, int64_t & step, double & time ){
+  return loadCheckpoint( path, agentStore, step, time, checkpointError );
 }
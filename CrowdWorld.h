@@ -1,23 +1,101 @@
 #include "CrowdObject.h"
 #include "Agent.h"
+#include "AgentStore.h"
 #include "Wall.h"
-#include "Render.h"
+#include "SpatialHash.h"
+#include "WallBVH.h"
+#include "TaskScheduler.h"
+#include "TrajectoryRecorder.h"
+#include "Checkpoint.h"
 #include <vector>
+#include <ostream>
 #include <json/value.h>
 
 class CrowdWorld {
  protected:
   std::vector<Agent * > agentList;
+  //state of every agent in agentList; agentList[i] is slot i
+  AgentStore agentStore;
   std::vector<CrowdObject * > objectList;
+
+  //build from JSON value, leaving the agents out when loadAgents is false so
+  //a subclass can create its own agent types from w["agents"]
+  CrowdWorld( const Json::Value& w, bool loadAgents );
   
- private:
+  //adds the object(s) described by v to objectList
   void createNewObject(const Json::Value& v);
+
+  //true when the world must not touch the renderer. Set by "headless" in the
+  //scene, and always on in builds made with -DHEADLESS (no OGRE at all)
+  bool headless;
+
+  //hand new objects to the renderer unless headless
+  void drawAgent( Agent * a );
+  void drawWall( Wall * w );
+
+  //runs body( begin, end, worker ) over [0, n) on the scheduler, or inline
+  //when the world is single threaded
+  void parallelFor( int n, const TaskScheduler::RangeBody & body );
+
+ private:
+  //broadphase over agent positions, rebuilt at the start of updateAgents
+  SpatialHash agentGrid;
+
+  //agent indices grouped by grid cell; the parallel phases hand out chunks
+  //of this list, so each task covers a few neighbouring cells
+  std::vector<int> agentOrder;
+
+  //per-worker query buffers
+  struct QueryScratch {
+    std::vector<int> candidates;
+    std::vector<int> objCandidates;
+  };
+  std::vector<QueryScratch> scratch;
+
+  //rebuilds agentGrid and returns the largest agent radius in the world
+  float rebuildAgentGrid();
+
+  //static index over the walls in objectList. Everything else in objectList
+  //is kept in looseObjects and still tested against every agent
+  WallBVH wallIndex;
+  std::vector<int> looseObjects;
+  size_t indexedObjects;
+
+  //(re)builds wallIndex if objects were added since the last build
+  void rebuildObjectIndex();
+
+  //fills agent i's visibility and collision lists
+  void queryAgent( int i, float maxRadius, QueryScratch & q );
+
+  //step pipeline. With doubleBuffered set, every phase reads the agent
+  //state published at the start of the step, so agents are independent and
+  //the phases run on the scheduler. Off, agents update in place in
+  //agentList order (stopping agents' velocities are seen by later agents)
+  bool doubleBuffered;
+  TaskScheduler * scheduler;
+
+  TrajectoryRecorder recorder;
+  CheckpointWriter checkpoints;
+  std::string checkpointError;
+
+  void initPipeline( const Json::Value& w );
   
  public:
   //build from JSON value
   CrowdWorld();
   CrowdWorld( const Json::Value& w );
   virtual ~CrowdWorld();
+
+  //adds an agent described by a, as in the scene's "agents" list
+  virtual Agent * addAgent( const Json::Value & a );
+
+  //threads > 1 turns on double buffering; threads <= 0 uses every core
+  void setThreads( int threads );
+  void setDoubleBuffered( bool on );
+  int getThreads() const { return scheduler ? scheduler->size() : 1; }
+  //NULL when single threaded
+  TaskScheduler * getScheduler() { return scheduler; }
+  bool isDoubleBuffered() const { return doubleBuffered; }
   
   //updates each agent with visibility and collision information
   virtual void updateAgents();
@@ -28,7 +106,30 @@ class CrowdWorld {
   //applies forces for each agent
   virtual void stepWorld(float deltaT);
 
+  void setHeadless( bool on );
+  bool isHeadless() const { return headless; }
+
   //output functions
   void print();
   void render();
+
+  //records the agents' positions to path as the run goes, in the ETH text
+  //layout DatasetLoader reads (see TrajectoryRecorder.h), keeping every nth
+  //frame. The step loop calls recordFrame after each step; the file is
+  //written on a background thread
+  bool startRecording( const std::string & path, int every = 1 );
+  void recordFrame( int frame ){ recorder.record( agentStore, agentList.size(), frame ); }
+  //writes out the rest; false if the file could not be written
+  bool stopRecording();
+  const std::string & getRecordingError() const { return recorder.getError(); }
+
+  //snapshots the agents to path, with the step count and simulation time
+  //(see Checkpoint.h). Only the copy happens here; the file is written on a
+  //background thread, and the next save or finishCheckpoint waits for it
+  bool saveCheckpoint( const std::string & path, int64_t step, double time );
+  bool finishCheckpoint();
+  //puts the agents back as they were in the checkpoint at path. The world
+  //must have been built from the same scene
+  bool restoreCheckpoint( const std::string & path, int64_t & step, double & time );
+  const std::string & getCheckpointError() const { return checkpointError; }
 };
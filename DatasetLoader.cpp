@@ -1,7 +1,18 @@
 #include "DatasetLoader.h"
+#include "DatasetStream.h"
+#include "EthText.h"
+#include "Log.h"
+#include "BufferedWriter.h"
 #include "CrowdWorld.h"
+#include "Profiler.h"
+#include "MappedFile.h"
+#include "TaskScheduler.h"
+#include "TrajectoryFile.h"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
 #include <json/json.h>
 
 DatasetLoader::DatasetLoader() {
@@ -9,99 +20,159 @@ DatasetLoader::DatasetLoader() {
     pixelToMeter = 0.05f;  // Standard conversion (may need adjustment per dataset)
     currentFrame = 0;
     maxFrame = 0;
+    streaming = false;
+    streamFailed = false;
+    lookahead = 4;
 }
 
 DatasetLoader::~DatasetLoader() {
 }
 
+void DatasetLoader::setStreaming(bool enabled, int lookaheadFrames) {
+    streaming = enabled;
+    lookahead = std::max(1, lookaheadFrames);
+}
+
+void DatasetLoader::reset() {
+    currentFrame = 0;
+    if (stream) {
+        streamFailed = false;
+        if (!stream->rewind()) {
+            LOG_ERROR("Could not restart the dataset: " << stream->getError());
+            streamFailed = true;
+        }
+        syncStream();
+    }
+}
+
+void DatasetLoader::nextFrame() {
+    currentFrame++;
+    if (stream) {
+        syncStream();
+    }
+}
+
+// Brings the window to the current frame; the end of the dataset is only
+// known once the window gets there. A read error also ends the window, so
+// it is reported here rather than taken for the end of the file
+void DatasetLoader::syncStream() {
+    stream->advance(currentFrame);
+    maxFrame = std::max(0, stream->lastFrame());
+    if (!streamFailed && !stream->getError().empty()) {
+        LOG_ERROR("Dataset ends early, at frame " << maxFrame << ": " << stream->getError());
+        streamFailed = true;
+    }
+}
+
 bool DatasetLoader::loadDataset(const std::string& filename, const std::string& format) {
-    trajectories.clear();
-    frameData.clear();
+    PROFILE_PHASE("DatasetLoader::loadDataset");
+    table.clear();
+    stream.reset();
     currentFrame = 0;
     maxFrame = 0;
     
+    bool text = format == "eth" || format == "ucy";
+    if (streaming && !text) {
+        LOG_WARN("Only eth and ucy files are streamed; loading " << filename << " whole");
+    }
+    if (streaming && text) {
+        return openStream(filename);
+    }
+    
     bool success = false;
+    std::vector<TrajectoryPoint> points;
     
-    if (format == "eth" || format == "ucy") {
-        success = parseETHFormat(filename);  // Both use similar format
+    if (text) {
+        success = parseETHFormat(filename, points);  // Both use similar format
     } else if (format == "trajnet") {
-        success = parseTrajNetFormat(filename);
+        success = parseTrajNetFormat(filename, points);
+    } else if (format == "binary") {
+        success = openBinaryFormat(filename);
     } else {
-        std::cerr << "Unknown dataset format: " << format << std::endl;
+        LOG_ERROR("Unknown dataset format: " << format);
         return false;
     }
     
+    // Text points go straight into the table, which is the only copy kept;
+    // binary files come with velocities and indexes
+    if (success && format != "binary") {
+        success = table.build(points, frameRate, pixelToMeter);
+        std::vector<TrajectoryPoint>().swap(points);
+        if (success) {
+            calculateVelocities();
+        } else {
+            LOG_ERROR("Could not index dataset: " << table.getError());
+        }
+    }
+    if (success) {
+        maxFrame = std::max(0, table.firstFrame() + table.numFrames() - 1);
+    }
+    
     if (success) {
-        calculateVelocities();
-        organizeByFrames();
-        std::cout << "Successfully loaded dataset: " << filename << std::endl;
+        LOG_INFO("Successfully loaded dataset: " << filename);
         printStatistics();
     }
     
     return success;
 }
 
-bool DatasetLoader::parseETHFormat(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Could not open file: " << filename << std::endl;
+bool DatasetLoader::parseETHFormat(const std::string& filename, std::vector<TrajectoryPoint>& points) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        LOG_ERROR("Could not open file: " << file.getError());
         return false;
     }
-    
-    std::string line;
-    std::map<int, AgentTrajectory> agentMap;
-    
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        int frameId, agentId;
-        float x, y;
-        
-        if (!(iss >> frameId >> agentId >> x >> y)) {
-            continue;  // Skip malformed lines
-        }
-        
-        // Convert from pixels to meters
-        x *= pixelToMeter;
-        y *= pixelToMeter;
-        
-        TrajectoryPoint point;
-        point.frameId = frameId;
-        point.agentId = agentId;
-        point.x = x;
-        point.y = y;
-        point.vx = 0.0f;  // Will be calculated later
-        point.vy = 0.0f;
-        
-        // Add to agent's trajectory
-        if (agentMap.find(agentId) == agentMap.end()) {
-            AgentTrajectory traj;
-            traj.agentId = agentId;
-            traj.startTime = frameId / frameRate;
-            agentMap[agentId] = traj;
-        }
-        
-        agentMap[agentId].points.push_back(point);
-        maxFrame = std::max(maxFrame, frameId);
+    const char* data = file.data();
+    const char* limit = data + file.size();
+
+    // Cut the file into chunks that each start on a line of their own and
+    // parse them side by side. Small files are not worth the threads
+    const size_t chunkBytes = 1 << 20;
+    unsigned int hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t numChunks = std::min<size_t>(file.size() / chunkBytes + 1, hw * 4);
+    std::vector<const char*> cuts(numChunks + 1, limit);
+    cuts[0] = data;
+    for (size_t c = 1; c < numChunks; ++c) {
+        const char* at = std::max(cuts[c - 1], data + file.size() / numChunks * c);
+        const char* eol = at < limit ? static_cast<const char*>(memchr(at, '\n', limit - at)) : nullptr;
+        cuts[c] = eol ? eol + 1 : limit;
     }
-    
-    // Convert map to vector and set end times
-    for (auto& pair : agentMap) {
-        AgentTrajectory& traj = pair.second;
-        if (!traj.points.empty()) {
-            traj.endTime = traj.points.back().frameId / frameRate;
-            trajectories.push_back(traj);
+
+    std::vector<std::vector<TrajectoryPoint>> chunkPoints(numChunks);
+    if (numChunks == 1) {
+        parseETHLines(cuts[0], cuts[1], limit, pixelToMeter, chunkPoints[0]);
+    } else {
+        TaskScheduler pool(std::min<size_t>(hw, numChunks));
+        pool.parallelFor(numChunks, 1, [&](int begin, int end, int) {
+            for (int c = begin; c < end; ++c) {
+                parseETHLines(cuts[c], cuts[c + 1], limit, pixelToMeter, chunkPoints[c]);
+            }
+        });
+    }
+
+    // One list in file order; each chunk is freed as soon as it is copied,
+    // so this costs one chunk's worth on top
+    if (numChunks == 1) {
+        points.swap(chunkPoints[0]);
+    } else {
+        size_t total = 0;
+        for (const std::vector<TrajectoryPoint>& chunk : chunkPoints) {
+            total += chunk.size();
+        }
+        points.reserve(total);
+        for (std::vector<TrajectoryPoint>& chunk : chunkPoints) {
+            points.insert(points.end(), chunk.begin(), chunk.end());
+            std::vector<TrajectoryPoint>().swap(chunk);
         }
     }
-    
-    file.close();
     return true;
 }
 
-bool DatasetLoader::parseTrajNetFormat(const std::string& filename) {
+bool DatasetLoader::parseTrajNetFormat(const std::string& filename, std::vector<TrajectoryPoint>& points) {
     // TrajNet format is typically JSON-based
     std::ifstream file(filename);
     if (!file.is_open()) {
-        std::cerr << "Could not open file: " << filename << std::endl;
+        LOG_ERROR("Could not open file: " << filename);
         return false;
     }
     
@@ -109,7 +180,7 @@ bool DatasetLoader::parseTrajNetFormat(const std::string& filename) {
     Json::Reader reader;
     
     if (!reader.parse(file, root)) {
-        std::cerr << "Failed to parse JSON: " << reader.getFormatedErrorMessages() << std::endl;
+        LOG_ERROR("Failed to parse JSON: " << reader.getFormatedErrorMessages());
         return false;
     }
     
@@ -118,12 +189,11 @@ bool DatasetLoader::parseTrajNetFormat(const std::string& filename) {
     //          "tracks": [{"f": frame, "p": person_id, "x": x, "y": y}, ...]}
     
     if (!root.isMember("tracks")) {
-        std::cerr << "Invalid TrajNet format: missing tracks" << std::endl;
+        LOG_ERROR("Invalid TrajNet format: missing tracks");
         return false;
     }
     
-    std::map<int, AgentTrajectory> agentMap;
-    
+    points.reserve(root["tracks"].size());
     for (const Json::Value& track : root["tracks"]) {
         int frameId = track["f"].asInt();
         int agentId = track["p"].asInt();
@@ -137,80 +207,110 @@ bool DatasetLoader::parseTrajNetFormat(const std::string& filename) {
         point.y = y;
         point.vx = 0.0f;
         point.vy = 0.0f;
-        
-        if (agentMap.find(agentId) == agentMap.end()) {
-            AgentTrajectory traj;
-            traj.agentId = agentId;
-            traj.startTime = frameId / frameRate;
-            agentMap[agentId] = traj;
-        }
-        
-        agentMap[agentId].points.push_back(point);
-        maxFrame = std::max(maxFrame, frameId);
-    }
-    
-    // Convert to vector
-    for (auto& pair : agentMap) {
-        AgentTrajectory& traj = pair.second;
-        if (!traj.points.empty()) {
-            traj.endTime = traj.points.back().frameId / frameRate;
-            trajectories.push_back(traj);
-        }
+        points.push_back(point);
     }
     
     file.close();
     return true;
 }
 
+bool DatasetLoader::openBinaryFormat(const std::string& filename) {
+    if (!table.open(filename)) {
+        LOG_ERROR("Could not open trajectory file: " << table.getError());
+        return false;
+    }
+    // Velocities in the file were worked out at its own frame rate
+    frameRate = table.frameRate();
+    pixelToMeter = table.pixelToMeter();
+    return true;
+}
+
+bool DatasetLoader::openStream(const std::string& filename) {
+    stream.reset(new DatasetStream());
+    streamFailed = false;
+    if (!stream->open(filename, frameRate, pixelToMeter, lookahead)) {
+        LOG_ERROR("Could not open file: " << stream->getError());
+        stream.reset();
+        return false;
+    }
+    syncStream();
+    LOG_INFO("Streaming dataset: " << filename);
+    printStatistics();
+    return true;
+}
+
 void DatasetLoader::calculateVelocities() {
-    for (AgentTrajectory& traj : trajectories) {
-        for (size_t i = 0; i < traj.points.size(); ++i) {
+    // Over each agent's points in frame order, writing the table's
+    // velocity columns in place
+    const PointColumns& columns = table.getColumns();
+    const int32_t* frame = columns.frame;
+    const float* x = columns.x;
+    const float* y = columns.y;
+    float* vx = table.writableColumn(TRAJ_VX);
+    float* vy = table.writableColumn(TRAJ_VY);
+    if (!vx || !vy) {
+        return;
+    }
+    for (int agent = 0; agent < table.numAgents(); ++agent) {
+        const uint32_t* p = table.agentPointIndices(agent);
+        size_t n = table.agentSize(agent);
+        for (size_t i = 0; i < n; ++i) {
             if (i == 0) {
                 // First point - use forward difference
-                if (traj.points.size() > 1) {
-                    float dt = (traj.points[1].frameId - traj.points[0].frameId) / frameRate;
-                    traj.points[i].vx = (traj.points[1].x - traj.points[0].x) / dt;
-                    traj.points[i].vy = (traj.points[1].y - traj.points[0].y) / dt;
+                if (n > 1) {
+                    float dt = (frame[p[1]] - frame[p[0]]) / frameRate;
+                    vx[p[i]] = (x[p[1]] - x[p[0]]) / dt;
+                    vy[p[i]] = (y[p[1]] - y[p[0]]) / dt;
                 }
-            } else if (i == traj.points.size() - 1) {
+            } else if (i == n - 1) {
                 // Last point - use backward difference
-                float dt = (traj.points[i].frameId - traj.points[i-1].frameId) / frameRate;
-                traj.points[i].vx = (traj.points[i].x - traj.points[i-1].x) / dt;
-                traj.points[i].vy = (traj.points[i].y - traj.points[i-1].y) / dt;
+                float dt = (frame[p[i]] - frame[p[i-1]]) / frameRate;
+                vx[p[i]] = (x[p[i]] - x[p[i-1]]) / dt;
+                vy[p[i]] = (y[p[i]] - y[p[i-1]]) / dt;
             } else {
                 // Middle point - use central difference
-                float dt = (traj.points[i+1].frameId - traj.points[i-1].frameId) / frameRate;
-                traj.points[i].vx = (traj.points[i+1].x - traj.points[i-1].x) / dt;
-                traj.points[i].vy = (traj.points[i+1].y - traj.points[i-1].y) / dt;
+                float dt = (frame[p[i+1]] - frame[p[i-1]]) / frameRate;
+                vx[p[i]] = (x[p[i+1]] - x[p[i-1]]) / dt;
+                vy[p[i]] = (y[p[i+1]] - y[p[i-1]]) / dt;
             }
         }
     }
 }
 
-void DatasetLoader::organizeByFrames() {
-    frameData.clear();
-    
-    for (const AgentTrajectory& traj : trajectories) {
-        for (const TrajectoryPoint& point : traj.points) {
-            frameData[point.frameId].push_back(point);
-        }
-    }
-}
-
 std::vector<TrajectoryPoint> DatasetLoader::getCurrentFrameData() {
     return getFrameData(currentFrame);
 }
 
 std::vector<TrajectoryPoint> DatasetLoader::getFrameData(int frameId) {
-    if (frameData.find(frameId) != frameData.end()) {
-        return frameData[frameId];
+    FrameView frame = getFrameView(frameId);
+    std::vector<TrajectoryPoint> points;
+    points.reserve(frame.size());
+    for (const TrajectoryPoint& point : frame) {
+        points.push_back(point);
+    }
+    return points;
+}
+
+bool DatasetLoader::getNextPoint(const TrajectoryPoint& point, TrajectoryPoint& next) {
+    size_t index;
+    if (stream) {
+        if (!stream->nextPoint(point.agentId, point.frameId, index)) {
+            return false;
+        }
+        next = stream->point(index);
+        return true;
+    }
+    if (!table.nextPoint(point.agentId, point.frameId, index)) {
+        return false;
     }
-    return std::vector<TrajectoryPoint>();
+    next = table.point(index);
+    return true;
 }
 
 std::vector<int> DatasetLoader::getActiveAgents(int frameId) {
     std::vector<int> agentIds;
-    std::vector<TrajectoryPoint> points = getFrameData(frameId);
+    FrameView points = getFrameView(frameId);
+    agentIds.reserve(points.size());
     
     for (const TrajectoryPoint& point : points) {
         agentIds.push_back(point.agentId);
@@ -220,12 +320,9 @@ std::vector<int> DatasetLoader::getActiveAgents(int frameId) {
 }
 
 TrajectoryPoint DatasetLoader::getAgentPosition(int agentId, int frameId) {
-    std::vector<TrajectoryPoint> points = getFrameData(frameId);
-    
-    for (const TrajectoryPoint& point : points) {
-        if (point.agentId == agentId) {
-            return point;
-        }
+    size_t index;
+    if (findPoint(agentId, frameId, index)) {
+        return getPoint(index);
     }
     
     // Return empty point if not found
@@ -237,33 +334,39 @@ TrajectoryPoint DatasetLoader::getAgentPosition(int agentId, int frameId) {
 }
 
 bool DatasetLoader::isAgentActive(int agentId, int frameId) {
-    std::vector<TrajectoryPoint> points = getFrameData(frameId);
-    
-    for (const TrajectoryPoint& point : points) {
-        if (point.agentId == agentId) {
-            return true;
-        }
-    }
-    return false;
+    size_t index;
+    return findPoint(agentId, frameId, index);
 }
 
 void DatasetLoader::printStatistics() {
     std::cout << "Dataset Statistics:" << std::endl;
-    std::cout << "  Number of agents: " << trajectories.size() << std::endl;
+    if (stream) {
+        // Only the window is known ahead of playback
+        std::cout << "  Streaming, " << stream->getLookahead() << " recorded frames ahead" << std::endl;
+        std::cout << "  Frame rate: " << frameRate << " fps" << std::endl;
+        std::cout << "  Pixel to meter ratio: " << pixelToMeter << std::endl;
+        if (stream->getDroppedPoints()) {
+            std::cout << "  Points out of frame order, dropped: " << stream->getDroppedPoints() << std::endl;
+        }
+        return;
+    }
+    std::cout << "  Number of agents: " << getNumAgents() << std::endl;
     std::cout << "  Number of frames: " << maxFrame + 1 << std::endl;
     std::cout << "  Frame rate: " << frameRate << " fps" << std::endl;
     std::cout << "  Pixel to meter ratio: " << pixelToMeter << std::endl;
     std::cout << "  Duration: " << (maxFrame / frameRate) << " seconds" << std::endl;
     
     // Calculate average trajectory length
-    float avgLength = 0.0f;
-    for (const AgentTrajectory& traj : trajectories) {
-        avgLength += traj.points.size();
-    }
-    avgLength /= trajectories.size();
+    float avgLength = (float)table.numPoints() / getNumAgents();
     std::cout << "  Average trajectory length: " << avgLength << " points" << std::endl;
 }
 
+void DatasetLoader::populateCrowdWorld(CrowdWorld& world, int frameId) {
+    for (const TrajectoryPoint& point : getFrameView(frameId)) {
+        world.addAgent(createAgentJson(point));
+    }
+}
+
 Json::Value DatasetLoader::createAgentJson(const TrajectoryPoint& point) {
     Json::Value agent;
     
@@ -289,87 +392,144 @@ Json::Value DatasetLoader::createAgentJson(const TrajectoryPoint& point) {
     agent["mesh"] = "blue.mesh";
     
     // Set attractor to next position if available
-    AgentTrajectory* traj = findTrajectory(point.agentId);
-    if (traj) {
-        // Find next point
-        for (size_t i = 0; i < traj->points.size() - 1; ++i) {
-            if (traj->points[i].frameId == point.frameId) {
-                agent["attractor"] = Json::Value();
-                agent["attractor"]["type"] = "attractor";
-                agent["attractor"]["pos"] = Json::Value(Json::arrayValue);
-                agent["attractor"]["pos"].append(traj->points[i+1].x);
-                agent["attractor"]["pos"].append(traj->points[i+1].y);
-                agent["attractor"]["norm"] = Json::Value(Json::arrayValue);
-                agent["attractor"]["norm"].append(0.0);
-                agent["attractor"]["norm"].append(0.0);
-                break;
-            }
-        }
+    TrajectoryPoint next;
+    if (getNextPoint(point, next)) {
+        agent["attractor"] = Json::Value();
+        agent["attractor"]["type"] = "attractor";
+        agent["attractor"]["pos"] = Json::Value(Json::arrayValue);
+        agent["attractor"]["pos"].append(next.x);
+        agent["attractor"]["pos"].append(next.y);
+        agent["attractor"]["norm"] = Json::Value(Json::arrayValue);
+        agent["attractor"]["norm"].append(0.0);
+        agent["attractor"]["norm"].append(0.0);
     }
     
     return agent;
 }
 
-AgentTrajectory* DatasetLoader::findTrajectory(int agentId) {
-    for (AgentTrajectory& traj : trajectories) {
-        if (traj.agentId == agentId) {
-            return &traj;
-        }
+// JSON has no inf or nan; velocities across a repeated frame can be either
+static void putJsonFloat(BufferedWriter& out, float v) {
+    if (std::isfinite(v)) {
+        out.putFloat(v);
+    } else {
+        out.write("null", 4);
     }
-    return nullptr;
 }
 
 bool DatasetLoader::exportToJson(const std::string& filename) {
-    Json::Value root;
-    
-    // Export configuration
-    root["steps"] = maxFrame + 1;
-    root["timeslice"] = 1.0f / frameRate;
-    root["frameRate"] = frameRate;
-    root["pixelToMeter"] = pixelToMeter;
+    if (stream) {
+        LOG_WARN("A streamed dataset is not held in memory and cannot be exported");
+        return false;
+    }
+    // Written out as it goes, one point per line, so memory use does not
+    // grow with the dataset. Keys keep the order the whole-document writer
+    // gave them; only the first frame's agents go through Json::Value
+    BufferedWriter out;
+    if (!out.open(filename)) {
+        LOG_ERROR("Could not open output file: " << out.getError());
+        return false;
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
     
     // Export first frame as example
-    std::vector<TrajectoryPoint> firstFrame = getFrameData(0);
-    root["agents"] = Json::Value(Json::arrayValue);
-    
-    for (const TrajectoryPoint& point : firstFrame) {
-        root["agents"].append(createAgentJson(point));
+    out.write("{\n\"agents\":[");
+    bool first = true;
+    for (const TrajectoryPoint& point : getFrameView(0)) {
+        out.write(first ? "\n" : ",\n");
+        out.write(Json::writeString(builder, createAgentJson(point)));
+        first = false;
     }
-    
-    // Export trajectory data
-    root["trajectories"] = Json::Value(Json::arrayValue);
-    for (const AgentTrajectory& traj : trajectories) {
-        Json::Value trajJson;
-        trajJson["agentId"] = traj.agentId;
-        trajJson["startTime"] = traj.startTime;
-        trajJson["endTime"] = traj.endTime;
-        trajJson["points"] = Json::Value(Json::arrayValue);
-        
-        for (const TrajectoryPoint& point : traj.points) {
-            Json::Value pointJson;
-            pointJson["frame"] = point.frameId;
-            pointJson["x"] = point.x;
-            pointJson["y"] = point.y;
-            pointJson["vx"] = point.vx;
-            pointJson["vy"] = point.vy;
-            trajJson["points"].append(pointJson);
+    out.write("],\n\"frameRate\":");
+    putJsonFloat(out, frameRate);
+    out.write(",\n\"pixelToMeter\":");
+    putJsonFloat(out, pixelToMeter);
+    out.write(",\n\"steps\":");
+    out.putInt(maxFrame + 1);
+    out.write(",\n\"timeslice\":");
+    putJsonFloat(out, 1.0f / frameRate);
+    
+    // Export trajectory data, read straight from the columns
+    out.write(",\n\"trajectories\":[");
+    const PointColumns& columns = table.getColumns();
+    for (int a = 0; a < table.numAgents(); ++a) {
+        const uint32_t* indices = table.agentPointIndices(a);
+        size_t n = table.agentSize(a);
+        out.write(a == 0 ? "\n{\"agentId\":" : ",\n{\"agentId\":");
+        out.putInt(table.agentId(a));
+        out.write(",\"endTime\":");
+        putJsonFloat(out, n ? columns.frame[indices[n - 1]] / table.frameRate() : 0.0f);
+        out.write(",\"points\":[");
+        for (size_t k = 0; k < n; ++k) {
+            uint32_t i = indices[k];
+            out.write(k == 0 ? "\n{\"frame\":" : ",\n{\"frame\":");
+            out.putInt(columns.frame[i]);
+            out.write(",\"vx\":");
+            putJsonFloat(out, columns.vx[i]);
+            out.write(",\"vy\":");
+            putJsonFloat(out, columns.vy[i]);
+            out.write(",\"x\":");
+            putJsonFloat(out, columns.x[i]);
+            out.write(",\"y\":");
+            putJsonFloat(out, columns.y[i]);
+            out.put('}');
         }
-        
-        root["trajectories"].append(trajJson);
+        out.write("],\"startTime\":");
+        putJsonFloat(out, n ? columns.frame[indices[0]] / table.frameRate() : 0.0f);
+        out.put('}');
     }
+    out.write("]\n}\n");
     
-    // Write to file
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Could not open output file: " << filename << std::endl;
+    if (!out.close()) {
+        LOG_ERROR("Could not write output file: " << out.getError());
+        return false;
+    }
+    return true;
+}
+
+bool DatasetLoader::exportToCsv(const std::string& filename) {
+    if (stream) {
+        LOG_WARN("A streamed dataset is not held in memory and cannot be exported");
+        return false;
+    }
+    BufferedWriter out;
+    if (!out.open(filename)) {
+        LOG_ERROR("Could not open output file: " << out.getError());
+        return false;
+    }
+    // One row per point in frame order, which is the order of the columns
+    out.write("frame,agent,x,y,vx,vy\n");
+    const PointColumns& columns = table.getColumns();
+    for (size_t i = 0; i < table.numPoints(); ++i) {
+        out.putInt(columns.frame[i]);
+        out.put(',');
+        out.putInt(columns.agent[i]);
+        out.put(',');
+        out.putFloat(columns.x[i]);
+        out.put(',');
+        out.putFloat(columns.y[i]);
+        out.put(',');
+        out.putFloat(columns.vx[i]);
+        out.put(',');
+        out.putFloat(columns.vy[i]);
+        out.put('\n');
+    }
+    if (!out.close()) {
+        LOG_ERROR("Could not write output file: " << out.getError());
+        return false;
+    }
+    return true;
+}
+
+bool DatasetLoader::exportToBinary(const std::string& filename) {
+    if (stream) {
+        LOG_WARN("A streamed dataset is not held in memory and cannot be exported");
+        return false;
+    }
+    // The table is a trajectory file image already
+    if (!table.save(filename)) {
+        LOG_ERROR("Could not write trajectory file: " << table.getError());
         return false;
     }
-    
-    Json::StreamWriterBuilder builder;
-    builder["indentation"] = "  ";
-    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-    writer->write(root, &file);
-    
-    file.close();
     return true;
 }
@@ -6,68 +6,89 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <memory>
 #include "Agent.h"
+#include "Trajectory.h"
+#include "TrajectoryFile.h"
+#include "DatasetStream.h"
 // Forward declarations to avoid circular includes
 class CrowdWorld;
 
-// Structure to hold trajectory data for a single agent
-struct TrajectoryPoint {
-    int frameId;
-    int agentId;
-    float x, y;
-    float vx, vy;  // velocities (calculated)
-};
-
-// Structure to hold agent trajectory
-struct AgentTrajectory {
-    int agentId;
-    std::vector<TrajectoryPoint> points;
-    float startTime;
-    float endTime;
-};
-
 // ETH/UCY dataset loader and simulator
 class DatasetLoader {
 private:
-    std::vector<AgentTrajectory> trajectories;
-    std::map<int, std::vector<TrajectoryPoint>> frameData;  // frameId -> agents in that frame
+    
+    // The one copy of every point, in frame order, with the frame offsets
+    // and the per-agent permutation over them. Binary datasets are mapped;
+    // text ones are built in the same layout and their velocities filled in
+    TrajectoryFile table;
+    // Set instead of the table when an eth/ucy file is streamed
+    std::unique_ptr<DatasetStream> stream;
+    bool streaming;
+    int lookahead;  // recorded frames the stream reads ahead
+    bool streamFailed;  // the stream's read error has been reported
     
     float frameRate;  // frames per second (usually 2.5 fps for ETH/UCY)
     float pixelToMeter;  // conversion factor from pixels to meters
     int currentFrame;
     int maxFrame;
     
-    // Parse different dataset formats
-    bool parseETHFormat(const std::string& filename);
+    // Parse different dataset formats. Parsers append points in file order; the table sorts and indexes them
+    bool parseETHFormat(const std::string& filename, std::vector<TrajectoryPoint>& points);
     bool parseUCYFormat(const std::string& filename); 
-    bool parseTrajNetFormat(const std::string& filename);
+    bool parseTrajNetFormat(const std::string& filename, std::vector<TrajectoryPoint>& points);
+    bool openBinaryFormat(const std::string& filename);
+    bool openStream(const std::string& filename);
+    void syncStream();
     
     // Helper functions
-    void calculateVelocities();
-    void organizeByFrames();
-    AgentTrajectory* findTrajectory(int agentId);
+    void calculateVelocities();  // into the table's velocity columns
     
 public:
     DatasetLoader();
     ~DatasetLoader();
     
-    // Load dataset from file
+    // Load dataset from file; format is eth, ucy, trajnet or binary (a
+    // trajectory file written by exportToBinary or trajconvert)
     bool loadDataset(const std::string& filename, const std::string& format = "eth");
     
     // Configuration
     void setFrameRate(float fps) { frameRate = fps; }
     void setPixelToMeter(float ptm) { pixelToMeter = ptm; }
+    float getFrameRate() const { return frameRate; }
+    float getPixelToMeter() const { return pixelToMeter; }
+    // Play eth/ucy files through a window of frames rather than loading
+    // them (see DatasetStream.h), for recordings too big to hold. Takes
+    // effect on the next loadDataset. Only the window can be queried, and
+    // views last until the next frame; exports need a loaded dataset
+    void setStreaming(bool enabled, int lookaheadFrames = 4);
+    bool isStreaming() const { return stream != nullptr; }
     
     // Simulation control
-    void reset() { currentFrame = 0; }
+    void reset();
     bool hasNextFrame() { return currentFrame <= maxFrame; }
-    void nextFrame() { currentFrame++; }
+    void nextFrame();
     int getCurrentFrame() { return currentFrame; }
     int getMaxFrame() { return maxFrame; }
     
     // Get data for current frame
     std::vector<TrajectoryPoint> getCurrentFrameData();
     std::vector<TrajectoryPoint> getFrameData(int frameId);
+    // The same read in place, without the copy; empty for frames with
+    // nobody in them
+    FrameView getFrameView(int frameId) const { return stream ? stream->frame(frameId) : table.frame(frameId); }
+    
+    // Where point's agent is on its next recorded frame, if it has one
+    bool getNextPoint(const TrajectoryPoint& point, TrajectoryPoint& next);
+    
+    // Point index of agentId in frameId, for getPoint; no allocation
+    bool findPoint(int agentId, int frameId, size_t& index) const {
+        return stream ? stream->findPoint(agentId, frameId, index) : table.findPoint(agentId, frameId, index);
+    }
+    TrajectoryPoint getPoint(size_t index) const { return stream ? stream->point(index) : table.point(index); }
+    // The whole loaded dataset with its indexes, for evaluation; empty
+    // while streaming
+    const TrajectoryFile& getTable() const { return table; }
     
     // Agent management
     std::vector<int> getActiveAgents(int frameId);
@@ -75,14 +96,22 @@ public:
     bool isAgentActive(int agentId, int frameId);
     
     // Dataset statistics
-    int getNumAgents() { return trajectories.size(); }
+    int getNumAgents() { return stream ? stream->numAgents() : table.numAgents(); }
     int getNumFrames() { return maxFrame + 1; }
     void printStatistics();
     
-    // Export functionality
+    // Export functionality. Every exporter writes through a fixed buffer as
+    // it reads the table, so none of them needs memory in proportion to the
+    // dataset; a streamed dataset cannot be exported
     bool exportToJson(const std::string& filename);
+    // frame,agent,x,y,vx,vy rows in frame order, after a header row
+    bool exportToCsv(const std::string& filename);
+    // Native binary trajectory file, velocities included (see TrajectoryFile.h)
+    bool exportToBinary(const std::string& filename);
     
-    // Integration with existing simulation
+    // Integration with existing simulation: adds one agent per pedestrian
+    // in frameId, heading for where it is next seen (see RolloutHarness.h
+    // for running many short simulations from a dataset)
     void populateCrowdWorld(CrowdWorld& world, int frameId);
     Json::Value createAgentJson(const TrajectoryPoint& point);
 };
@@ -92,5 +121,7 @@ public:
 // UCY Format: frame_id agent_id pos_x pos_y
 // Both use 2.5 fps, coordinates in pixels
 // Standard conversion: 1 pixel = 0.05 meters (varies by dataset)
+// Binary trajectory files are already in meters and keep their own frame
+// rate, which replaces the configured one on load
 
 #endif
@@ -0,0 +1,376 @@
+#include "DatasetStream.h"
+#include "EthText.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+// Bytes the reader takes from the file at a time, and how many parsed
+// blocks it may get ahead of playback
+static const size_t streamBlockBytes = 1 << 20;
+static const size_t streamBlocksAhead = 4;
+// Played points left in front of the window before the columns are compacted
+static const size_t compactPoints = 1 << 16;
+
+DatasetStream::DatasetStream() {
+    frameRate = 2.5f;
+    pixelToMeter = 0.05f;
+    lookahead = 1;
+    readerDone = true;
+    stopping = false;
+    resetWindow();
+}
+
+DatasetStream::~DatasetStream() {
+    close();
+}
+
+bool DatasetStream::open(const std::string& filename, float fps, float ptm, int frames) {
+    close();
+    input.open(filename, std::ios::binary);
+    if (!input.is_open()) {
+        error = filename + ": " + strerror(errno);
+        return false;
+    }
+    path = filename;
+    frameRate = fps;
+    pixelToMeter = ptm;
+    lookahead = std::max(1, frames);
+    startReader();
+    return true;
+}
+
+void DatasetStream::close() {
+    stopReader();
+    if (input.is_open()) {
+        input.close();
+    }
+    input.clear();
+    resetWindow();
+    error.clear();
+}
+
+bool DatasetStream::rewind() {
+    stopReader();
+    resetWindow();
+    error.clear();
+    input.clear();
+    input.seekg(0);
+    if (!input) {
+        error = path + ": cannot go back to the start";
+        return false;
+    }
+    startReader();
+    return true;
+}
+
+void DatasetStream::startReader() {
+    blocks.clear();
+    readerDone = false;
+    stopping = false;
+    readError.clear();
+    reader = std::thread(&DatasetStream::readLoop, this);
+}
+
+void DatasetStream::stopReader() {
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        blockTaken.notify_all();
+        reader.join();
+    }
+    blocks.clear();
+    readerDone = true;
+}
+
+// Reader thread: whole lines of each block are parsed here and queued; the
+// partial line at the end is carried over to the next block
+void DatasetStream::readLoop() {
+    std::vector<char> buffer(streamBlockBytes);
+    size_t carry = 0;
+    bool atEnd = false;
+    while (!atEnd) {
+        if (buffer.size() < carry + streamBlockBytes) {
+            buffer.resize(carry + streamBlockBytes);
+        }
+        input.read(buffer.data() + carry, streamBlockBytes);
+        size_t size = carry + input.gcount();
+        atEnd = !input;
+        const char* base = buffer.data();
+        const char* end = base + size;
+        const char* cut = end;
+        if (!atEnd) {
+            while (cut > base && cut[-1] != '\n') {
+                --cut;
+            }
+        }
+
+        std::vector<TrajectoryPoint> parsed;
+        if (cut > base) {
+            parseETHLines(base, cut, cut, pixelToMeter, parsed);
+        }
+        carry = end - cut;
+        memmove(buffer.data(), cut, carry);
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            blockTaken.wait(guard, [this] { return stopping || blocks.size() < streamBlocksAhead; });
+            if (stopping) {
+                return;
+            }
+            if (!parsed.empty()) {
+                blocks.push_back(std::move(parsed));
+            }
+            if (atEnd) {
+                readerDone = true;
+                if (input.bad()) {
+                    readError = path + ": read failed";
+                }
+            }
+        }
+        blockReady.notify_one();
+    }
+}
+
+bool DatasetStream::takeBlock() {
+    std::unique_lock<std::mutex> guard(lock);
+    blockReady.wait(guard, [this] { return !blocks.empty() || readerDone; });
+    if (blocks.empty()) {
+        if (!readError.empty()) {
+            error = readError;
+        }
+        return false;
+    }
+    block.swap(blocks.front());
+    blocks.pop_front();
+    guard.unlock();
+    blockTaken.notify_one();
+    return true;
+}
+
+void DatasetStream::resetWindow() {
+    frameColumn.clear();
+    agentColumn.clear();
+    xColumn.clear();
+    yColumn.clear();
+    vxColumn.clear();
+    vyColumn.clear();
+    frames.clear();
+    withVelocity = 0;
+    pending.clear();
+    block.clear();
+    blockPos = 0;
+    closedFrames = 0;
+    lastFrameId = INT_MIN;
+    exhausted = false;
+    lastSeen.clear();
+    sweepAt = 1024;
+    droppedPoints = 0;
+    refreshColumns();
+}
+
+void DatasetStream::advance(int frameId) {
+    fill(frameId);
+    // A frame's velocities need `lookahead` recorded frames after it, or the
+    // end of the file
+    while (withVelocity < frames.size() &&
+           (exhausted || frames.size() - withVelocity > (size_t)lookahead)) {
+        setVelocities(withVelocity++);
+    }
+    dropBefore(frameId);
+}
+
+// Takes points from the reader until `lookahead` frames after frameId are
+// closed, or the file runs out
+void DatasetStream::fill(int frameId) {
+    size_t after = frameId == INT_MAX ? 0 : frames.size() - frameAt(frameId + 1);
+    while (!exhausted && after < (size_t)lookahead) {
+        if (blockPos == block.size()) {
+            block.clear();
+            blockPos = 0;
+            if (!takeBlock()) {
+                exhausted = true;
+                closePending();
+            }
+            continue;
+        }
+        if (addPoint(block[blockPos++]) && frames.back().frameId > frameId) {
+            ++after;
+        }
+    }
+}
+
+// Adds a point to the frame being read; true if that closed the one before
+bool DatasetStream::addPoint(const TrajectoryPoint& point) {
+    if (point.frameId < lastFrameId || (point.frameId == lastFrameId && pending.empty())) {
+        ++droppedPoints;
+        return false;
+    }
+    bool closed = false;
+    if (point.frameId > lastFrameId && !pending.empty()) {
+        closePending();
+        closed = true;
+    }
+    pending.push_back(point);
+    lastFrameId = point.frameId;
+    return closed;
+}
+
+// Moves the frame being read into the window, in agent id order like the
+// frames of a loaded dataset
+void DatasetStream::closePending() {
+    if (pending.empty()) {
+        return;
+    }
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const TrajectoryPoint& a, const TrajectoryPoint& b) { return a.agentId < b.agentId; });
+    WindowFrame f;
+    f.frameId = pending[0].frameId;
+    f.first = frameColumn.size();
+    f.seq = closedFrames++;
+    for (const TrajectoryPoint& p : pending) {
+        frameColumn.push_back(p.frameId);
+        agentColumn.push_back(p.agentId);
+        xColumn.push_back(p.x);
+        yColumn.push_back(p.y);
+        vxColumn.push_back(0.0f);
+        vyColumn.push_back(0.0f);
+    }
+    f.last = frameColumn.size();
+    frames.push_back(f);
+    pending.clear();
+    refreshColumns();
+}
+
+// The differences of DatasetLoader::calculateVelocities, for window frame k
+void DatasetStream::setVelocities(size_t k) {
+    const WindowFrame& f = frames[k];
+    size_t lastK = std::min(frames.size(), k + 1 + lookahead);
+    for (size_t i = f.first; i < f.last; ++i) {
+        int agentId = agentColumn[i];
+        size_t next = 0;
+        bool hasNext = false;
+        for (size_t j = k + 1; j < lastK && !hasNext; ++j) {
+            hasNext = findIn(j, agentId, next);
+        }
+        std::unordered_map<int, LastSeen>::const_iterator prev = lastSeen.find(agentId);
+        bool hasPrev = prev != lastSeen.end() && f.seq - prev->second.seq <= (uint64_t)lookahead;
+
+        if (hasPrev && hasNext) {
+            // Middle point - use central difference
+            float dt = (frameColumn[next] - prev->second.frameId) / frameRate;
+            vxColumn[i] = (xColumn[next] - prev->second.x) / dt;
+            vyColumn[i] = (yColumn[next] - prev->second.y) / dt;
+        } else if (hasNext) {
+            // First point - use forward difference
+            float dt = (frameColumn[next] - f.frameId) / frameRate;
+            vxColumn[i] = (xColumn[next] - xColumn[i]) / dt;
+            vyColumn[i] = (yColumn[next] - yColumn[i]) / dt;
+        } else if (hasPrev) {
+            // Last point - use backward difference
+            float dt = (f.frameId - prev->second.frameId) / frameRate;
+            vxColumn[i] = (xColumn[i] - prev->second.x) / dt;
+            vyColumn[i] = (yColumn[i] - prev->second.y) / dt;
+        }
+    }
+
+    for (size_t i = f.first; i < f.last; ++i) {
+        LastSeen& seen = lastSeen[agentColumn[i]];
+        seen.frameId = f.frameId;
+        seen.seq = f.seq;
+        seen.x = xColumn[i];
+        seen.y = yColumn[i];
+    }
+    // Forget pedestrians gone for longer than the lookahead
+    if (lastSeen.size() >= sweepAt) {
+        for (std::unordered_map<int, LastSeen>::iterator it = lastSeen.begin(); it != lastSeen.end();) {
+            if (f.seq - it->second.seq > (uint64_t)lookahead) {
+                it = lastSeen.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        sweepAt = std::max<size_t>(1024, lastSeen.size() * 2);
+    }
+}
+
+void DatasetStream::dropBefore(int frameId) {
+    while (withVelocity > 0 && frames.front().frameId < frameId) {
+        frames.pop_front();
+        --withVelocity;
+    }
+    // Played points stay at the front of the columns until there are enough
+    // of them to be worth moving the rest down
+    size_t played = frames.empty() ? frameColumn.size() : frames.front().first;
+    if (played < compactPoints || played * 2 < frameColumn.size()) {
+        return;
+    }
+    frameColumn.erase(frameColumn.begin(), frameColumn.begin() + played);
+    agentColumn.erase(agentColumn.begin(), agentColumn.begin() + played);
+    xColumn.erase(xColumn.begin(), xColumn.begin() + played);
+    yColumn.erase(yColumn.begin(), yColumn.begin() + played);
+    vxColumn.erase(vxColumn.begin(), vxColumn.begin() + played);
+    vyColumn.erase(vyColumn.begin(), vyColumn.begin() + played);
+    for (WindowFrame& f : frames) {
+        f.first -= played;
+        f.last -= played;
+    }
+    refreshColumns();
+}
+
+void DatasetStream::refreshColumns() {
+    columns.frame = frameColumn.data();
+    columns.agent = agentColumn.data();
+    columns.x = xColumn.data();
+    columns.y = yColumn.data();
+    columns.vx = vxColumn.data();
+    columns.vy = vyColumn.data();
+}
+
+size_t DatasetStream::frameAt(int frameId) const {
+    return std::lower_bound(frames.begin(), frames.end(), frameId,
+                            [](const WindowFrame& f, int id) { return f.frameId < id; }) - frames.begin();
+}
+
+bool DatasetStream::findIn(size_t k, int agentId, size_t& index) const {
+    const int32_t* first = agentColumn.data() + frames[k].first;
+    const int32_t* last = agentColumn.data() + frames[k].last;
+    const int32_t* it = std::lower_bound(first, last, agentId);
+    if (it == last || *it != agentId) {
+        return false;
+    }
+    index = it - agentColumn.data();
+    return true;
+}
+
+FrameView DatasetStream::frame(int frameId) const {
+    size_t k = frameAt(frameId);
+    if (k == frames.size() || frames[k].frameId != frameId) {
+        return FrameView();
+    }
+    return FrameView(&columns, frames[k].first, frames[k].last);
+}
+
+bool DatasetStream::findPoint(int agentId, int frameId, size_t& index) const {
+    size_t k = frameAt(frameId);
+    if (k == frames.size() || frames[k].frameId != frameId) {
+        return false;
+    }
+    return findIn(k, agentId, index);
+}
+
+bool DatasetStream::nextPoint(int agentId, int frameId, size_t& index) const {
+    if (frameId == INT_MAX) {
+        return false;
+    }
+    size_t first = frameAt(frameId + 1);
+    size_t last = std::min(frames.size(), first + lookahead);
+    for (size_t k = first; k < last; ++k) {
+        if (findIn(k, agentId, index)) {
+            return true;
+        }
+    }
+    return false;
+}
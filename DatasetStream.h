@@ -0,0 +1,131 @@
+#ifndef _DATASET_STREAM_H_
+#define _DATASET_STREAM_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Trajectory.h"
+
+// An ETH/UCY file played through a sliding window of frames instead of being
+// loaded whole, for recordings that do not fit in memory. A reader thread
+// reads and parses the file a few blocks ahead of playback; the window holds
+// the current frame and the next `lookahead` recorded frames, and frames
+// are dropped once played. Memory stays bounded however long the file is.
+//
+// Frames must come in order, as they do in the ETH/UCY recordings: a point
+// for a frame the window has already closed is dropped and counted.
+// Velocities are the same differences loadDataset works out, except that
+// the next point is only looked for within the lookahead and the previous
+// one only remembered for as long, so a pedestrian missing for longer
+// starts a new track.
+class DatasetStream {
+private:
+    // One closed frame of the window: points [first, last) of the columns
+    struct WindowFrame {
+        int frameId;
+        size_t first, last;
+        uint64_t seq;  // recorded frames closed before this one
+    };
+
+    // Where an agent was last seen, for the backward difference
+    struct LastSeen {
+        int frameId;
+        uint64_t seq;
+        float x, y;
+    };
+
+    std::string path;
+    std::ifstream input;
+    float frameRate;
+    float pixelToMeter;
+    int lookahead;
+    std::string error;
+
+    // Reader thread and the blocks of parsed points it hands over
+    std::thread reader;
+    std::mutex lock;
+    std::condition_variable blockReady;
+    std::condition_variable blockTaken;
+    std::deque<std::vector<TrajectoryPoint>> blocks;
+    bool readerDone;
+    bool stopping;
+    std::string readError;
+
+    // The window. Columns hold the closed frames; the frame still being
+    // read sits in pending until a later frame shows up
+    std::vector<int32_t> frameColumn, agentColumn;
+    std::vector<float> xColumn, yColumn, vxColumn, vyColumn;
+    PointColumns columns;
+    std::deque<WindowFrame> frames;
+    size_t withVelocity;  // frames at the front whose velocities are set
+    std::vector<TrajectoryPoint> pending;
+    std::vector<TrajectoryPoint> block;  // taken from the reader, read up to blockPos
+    size_t blockPos;
+    uint64_t closedFrames;
+    int lastFrameId;
+    bool exhausted;  // every block has been taken
+    std::unordered_map<int, LastSeen> lastSeen;
+    size_t sweepAt;
+    uint64_t droppedPoints;
+
+    void readLoop();
+    bool takeBlock();
+    void startReader();
+    void stopReader();
+    void resetWindow();
+
+    void fill(int frameId);
+    bool addPoint(const TrajectoryPoint& point);
+    void closePending();
+    void setVelocities(size_t k);
+    void dropBefore(int frameId);
+    void refreshColumns();
+    // Window position of the first closed frame at or after frameId
+    size_t frameAt(int frameId) const;
+    bool findIn(size_t k, int agentId, size_t& index) const;
+
+    DatasetStream(const DatasetStream&);
+    DatasetStream& operator=(const DatasetStream&);
+
+public:
+    DatasetStream();
+    ~DatasetStream();
+
+    // Starts reading; false, with getError() set, if the file cannot be read
+    bool open(const std::string& filename, float frameRate, float pixelToMeter, int lookahead);
+    void close();
+    // Back to the start of the file
+    bool rewind();
+    // Also set, and the window ended, once advance() reaches a read that
+    // failed partway through the file
+    const std::string& getError() const { return error; }
+
+    // Makes frameId current: earlier frames leave the window and it is
+    // filled to `lookahead` recorded frames past frameId, waiting for the
+    // reader if need be. Frames only move forward until rewind(). Views and
+    // point indices from before the call are invalid after it
+    void advance(int frameId);
+    // Largest frame id read so far; once the window has reached the end of
+    // the file, the last frame of the dataset
+    int lastFrame() const { return lastFrameId; }
+    // Pedestrians seen in about the last `lookahead` recorded frames
+    int numAgents() const { return lastSeen.size(); }
+    int getLookahead() const { return lookahead; }
+    uint64_t getDroppedPoints() const { return droppedPoints; }
+
+    // The same queries as TrajectoryFile, over the window only: frames
+    // outside it are empty
+    FrameView frame(int frameId) const;
+    bool findPoint(int agentId, int frameId, size_t& index) const;
+    TrajectoryPoint point(size_t i) const { return columns.point(i); }
+    // First point of agentId after frameId, if it is within the lookahead
+    bool nextPoint(int agentId, int frameId, size_t& index) const;
+};
+
+#endif
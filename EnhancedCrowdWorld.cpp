@@ -1,28 +1,41 @@
 #include "EnhancedCrowdWorld.h"
+#include "Log.h"
+#include "Profiler.h"
 #include <iostream>
 
 EnhancedCrowdWorld::EnhancedCrowdWorld() : CrowdWorld() {
     mode = SOCIAL_FORCE;
     currentTime = 0.0f;
     isPlaying = false;
+    syncCount = 0;
     datasetLoader = std::make_unique<DatasetLoader>();
 }
 
-EnhancedCrowdWorld::EnhancedCrowdWorld(const Json::Value& config) : CrowdWorld(config) {
-    mode = SOCIAL_FORCE;
-    currentTime = 0.0f;
-    isPlaying = false;
-    datasetLoader = std::make_unique<DatasetLoader>();
-    
-    // Check if mode is specified in config
+// Mode requested by the config's "simulation" section, social force by default
+static SimulationMode modeFromConfig(const Json::Value& config) {
     if (config.isMember("simulation") && config["simulation"].isMember("mode")) {
         std::string modeStr = config["simulation"]["mode"].asString();
         if (modeStr == "orca") {
-            mode = ORCA_SIMULATION;
+            return ORCA_SIMULATION;
         } else if (modeStr == "dataset") {
-            mode = DATASET_PLAYBACK;
+            return DATASET_PLAYBACK;
         }
     }
+    return SOCIAL_FORCE;
+}
+
+// In ORCA mode the base class skips the agents so they can be built as ORCAAgents
+EnhancedCrowdWorld::EnhancedCrowdWorld(const Json::Value& config)
+    : CrowdWorld(config, modeFromConfig(config) != ORCA_SIMULATION) {
+    mode = modeFromConfig(config);
+    currentTime = 0.0f;
+    isPlaying = false;
+    syncCount = 0;
+    datasetLoader = std::make_unique<DatasetLoader>();
+    
+    if (mode == ORCA_SIMULATION) {
+        initializeORCA(config);
+    }
 }
 
 EnhancedCrowdWorld::~EnhancedCrowdWorld() {
@@ -43,17 +56,27 @@ void EnhancedCrowdWorld::setDatasetParameters(float frameRate, float pixelToMete
     datasetLoader->setPixelToMeter(pixelToMeter);
 }
 
+void EnhancedCrowdWorld::setDatasetStreaming(bool enabled, int lookahead) {
+    datasetLoader->setStreaming(enabled, lookahead);
+}
+
 void EnhancedCrowdWorld::reset() {
     currentTime = 0.0f;
     isPlaying = false;
     
     if (mode == DATASET_PLAYBACK) {
         datasetLoader->reset();
+        // Playback starts over with nobody in view
+        syncCount++;
+        activeAgents.clear();
+        retireDatasetAgents();
     }
 }
 
 void EnhancedCrowdWorld::step(float deltaT) {
     if (!isPlaying) return;
+    // The step as a whole, whatever the mode
+    PROFILE_PHASE("step");
     
     switch (mode) {
         case SOCIAL_FORCE:
@@ -98,18 +121,76 @@ void EnhancedCrowdWorld::stepWorld(float deltaT) {
     CrowdWorld::stepWorld(deltaT);
 }
 
-void EnhancedCrowdWorld::updateORCA(float deltaT) {
-    // Convert regular agents to ORCA agents if needed
-    std::vector<Agent*> allAgents;
-    for (Agent* agent : agentList) {
-        allAgents.push_back(agent);
+void EnhancedCrowdWorld::initializeORCA(const Json::Value& config) {
+    for (const Json::Value& agentConfig : config["agents"]) {
+        createORCAAgent(agentConfig);
     }
-    
-    // Update each ORCA agent
-    for (ORCAAgent* orcaAgent : orcaAgents) {
-        orcaAgent->calculateORCAVelocity(allAgents, deltaT);
-        orcaAgent->applyForces(deltaT);
+
+    // ORCA scenes list their walls under "walls" as well as "objects"
+    for (const Json::Value& wallConfig : config["walls"]) {
+        createNewObject(wallConfig);
     }
+    buildORCAObstacles();
+}
+
+void EnhancedCrowdWorld::buildORCAObstacles() {
+    // Each wall becomes a two-vertex obstacle, which ORCA treats as a thin
+    // segment avoidable from both sides. The back-to-back copy is skipped.
+    for (size_t i = 0; i < objectList.size(); ++i) {
+        if (objectList[i]->getType() != WALL) {
+            continue;
+        }
+        Wall* wall = static_cast<Wall*>(objectList[i]);
+        if (i + 1 < objectList.size() && objectList[i + 1]->getType() == WALL &&
+            wall->isReverseOf(static_cast<Wall*>(objectList[i + 1]))) {
+            ++i;
+        }
+
+        v2f start, end;
+        wall->getStart(start);
+        wall->getEnd(end);
+        std::vector<std::pair<float, float> > vertices;
+        vertices.push_back(std::make_pair(start[0], start[1]));
+        vertices.push_back(std::make_pair(end[0], end[1]));
+        obstacleTree.addObstacle(vertices);
+    }
+    obstacleTree.build();
+}
+
+ORCAAgent* EnhancedCrowdWorld::createORCAAgent(const Json::Value& config) {
+    ORCAAgent* agent = new ORCAAgent(config, &agentStore);
+    agent->updatePrefVelocity();
+    orcaAgents.push_back(agent);
+    agentList.push_back(agent);
+    drawAgent(agent);
+    return agent;
+}
+
+Agent* EnhancedCrowdWorld::addAgent(const Json::Value& config) {
+    if (mode == ORCA_SIMULATION) {
+        return createORCAAgent(config);
+    }
+    return CrowdWorld::addAgent(config);
+}
+
+void EnhancedCrowdWorld::updateORCA(float deltaT) {
+    PROFILE_PHASE("EnhancedCrowdWorld::updateORCA");
+    // Neighbors come from a k-d tree over this step's positions
+    agentTree.build(agentList);
+    
+    // Every agent picks its new velocity from the same snapshot of positions
+    // and velocities before anyone moves, so both phases split across threads
+    parallelFor(orcaAgents.size(), [&](int begin, int end, int) {
+        for (int i = begin; i < end; ++i) {
+            orcaAgents[i]->updatePrefVelocity();
+            orcaAgents[i]->calculateORCAVelocity(agentTree, obstacleTree, deltaT);
+        }
+    });
+    parallelFor(orcaAgents.size(), [&](int begin, int end, int) {
+        for (int i = begin; i < end; ++i) {
+            orcaAgents[i]->applyForces(deltaT);
+        }
+    });
 }
 
 void EnhancedCrowdWorld::updateDatasetPlayback(float deltaT) {
@@ -123,23 +204,78 @@ void EnhancedCrowdWorld::updateDatasetPlayback(float deltaT) {
 }
 
 void EnhancedCrowdWorld::syncAgentsWithDataset() {
-    // Clear existing agents
-    clearAgents();
-    
-    // Get current frame data
-    std::vector<TrajectoryPoint> currentFrame = datasetLoader->getCurrentFrameData();
+    PROFILE_PHASE("EnhancedCrowdWorld::syncAgentsWithDataset");
+    FrameView currentFrame = datasetLoader->getFrameView(datasetLoader->getCurrentFrame());
     
-    // Create agents for current frame
+    // Pedestrians already in view keep their agent; new ones get one from
+    // the pool. Either way only the kinematic state changes
+    syncCount++;
+    activeAgents.clear();
     for (const TrajectoryPoint& point : currentFrame) {
-        createDatasetAgent(point);
+        auto it = datasetAgents.find(point.agentId);
+        Agent* agent;
+        if (it != datasetAgents.end()) {
+            agent = it->second;
+        } else {
+            agent = acquireDatasetAgent(point);
+            datasetAgents[point.agentId] = agent;
+        }
+        placeDatasetAgent(agent, point);
+        activeAgents.push_back(agent);
     }
+    retireDatasetAgents();
 }
 
-void EnhancedCrowdWorld::createDatasetAgent(const TrajectoryPoint& point) {
-    Json::Value agentConfig = datasetLoader->createAgentJson(point);
-    Agent* agent = new Agent(agentConfig);
+Agent* EnhancedCrowdWorld::acquireDatasetAgent(const TrajectoryPoint& point) {
+    if (!freeDatasetAgents.empty()) {
+        Agent* agent = freeDatasetAgents.back();
+        freeDatasetAgents.pop_back();
+        return agent;
+    }
+    // Every dataset agent has the same parameters, so the JSON is only
+    // needed when the pool grows
+    Agent* agent = new Agent(datasetLoader->createAgentJson(point), &agentStore);
     agentList.push_back(agent);
-    objectList.push_back(agent);
+    datasetStamp.resize(agentStore.size(), 0);
+    return agent;
+}
+
+void EnhancedCrowdWorld::placeDatasetAgent(Agent* agent, const TrajectoryPoint& point) {
+    int slot = agent->getId();
+    datasetStamp[slot] = syncCount;
+    agentStore.reset(slot);
+    agentStore.x[slot] = point.x;
+    agentStore.y[slot] = point.y;
+    agentStore.vx[slot] = point.vx;
+    agentStore.vy[slot] = point.vy;
+    if (point.vx != 0.0f || point.vy != 0.0f) {
+        v2f v = {point.vx, point.vy}, n;
+        v2fNormalize(v, n);
+        agentStore.setNorm(slot, n);
+    }
+    
+    // Heading for where the pedestrian is next seen
+    TrajectoryPoint next;
+    if (!datasetLoader->getNextPoint(point, next)) {
+        next = point;
+    }
+    agentStore.ax[slot] = next.x;
+    agentStore.ay[slot] = next.y;
+}
+
+// Returns the agents of pedestrians missing from the last sync to the pool
+void EnhancedCrowdWorld::retireDatasetAgents() {
+    for (auto it = datasetAgents.begin(); it != datasetAgents.end();) {
+        int slot = it->second->getId();
+        if (datasetStamp[slot] == syncCount) {
+            ++it;
+            continue;
+        }
+        agentStore.vx[slot] = 0.0f;
+        agentStore.vy[slot] = 0.0f;
+        freeDatasetAgents.push_back(it->second);
+        it = datasetAgents.erase(it);
+    }
 }
 
 void EnhancedCrowdWorld::clearAgents() {
@@ -149,7 +285,16 @@ void EnhancedCrowdWorld::clearAgents() {
     }
     orcaAgents.clear();
     
-    // Note: Regular agents are cleaned up by base class
+    // Dataset agents, in view or pooled
+    for (auto& entry : datasetAgents) {
+        delete entry.second;
+    }
+    datasetAgents.clear();
+    for (Agent* agent : freeDatasetAgents) {
+        delete agent;
+    }
+    freeDatasetAgents.clear();
+    activeAgents.clear();
 }
 
 void EnhancedCrowdWorld::setORCAParameters(float timeHorizon, float neighborDist, int maxNeighbors) {
@@ -167,12 +312,23 @@ int EnhancedCrowdWorld::getCurrentFrame() const {
     return (int)(currentTime * 2.5f); // Assume 2.5 fps default
 }
 
-void EnhancedCrowdWorld::exportTrajectories(const std::string& filename) {
-    if (mode == DATASET_PLAYBACK) {
-        datasetLoader->exportToJson(filename);
-    } else {
-        std::cout << "Trajectory export only available in dataset mode" << std::endl;
+static bool hasExtension(const std::string& filename, const std::string& ext) {
+    return filename.size() >= ext.size() &&
+           filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+bool EnhancedCrowdWorld::exportTrajectories(const std::string& filename) {
+    if (mode != DATASET_PLAYBACK) {
+        LOG_WARN("Trajectory export only available in dataset mode");
+        return false;
     }
+    // The extension picks the format; JSON unless it says otherwise
+    if (hasExtension(filename, ".csv")) {
+        return datasetLoader->exportToCsv(filename);
+    } else if (hasExtension(filename, ".traj")) {
+        return datasetLoader->exportToBinary(filename);
+    }
+    return datasetLoader->exportToJson(filename);
 }
 
 void EnhancedCrowdWorld::printSimulationStats() {
@@ -186,42 +342,61 @@ void EnhancedCrowdWorld::printSimulationStats() {
     std::cout << std::endl;
     std::cout << "  Current time: " << currentTime << "s" << std::endl;
     std::cout << "  Number of agents: " << agentList.size() << std::endl;
+    if (mode == DATASET_PLAYBACK) {
+        std::cout << "  Agents in view: " << activeAgents.size() << std::endl;
+    }
     
     if (mode == DATASET_PLAYBACK) {
         std::cout << "  Current frame: " << getCurrentFrame() << std::endl;
         std::cout << "  Total frames: " << datasetLoader->getMaxFrame() + 1 << std::endl;
     }
+    if (getScheduler()) {
+        std::cout << "  Threads: " << getThreads() << std::endl;
+        getScheduler()->printStats(std::cout);
+    }
+}
+
+bool EnhancedCrowdWorld::compareWithGroundTruth(const std::string& gtFilename, const std::string& format,
+                                                float collisionDistance) {
+    if (mode != DATASET_PLAYBACK || datasetLoader->isStreaming()) {
+        LOG_WARN("Comparison needs a loaded (not streamed) dataset to score");
+        return false;
+    }
+    DatasetLoader truth;
+    truth.setFrameRate(datasetLoader->getFrameRate());
+    truth.setPixelToMeter(datasetLoader->getPixelToMeter());
+    if (!truth.loadDataset(gtFilename, format)) {
+        LOG_ERROR("Failed to load ground truth: " << gtFilename);
+        return false;
+    }
+
+    EvaluationOptions options;
+    options.collisionDistance = collisionDistance;
+    options.scheduler = getScheduler();
+    EvaluationResult result = evaluateTrajectories(datasetLoader->getTable(), truth.getTable(), options);
+    std::cout << "Comparison with " << gtFilename << ":" << std::endl;
+    printEvaluation(std::cout, result);
+    return true;
+}
+
+// Both sides go through a table so the points can be paired by agent and
+// frame; the crowd statistics are not needed
+static EvaluationResult displacementErrors(const std::vector<TrajectoryPoint>& predicted,
+                                           const std::vector<TrajectoryPoint>& groundTruth) {
+    TrajectoryFile p, g;
+    p.build(predicted, 1.0f, 1.0f);
+    g.build(groundTruth, 1.0f, 1.0f);
+    EvaluationOptions options;
+    options.crowdStatistics = false;
+    return evaluateTrajectories(p, g, options);
 }
 
 float EnhancedCrowdWorld::calculateADE(const std::vector<TrajectoryPoint>& predicted, 
                                      const std::vector<TrajectoryPoint>& groundTruth) {
-    // Average Displacement Error calculation
-    float totalError = 0.0f;
-    int count = 0;
-    
-    size_t minSize = std::min(predicted.size(), groundTruth.size());
-    for (size_t i = 0; i < minSize; ++i) {
-        float dx = predicted[i].x - groundTruth[i].x;
-        float dy = predicted[i].y - groundTruth[i].y;
-        totalError += sqrt(dx * dx + dy * dy);
-        count++;
-    }
-    
-    return count > 0 ? totalError / count : 0.0f;
+    return displacementErrors(predicted, groundTruth).ade;
 }
 
 float EnhancedCrowdWorld::calculateFDE(const std::vector<TrajectoryPoint>& predicted, 
                                      const std::vector<TrajectoryPoint>& groundTruth) {
-    // Final Displacement Error calculation
-    if (predicted.empty() || groundTruth.empty()) {
-        return 0.0f;
-    }
-    
-    const TrajectoryPoint& predFinal = predicted.back();
-    const TrajectoryPoint& gtFinal = groundTruth.back();
-    
-    float dx = predFinal.x - gtFinal.x;
-    float dy = predFinal.y - gtFinal.y;
-    
-    return sqrt(dx * dx + dy * dy);
+    return displacementErrors(predicted, groundTruth).fde;
 }
@@ -4,7 +4,10 @@
 #include "CrowdWorld.h"
 #include "ORCAAgent.h"
 #include "DatasetLoader.h"
+#include "Evaluation.h"
+#include "KdTree.h"
 #include <memory>
+#include <unordered_map>
 
 enum SimulationMode {
     SOCIAL_FORCE,    // Original force-based simulation
@@ -17,22 +20,38 @@ private:
     SimulationMode mode;
     std::unique_ptr<DatasetLoader> datasetLoader;
     std::vector<ORCAAgent*> orcaAgents;
+    AgentKdTree agentTree;      // ORCA neighbor search, rebuilt every step
+    ObstacleKdTree obstacleTree; // walls as ORCA obstacles, built once
     
     float currentTime;
     bool isPlaying;
     
+    // Dataset playback keeps one agent per dataset agentId while that
+    // pedestrian is in view, and only moves it from frame to frame. Agents
+    // whose pedestrian has left go back to a free list and are handed to the
+    // next arrival, so agentList (and agentStore) only grow to the largest
+    // crowd seen at once. Free agents stay in agentList, parked.
+    std::unordered_map<int, Agent*> datasetAgents;  // agentId -> agent
+    std::vector<Agent*> freeDatasetAgents;
+    std::vector<Agent*> activeAgents;               // this frame's, in frame order
+    std::vector<int> datasetStamp;                  // per slot: last sync that placed it
+    int syncCount;
+    
     // ORCA-specific methods
-    void initializeORCA();
+    void initializeORCA(const Json::Value& config);
+    void buildORCAObstacles();
     void updateORCA(float deltaT);
     
     // Dataset playback methods
     void initializeDatasetPlayback(const std::string& filename, const std::string& format);
     void updateDatasetPlayback(float deltaT);
     void syncAgentsWithDataset();
+    void placeDatasetAgent(Agent* agent, const TrajectoryPoint& point);
+    void retireDatasetAgents();
     
     // Agent management
-    void createORCAAgent(const Json::Value& config);
-    void createDatasetAgent(const TrajectoryPoint& point);
+    ORCAAgent* createORCAAgent(const Json::Value& config);
+    Agent* acquireDatasetAgent(const TrajectoryPoint& point);
     void clearAgents();
 
 public:
@@ -47,6 +66,8 @@ public:
     // Dataset functionality
     bool loadDataset(const std::string& filename, const std::string& format = "eth");
     void setDatasetParameters(float frameRate, float pixelToMeter);
+    // Stream eth/ucy datasets instead of loading them (DatasetLoader::setStreaming)
+    void setDatasetStreaming(bool enabled, int lookahead);
     
     // Enhanced simulation control
     void reset();
@@ -58,9 +79,13 @@ public:
     void updateAgents() override;
     void calcForces() override;
     void stepWorld(float deltaT) override;
+    // ORCA worlds add an ORCA agent
+    Agent* addAgent(const Json::Value& config) override;
     
     // Statistics and analysis
-    void exportTrajectories(const std::string& filename);
+    // Dataset trajectories as CSV (.csv), a binary trajectory file (.traj)
+    // or JSON (anything else); false if nothing was written
+    bool exportTrajectories(const std::string& filename);
     void printSimulationStats();
     
     // ORCA configuration
@@ -68,11 +93,19 @@ public:
     
     // Getters
     float getCurrentTime() const { return currentTime; }
+    // Picks the clock up where a restored checkpoint left it
+    void setCurrentTime(float time) { currentTime = time; }
     bool getIsPlaying() const { return isPlaying; }
     int getCurrentFrame() const;
     
-    // Comparison and evaluation
-    void compareWithGroundTruth(const std::string& gtFilename);
+    // Comparison and evaluation. The loaded dataset is the prediction and is
+    // scored against gtFilename, loaded with the same frame rate and scale;
+    // see Evaluation.h. Points pair up by agent id and frame, so the
+    // prediction must use the ground truth's ids and frame numbers (a
+    // recorded simulation does not). Prints the result
+    bool compareWithGroundTruth(const std::string& gtFilename, const std::string& format = "eth",
+                                float collisionDistance = 0.2f);
+    // Points are paired by agent id and frame, whatever order they come in
     float calculateADE(const std::vector<TrajectoryPoint>& predicted, 
                       const std::vector<TrajectoryPoint>& groundTruth);
     float calculateFDE(const std::vector<TrajectoryPoint>& predicted, 
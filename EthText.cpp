@@ -0,0 +1,154 @@
+#include "EthText.h"
+#include <charconv>
+#include <climits>
+#include <cstring>
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+bool scanInt(const char*& p, const char* end, int& out) {
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p == end || !isDigit(*p)) {
+        return false;
+    }
+    long long v = 0;
+    while (p < end && isDigit(*p)) {
+        v = v * 10 + (*p++ - '0');
+        if (v > 2147483648LL) {
+            return false;
+        }
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && *p == '0') {
+            ++p;
+        }
+        if (p < end && isDigit(*p)) {
+            return false;
+        }
+    }
+    v = negative ? -v : v;
+    if (v > INT_MAX || v < INT_MIN) {
+        return false;
+    }
+    out = (int)v;
+    return true;
+}
+
+// Short decimals, which is all the datasets hold, are one exact float
+// multiply or divide; anything longer goes through std::from_chars
+bool scanFloat(const char*& p, const char* end, float& out) {
+    static const float powers[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    const char* number = p;
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while (p < end && isDigit(*p)) {
+        mantissa = mantissa * 10 + (*p++ - '0');
+        ++digits;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isDigit(*p)) {
+            mantissa = mantissa * 10 + (*p++ - '0');
+            ++digits;
+            --exponent;
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+    bool simple = digits <= 19;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool eNegative = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eNegative = *e == '-';
+            ++e;
+        }
+        if (e < end && isDigit(*e)) {
+            int ev = 0;
+            while (e < end && isDigit(*e)) {
+                if (ev < 100000) {
+                    ev = ev * 10 + (*e - '0');
+                }
+                ++e;
+            }
+            exponent += eNegative ? -ev : ev;
+            p = e;
+        }
+    }
+
+    float v;
+    if (simple && mantissa < (1ULL << 24) && exponent >= -10 && exponent <= 10) {
+        // Both operands are exact, so the one rounding is the right one
+        v = exponent < 0 ? (float)mantissa / powers[-exponent]
+                         : (float)mantissa * powers[exponent];
+    } else {
+        std::from_chars_result r = std::from_chars(number, p, v);
+        if (r.ec != std::errc() || r.ptr != p) {
+            return false;
+        }
+    }
+    out = negative ? -v : v;
+    return true;
+}
+
+void parseETHLines(const char* begin, const char* end, const char* limit,
+                   float pixelToMeter, std::vector<TrajectoryPoint>& points) {
+    // No valid line is shorter than "0 0 0 0\n", so this never reallocates.
+    // Capacity that is never written to is never faulted in either
+    points.reserve((end - begin) / 8 + 1);
+    const char* p = begin;
+    while (p < end) {
+        // The scanners stop at the newline by themselves, so the line is
+        // only read once
+        TrajectoryPoint point;
+        if (scanInt(p, limit, point.frameId) && scanInt(p, limit, point.agentId) &&
+            scanFloat(p, limit, point.x) && scanFloat(p, limit, point.y)) {
+            // Convert from pixels to meters
+            point.x *= pixelToMeter;
+            point.y *= pixelToMeter;
+            point.vx = 0.0f;  // Will be calculated later
+            point.vy = 0.0f;
+            points.push_back(point);
+        }
+        // Anything else on the line is ignored; malformed lines are skipped
+        while (p < limit && isBlank(*p)) {
+            ++p;
+        }
+        if (p < limit && *p != '\n') {
+            p = static_cast<const char*>(memchr(p, '\n', limit - p));
+            if (!p) {
+                break;
+            }
+        }
+        ++p;
+    }
+}
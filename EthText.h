@@ -0,0 +1,25 @@
+#ifndef _ETH_TEXT_H_
+#define _ETH_TEXT_H_
+
+#include <vector>
+#include "Trajectory.h"
+
+// Text scanning for ETH/UCY datasets, shared by the loader and the stream.
+// Lines are read straight out of a buffer; a scanner skips blanks, reads one
+// number and leaves p just past it, or returns false if there is no number
+// there. None of them moves past a newline or past end.
+
+// Integer field. Some releases of the datasets write ids as "780.0", which is
+// accepted as long as the fraction is zero
+bool scanInt(const char*& p, const char* end, int& out);
+
+// Float field, rounded the same way as stream extraction
+bool scanFloat(const char*& p, const char* end, float& out);
+
+// Parses the "frame agent x y" lines that start in [begin, end) of a buffer
+// ending at limit, appending the points with positions scaled by
+// pixelToMeter and velocities left zero. Malformed lines are skipped
+void parseETHLines(const char* begin, const char* end, const char* limit,
+                   float pixelToMeter, std::vector<TrajectoryPoint>& points);
+
+#endif
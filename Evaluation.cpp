@@ -0,0 +1,224 @@
+#include "Evaluation.h"
+#include "TaskScheduler.h"
+#include "VectorBatch.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+static const float infinity = std::numeric_limits<float>::infinity();
+
+// Runs body over [0, n) on the scheduler, or inline without one
+static void forRange(TaskScheduler* scheduler, int n, const TaskScheduler::RangeBody& body) {
+    if (scheduler) {
+        scheduler->parallelFor(n, body);
+    } else {
+        body(0, n, 0);
+    }
+}
+
+static EvaluationResult emptyResult() {
+    EvaluationResult r;
+    r.matchedPoints = 0;
+    r.predictedPoints = 0;
+    r.groundTruthPoints = 0;
+    r.matchedAgents = 0;
+    r.ade = 0.0;
+    r.fde = 0.0;
+    r.agentFrames = 0;
+    r.collisions = 0;
+    r.collisionRate = 0.0;
+    r.minDistance = infinity;
+    r.meanMinDistance = 0.0;
+    return r;
+}
+
+void nearestDistances(const float* x, const float* y, int n, float* nearest) {
+    // One row of distances at a time, from point i to the whole frame
+    static thread_local std::vector<float> row;
+    if (row.size() < (size_t)n) {
+        row.resize(n);
+    }
+    for (int i = 0; i < n; ++i) {
+        v2f from = { x[i], y[i] };
+        v2fBatchDist(x, y, from, row.data(), n);
+        row[i] = infinity;
+        float best = infinity;
+        for (int j = 0; j < n; ++j) {
+            best = std::min(best, row[j]);
+        }
+        nearest[i] = best;
+    }
+}
+
+namespace {
+
+// Displacement errors of one predicted agent
+struct AgentError {
+    double sum;
+    size_t count;
+    float final;
+};
+
+// Crowd statistics of one frame
+struct FrameCrowd {
+    size_t agentFrames;
+    size_t collisions;
+    double nearestSum;
+    float minDistance;
+};
+
+// Per-worker buffers for the matched pairs
+struct PairScratch {
+    std::vector<float> dx, dy, error;
+};
+
+}
+
+// Pairs agent a of predicted with the same id in groundTruth, frame by
+// frame; both lists are in frame order, so one merge pass finds every pair
+static AgentError agentError(const TrajectoryFile& predicted, const TrajectoryFile& groundTruth,
+                             int a, PairScratch& s) {
+    AgentError e = { 0.0, 0, 0.0f };
+    int g = groundTruth.findAgent(predicted.agentId(a));
+    if (g < 0) {
+        return e;
+    }
+    const PointColumns& pc = predicted.getColumns();
+    const PointColumns& gc = groundTruth.getColumns();
+    const uint32_t* p = predicted.agentPointIndices(a);
+    const uint32_t* q = groundTruth.agentPointIndices(g);
+    size_t n = predicted.agentSize(a), m = groundTruth.agentSize(g);
+
+    s.dx.resize(std::min(n, m));
+    s.dy.resize(std::min(n, m));
+    size_t pairs = 0;
+    for (size_t i = 0, j = 0; i < n && j < m;) {
+        int pf = pc.frame[p[i]], gf = gc.frame[q[j]];
+        if (pf < gf) {
+            ++i;
+        } else if (gf < pf) {
+            ++j;
+        } else {
+            s.dx[pairs] = pc.x[p[i]] - gc.x[q[j]];
+            s.dy[pairs] = pc.y[p[i]] - gc.y[q[j]];
+            ++pairs;
+            ++i;
+            ++j;
+        }
+    }
+    if (pairs == 0) {
+        return e;
+    }
+
+    s.error.resize(pairs);
+    v2fBatchLen(s.dx.data(), s.dy.data(), s.error.data(), pairs);
+    for (size_t k = 0; k < pairs; ++k) {
+        e.sum += s.error[k];
+    }
+    e.count = pairs;
+    e.final = s.error[pairs - 1];
+    return e;
+}
+
+static FrameCrowd frameCrowd(const TrajectoryFile& trajectories, int frameId, float collisionDistance,
+                             std::vector<float>& nearest) {
+    FrameCrowd c = { 0, 0, 0.0, infinity };
+    FrameView view = trajectories.frame(frameId);
+    if (view.size() < 2) {
+        return c;
+    }
+    const PointColumns& columns = trajectories.getColumns();
+    size_t first = view.pointIndex(0);
+    int n = view.size();
+    nearest.resize(n);
+    nearestDistances(columns.x + first, columns.y + first, n, nearest.data());
+    for (int i = 0; i < n; ++i) {
+        c.nearestSum += nearest[i];
+        c.minDistance = std::min(c.minDistance, nearest[i]);
+        if (nearest[i] < collisionDistance) {
+            ++c.collisions;
+        }
+    }
+    c.agentFrames = n;
+    return c;
+}
+
+// Fills in the crowd fields of r from trajectories
+static void measureFrames(const TrajectoryFile& trajectories, const EvaluationOptions& options,
+                            EvaluationResult& r) {
+    int frames = trajectories.numFrames();
+    int workers = options.scheduler ? options.scheduler->size() : 1;
+    std::vector<FrameCrowd> crowd(frames);
+    std::vector<std::vector<float> > nearest(workers);
+    forRange(options.scheduler, frames, [&](int begin, int end, int worker) {
+        for (int f = begin; f < end; ++f) {
+            crowd[f] = frameCrowd(trajectories, trajectories.firstFrame() + f, options.collisionDistance,
+                                  nearest[worker]);
+        }
+    });
+
+    double nearestSum = 0.0;
+    for (const FrameCrowd& c : crowd) {
+        r.agentFrames += c.agentFrames;
+        r.collisions += c.collisions;
+        nearestSum += c.nearestSum;
+        r.minDistance = std::min(r.minDistance, c.minDistance);
+    }
+    if (r.agentFrames > 0) {
+        r.collisionRate = (double)r.collisions / r.agentFrames;
+        r.meanMinDistance = nearestSum / r.agentFrames;
+    }
+}
+
+EvaluationResult evaluateTrajectories(const TrajectoryFile& predicted, const TrajectoryFile& groundTruth,
+                                      const EvaluationOptions& options) {
+    EvaluationResult r = emptyResult();
+    r.predictedPoints = predicted.numPoints();
+    r.groundTruthPoints = groundTruth.numPoints();
+
+    int agents = predicted.numAgents();
+    int workers = options.scheduler ? options.scheduler->size() : 1;
+    std::vector<AgentError> errors(agents);
+    std::vector<PairScratch> scratch(workers);
+    forRange(options.scheduler, agents, [&](int begin, int end, int worker) {
+        for (int a = begin; a < end; ++a) {
+            errors[a] = agentError(predicted, groundTruth, a, scratch[worker]);
+        }
+    });
+
+    double sum = 0.0, finalSum = 0.0;
+    for (const AgentError& e : errors) {
+        if (e.count > 0) {
+            sum += e.sum;
+            finalSum += e.final;
+            r.matchedPoints += e.count;
+            ++r.matchedAgents;
+        }
+    }
+    if (r.matchedPoints > 0) {
+        r.ade = sum / r.matchedPoints;
+        r.fde = finalSum / r.matchedAgents;
+    }
+
+    if (options.crowdStatistics) {
+        measureFrames(predicted, options, r);
+    }
+    return r;
+}
+
+EvaluationResult measureCrowd(const TrajectoryFile& trajectories, const EvaluationOptions& options) {
+    EvaluationResult r = emptyResult();
+    r.predictedPoints = trajectories.numPoints();
+    measureFrames(trajectories, options, r);
+    return r;
+}
+
+void printEvaluation(std::ostream& out, const EvaluationResult& r) {
+    out << "  Matched points: " << r.matchedPoints << " of " << r.predictedPoints << " predicted, "
+        << r.groundTruthPoints << " ground truth (" << r.matchedAgents << " agents)" << std::endl;
+    out << "  ADE: " << r.ade << " m" << std::endl;
+    out << "  FDE: " << r.fde << " m" << std::endl;
+    out << "  Collision rate: " << r.collisionRate << " (" << r.collisions << " of " << r.agentFrames
+        << " agent-frames)" << std::endl;
+    out << "  Min distance: " << r.minDistance << " m, mean nearest: " << r.meanMinDistance << " m" << std::endl;
+}
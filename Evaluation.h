@@ -0,0 +1,61 @@
+#ifndef _EVALUATION_H_
+#define _EVALUATION_H_
+
+#include <cstddef>
+#include <ostream>
+#include "TrajectoryFile.h"
+
+class TaskScheduler;
+
+// Scores predicted trajectories against ground truth. Points are paired by
+// (agent id, frame) through the agent indexes of the two tables, never by
+// position in a list, so either side may have agents or frames the other
+// lacks; those points are counted but not scored.
+//
+// Distances run through the v2fBatch kernels (see VectorBatch.h), and the
+// work is spread over a TaskScheduler when one is given: agents for the
+// displacement errors, frames for the crowd statistics. Every agent's and
+// frame's share is kept apart and summed in order at the end, so results
+// are the same for any number of threads.
+
+struct EvaluationResult {
+    // Displacement errors over the points present on both sides
+    size_t matchedPoints;
+    size_t predictedPoints;
+    size_t groundTruthPoints;
+    int matchedAgents;
+    double ade;               // mean displacement over matched points
+    double fde;               // mean over agents of the displacement at their last matched frame
+
+    // Crowd statistics of the predictions, frame by frame
+    size_t agentFrames;       // predicted points that share their frame with another agent
+    size_t collisions;        // of those, points closer than the collision distance to another
+    double collisionRate;     // collisions / agentFrames
+    float minDistance;        // closest any two agents come; infinite if none ever share a frame
+    double meanMinDistance;   // mean over agentFrames of the distance to the nearest other agent
+};
+
+struct EvaluationOptions {
+    float collisionDistance;  // meters between agent centres
+    bool crowdStatistics;     // off leaves the crowd fields at zero
+    TaskScheduler* scheduler; // null runs everything on the calling thread
+
+    EvaluationOptions() : collisionDistance(0.2f), crowdStatistics(true), scheduler(nullptr) {}
+};
+
+// ADE, FDE and the crowd statistics of predicted
+EvaluationResult evaluateTrajectories(const TrajectoryFile& predicted, const TrajectoryFile& groundTruth,
+                                      const EvaluationOptions& options = EvaluationOptions());
+
+// Only the crowd statistics, for one table on its own (the ground truth's
+// own collision rate, say); the displacement fields are left at zero
+EvaluationResult measureCrowd(const TrajectoryFile& trajectories,
+                              const EvaluationOptions& options = EvaluationOptions());
+
+// Distance from every point of a frame to its nearest neighbour in the same
+// frame, infinite for a point alone: nearest[i] for (x[i], y[i]), i < n
+void nearestDistances(const float* x, const float* y, int n, float* nearest);
+
+void printEvaluation(std::ostream& out, const EvaluationResult& result);
+
+#endif
@@ -0,0 +1,348 @@
+#include "KdTree.h"
+#include "ORCAAgent.h"
+#include <algorithm>
+
+// Maximum number of agents in a leaf before it gets split
+const int KD_MAX_LEAF_SIZE = 10;
+
+AgentKdTree::AgentKdTree() {
+}
+
+void AgentKdTree::build(const std::vector<Agent*>& agentList) {
+    agents.assign(agentList.begin(), agentList.end());
+    posX.resize(agents.size());
+    posY.resize(agents.size());
+    for (size_t i = 0; i < agents.size(); ++i) {
+        v2f p;
+        agents[i]->getPos(p);
+        posX[i] = p[0];
+        posY[i] = p[1];
+    }
+
+    nodes.clear();
+    if (!agents.empty()) {
+        nodes.resize(2 * agents.size() - 1);
+        buildRecursive(0, agents.size(), 0);
+    }
+}
+
+void AgentKdTree::buildRecursive(int begin, int end, int node) {
+    Node& n = nodes[node];
+    n.begin = begin;
+    n.end = end;
+    n.left = n.right = -1;
+    n.minX = n.maxX = posX[begin];
+    n.minY = n.maxY = posY[begin];
+
+    for (int i = begin + 1; i < end; ++i) {
+        n.maxX = std::max(n.maxX, posX[i]);
+        n.minX = std::min(n.minX, posX[i]);
+        n.maxY = std::max(n.maxY, posY[i]);
+        n.minY = std::min(n.minY, posY[i]);
+    }
+
+    if (end - begin <= KD_MAX_LEAF_SIZE) {
+        return;
+    }
+
+    // Split the wider side of the bounding box at its midpoint
+    const bool isVertical = (n.maxX - n.minX > n.maxY - n.minY);
+    const float splitValue = isVertical ? 0.5f * (n.maxX + n.minX) : 0.5f * (n.maxY + n.minY);
+    const std::vector<float>& key = isVertical ? posX : posY;
+
+    int left = begin;
+    int right = end;
+    while (left < right) {
+        while (left < right && key[left] < splitValue) {
+            ++left;
+        }
+        while (right > left && key[right - 1] >= splitValue) {
+            --right;
+        }
+        if (left < right) {
+            std::swap(agents[left], agents[right - 1]);
+            std::swap(posX[left], posX[right - 1]);
+            std::swap(posY[left], posY[right - 1]);
+            ++left;
+            --right;
+        }
+    }
+
+    // All agents on one side of the split (coincident positions)
+    if (left == begin) {
+        ++left;
+        ++right;
+    }
+
+    n.left = node + 1;
+    n.right = node + 2 * (left - begin);
+    int leftNode = n.left;
+    int rightNode = n.right;
+    buildRecursive(begin, left, leftNode);
+    buildRecursive(left, end, rightNode);
+}
+
+void AgentKdTree::computeAgentNeighbors(ORCAAgent* agent, float& rangeSq) const {
+    if (nodes.empty()) {
+        return;
+    }
+    v2f pos;
+    agent->getPos(pos);
+    queryRecursive(agent, pos, rangeSq, 0);
+}
+
+void AgentKdTree::queryRecursive(ORCAAgent* agent, const v2f& pos, float& rangeSq, int node) const {
+    const Node& n = nodes[node];
+
+    if (n.end - n.begin <= KD_MAX_LEAF_SIZE) {
+        for (int i = n.begin; i < n.end; ++i) {
+            float dx = posX[i] - pos[0];
+            float dy = posY[i] - pos[1];
+            agent->insertAgentNeighbor(agents[i], dx * dx + dy * dy, rangeSq);
+        }
+        return;
+    }
+
+    // Squared distance from the agent to each child's bounding box
+    const Node& l = nodes[n.left];
+    const Node& r = nodes[n.right];
+    auto boxDistSq = [&pos](const Node& c) {
+        float dx = std::max(0.0f, c.minX - pos[0]) + std::max(0.0f, pos[0] - c.maxX);
+        float dy = std::max(0.0f, c.minY - pos[1]) + std::max(0.0f, pos[1] - c.maxY);
+        return dx * dx + dy * dy;
+    };
+    const float distSqLeft = boxDistSq(l);
+    const float distSqRight = boxDistSq(r);
+
+    // Visit the closer child first so rangeSq shrinks as early as possible
+    if (distSqLeft < distSqRight) {
+        if (distSqLeft < rangeSq) {
+            queryRecursive(agent, pos, rangeSq, n.left);
+            if (distSqRight < rangeSq) {
+                queryRecursive(agent, pos, rangeSq, n.right);
+            }
+        }
+    } else {
+        if (distSqRight < rangeSq) {
+            queryRecursive(agent, pos, rangeSq, n.right);
+            if (distSqLeft < rangeSq) {
+                queryRecursive(agent, pos, rangeSq, n.left);
+            }
+        }
+    }
+}
+
+// Positive if c lies to the left of the directed line a -> b
+static float leftOf(const v2f& a, const v2f& b, const v2f& c) {
+    return (a[0] - c[0]) * (b[1] - a[1]) - (a[1] - c[1]) * (b[0] - a[0]);
+}
+
+ObstacleKdTree::ObstacleKdTree() {
+    root = -1;
+}
+
+ObstacleKdTree::~ObstacleKdTree() {
+    for (ORCAObstacle* obstacle : obstacles) {
+        delete obstacle;
+    }
+}
+
+int ObstacleKdTree::addObstacle(const std::vector<std::pair<float, float> >& vertices) {
+    if (vertices.size() < 2) {
+        return -1;
+    }
+
+    const size_t count = vertices.size();
+    const int first = obstacles.size();
+
+    for (size_t i = 0; i < count; ++i) {
+        ORCAObstacle* obstacle = new ORCAObstacle();
+        obstacle->point[0] = vertices[i].first;
+        obstacle->point[1] = vertices[i].second;
+        obstacle->next = obstacle->prev = NULL;
+
+        if (i != 0) {
+            obstacle->prev = obstacles.back();
+            obstacle->prev->next = obstacle;
+        }
+        if (i == count - 1) {
+            obstacle->next = obstacles[first];
+            obstacle->next->prev = obstacle;
+        }
+
+        const std::pair<float, float>& nextVertex = vertices[(i == count - 1) ? 0 : i + 1];
+        v2f dir;
+        dir[0] = nextVertex.first - vertices[i].first;
+        dir[1] = nextVertex.second - vertices[i].second;
+        v2fNormalize(dir, obstacle->unitDir);
+
+        if (count == 2) {
+            obstacle->isConvex = true;
+        } else {
+            const std::pair<float, float>& prevVertex = vertices[(i == 0) ? count - 1 : i - 1];
+            v2f a, c;
+            a[0] = prevVertex.first;
+            a[1] = prevVertex.second;
+            c[0] = nextVertex.first;
+            c[1] = nextVertex.second;
+            obstacle->isConvex = (leftOf(a, obstacle->point, c) >= 0.0f);
+        }
+
+        obstacle->id = obstacles.size();
+        obstacles.push_back(obstacle);
+    }
+
+    return first;
+}
+
+void ObstacleKdTree::build() {
+    nodes.clear();
+    std::vector<ORCAObstacle*> edges(obstacles.begin(), obstacles.end());
+    root = buildRecursive(edges);
+}
+
+int ObstacleKdTree::buildRecursive(const std::vector<ORCAObstacle*>& edges) {
+    if (edges.empty()) {
+        return -1;
+    }
+
+    // Pick the splitting edge that leaves the most balanced halves, counting
+    // edges that straddle the split on both sides
+    size_t optimalSplit = 0;
+    size_t minLeft = edges.size();
+    size_t minRight = edges.size();
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+        size_t leftSize = 0;
+        size_t rightSize = 0;
+        const ORCAObstacle* obstacleI1 = edges[i];
+        const ORCAObstacle* obstacleI2 = obstacleI1->next;
+
+        for (size_t j = 0; j < edges.size(); ++j) {
+            if (i == j) {
+                continue;
+            }
+            const float j1LeftOfI = leftOf(obstacleI1->point, obstacleI2->point, edges[j]->point);
+            const float j2LeftOfI = leftOf(obstacleI1->point, obstacleI2->point, edges[j]->next->point);
+
+            if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
+                ++leftSize;
+            } else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
+                ++rightSize;
+            } else {
+                ++leftSize;
+                ++rightSize;
+            }
+
+            // Already worse than the best split found so far
+            if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize, rightSize)) >=
+                std::make_pair(std::max(minLeft, minRight), std::min(minLeft, minRight))) {
+                break;
+            }
+        }
+
+        if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize, rightSize)) <
+            std::make_pair(std::max(minLeft, minRight), std::min(minLeft, minRight))) {
+            minLeft = leftSize;
+            minRight = rightSize;
+            optimalSplit = i;
+        }
+    }
+
+    std::vector<ORCAObstacle*> leftEdges;
+    std::vector<ORCAObstacle*> rightEdges;
+    leftEdges.reserve(minLeft);
+    rightEdges.reserve(minRight);
+
+    const size_t i = optimalSplit;
+    const ORCAObstacle* obstacleI1 = edges[i];
+    const ORCAObstacle* obstacleI2 = obstacleI1->next;
+
+    for (size_t j = 0; j < edges.size(); ++j) {
+        if (i == j) {
+            continue;
+        }
+        ORCAObstacle* obstacleJ1 = edges[j];
+        ORCAObstacle* obstacleJ2 = obstacleJ1->next;
+        const float j1LeftOfI = leftOf(obstacleI1->point, obstacleI2->point, obstacleJ1->point);
+        const float j2LeftOfI = leftOf(obstacleI1->point, obstacleI2->point, obstacleJ2->point);
+
+        if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
+            leftEdges.push_back(obstacleJ1);
+        } else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
+            rightEdges.push_back(obstacleJ1);
+        } else {
+            // Edge j straddles the split line: cut it in two with a new vertex
+            v2f dirI, i1ToJ1, j2ToJ1;
+            dirI[0] = obstacleI2->point[0] - obstacleI1->point[0];
+            dirI[1] = obstacleI2->point[1] - obstacleI1->point[1];
+            i1ToJ1[0] = obstacleJ1->point[0] - obstacleI1->point[0];
+            i1ToJ1[1] = obstacleJ1->point[1] - obstacleI1->point[1];
+            v2fSub(obstacleJ1->point, obstacleJ2->point, j2ToJ1);
+            const float t = v2fCross(dirI, i1ToJ1) / v2fCross(dirI, j2ToJ1);
+
+            ORCAObstacle* newObstacle = new ORCAObstacle();
+            newObstacle->point[0] = obstacleJ1->point[0] + t * (obstacleJ2->point[0] - obstacleJ1->point[0]);
+            newObstacle->point[1] = obstacleJ1->point[1] + t * (obstacleJ2->point[1] - obstacleJ1->point[1]);
+            newObstacle->prev = obstacleJ1;
+            newObstacle->next = obstacleJ2;
+            newObstacle->isConvex = true;
+            v2fCopy(obstacleJ1->unitDir, newObstacle->unitDir);
+            newObstacle->id = obstacles.size();
+            obstacles.push_back(newObstacle);
+
+            obstacleJ1->next = newObstacle;
+            obstacleJ2->prev = newObstacle;
+
+            if (j1LeftOfI > 0.0f) {
+                leftEdges.push_back(obstacleJ1);
+                rightEdges.push_back(newObstacle);
+            } else {
+                rightEdges.push_back(obstacleJ1);
+                leftEdges.push_back(newObstacle);
+            }
+        }
+    }
+
+    int id = nodes.size();
+    nodes.push_back(Node());
+    nodes[id].obstacle = obstacleI1;
+    int left = buildRecursive(leftEdges);
+    int right = buildRecursive(rightEdges);
+    nodes[id].left = left;
+    nodes[id].right = right;
+    return id;
+}
+
+void ObstacleKdTree::computeObstacleNeighbors(ORCAAgent* agent, float rangeSq) const {
+    v2f pos;
+    agent->getPos(pos);
+    queryRecursive(agent, pos, rangeSq, root);
+}
+
+void ObstacleKdTree::queryRecursive(ORCAAgent* agent, const v2f& pos, float rangeSq, int node) const {
+    if (node < 0) {
+        return;
+    }
+
+    const ORCAObstacle* obstacle1 = nodes[node].obstacle;
+    const ORCAObstacle* obstacle2 = obstacle1->next;
+
+    const float agentLeftOfLine = leftOf(obstacle1->point, obstacle2->point, pos);
+
+    // Our own side of the split first, then the far side only if in range
+    queryRecursive(agent, pos, rangeSq, agentLeftOfLine >= 0.0f ? nodes[node].left : nodes[node].right);
+
+    v2f edge;
+    edge[0] = obstacle2->point[0] - obstacle1->point[0];
+    edge[1] = obstacle2->point[1] - obstacle1->point[1];
+    const float distSqLine = agentLeftOfLine * agentLeftOfLine / v2fLenSq(edge);
+
+    if (distSqLine < rangeSq) {
+        if (agentLeftOfLine < 0.0f) {
+            // The edge can only be seen from its right-hand side
+            agent->insertObstacleNeighbor(obstacle1, rangeSq);
+        }
+        queryRecursive(agent, pos, rangeSq, agentLeftOfLine >= 0.0f ? nodes[node].right : nodes[node].left);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _KD_TREE_H_
+#define _KD_TREE_H_
+
+#include "Agent.h"
+#include "ORCAAgent.h"
+#include <vector>
+
+// k-d tree over agent positions for ORCA neighbor selection.
+// Rebuilt from scratch every step; queries visit only the subtrees that can
+// still hold one of the k nearest agents within the querying agent's range.
+class AgentKdTree {
+private:
+    struct Node {
+        int begin;      // first agent in this subtree
+        int end;        // one past the last agent in this subtree
+        int left;       // child nodes (only meaningful for inner nodes)
+        int right;
+        float minX, maxX;
+        float minY, maxY;
+    };
+
+    std::vector<Agent*> agents;     // agents, reordered so subtrees are contiguous
+    std::vector<float> posX;        // cached positions, same order as agents
+    std::vector<float> posY;
+    std::vector<Node> nodes;
+
+    void buildRecursive(int begin, int end, int node);
+    void queryRecursive(ORCAAgent* agent, const v2f& pos, float& rangeSq, int node) const;
+
+public:
+    AgentKdTree();
+
+    // Rebuild the tree from the current positions of the given agents
+    void build(const std::vector<Agent*>& agentList);
+
+    // Offer every agent within sqrt(rangeSq) of the agent to its neighbor list.
+    // rangeSq shrinks as the neighbor list fills up.
+    void computeAgentNeighbors(ORCAAgent* agent, float& rangeSq) const;
+
+    int size() const { return agents.size(); }
+};
+
+// Static obstacles for ORCA: a linked graph of obstacle vertices plus a BSP
+// style k-d tree over their edges. Built once when the scene is loaded; a
+// query only descends into the half-planes that lie within the agent's range,
+// so the cost per agent does not grow with the total number of edges.
+class ObstacleKdTree {
+private:
+    struct Node {
+        const ORCAObstacle* obstacle;   // splitting edge
+        int left;                       // subtree left of the edge, -1 if empty
+        int right;                      // subtree right of the edge, -1 if empty
+    };
+
+    std::vector<ORCAObstacle*> obstacles;   // owns every vertex, including split points
+    std::vector<Node> nodes;
+    int root;
+
+    int buildRecursive(const std::vector<ORCAObstacle*>& edges);
+    void queryRecursive(ORCAAgent* agent, const v2f& pos, float rangeSq, int node) const;
+
+public:
+    ObstacleKdTree();
+    ~ObstacleKdTree();
+
+    // Add a polygon (counterclockwise) or, with two vertices, a two-sided
+    // segment. Returns the id of the first vertex, or -1 for fewer than two.
+    int addObstacle(const std::vector<std::pair<float, float> >& vertices);
+
+    // Build the tree over every obstacle added so far
+    void build();
+
+    // Offer every edge within sqrt(rangeSq) of the agent to its obstacle list
+    void computeObstacleNeighbors(ORCAAgent* agent, float rangeSq) const;
+
+    int getNumVertices() const { return obstacles.size(); }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "Log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+//slots in the queue, a power of two
+const size_t QUEUE_SIZE = 4096;
+//longest message kept, including the terminating zero
+const size_t MESSAGE_SIZE = 240;
+
+const char * prefixes[] = { "", "error: ", "warning: ", "", "debug: " };
+
+/* Bounded multi-producer queue after Dmitry Vyukov's. A slot's sequence
+ * number says whose turn it is: equal to a producer's ticket when the slot
+ * is free for it, ticket + 1 once the message is in and the consumer may
+ * take it. Producers claim tickets with a compare-and-swap on tail, so no
+ * thread ever waits for another.
+ */
+struct Slot {
+  std::atomic<size_t> sequence;
+  int level;
+  char text[MESSAGE_SIZE];
+};
+
+Slot slots[QUEUE_SIZE];
+std::atomic<size_t> tail( 0 );
+//only the consumer moves head; logFlush reads it
+std::atomic<size_t> head( 0 );
+std::atomic<unsigned long> dropped( 0 );
+std::atomic<bool> stopping( false );
+
+std::once_flag started;
+std::thread consumer;
+
+void writeOut( const Slot & s ){
+  int level = s.level >= 0 && s.level <= LOG_LEVEL_DEBUG ? s.level : 0;
+  fprintf( stderr, "%s%s\n", prefixes[level], s.text );
+}
+
+//writes everything ready; false if there was nothing
+bool drain(){
+  bool any = false;
+  size_t h = head.load( std::memory_order_relaxed );
+  for( ;; ){
+    Slot & s = slots[ h % QUEUE_SIZE ];
+    if( s.sequence.load( std::memory_order_acquire ) != h + 1 )
+      break;
+    writeOut( s );
+    s.sequence.store( h + QUEUE_SIZE, std::memory_order_release );
+    h++;
+    head.store( h, std::memory_order_release );
+    any = true;
+  }
+  if( any )
+    fflush( stderr );
+  return any;
+}
+
+//polls with a growing back-off, so producers never have to wake it
+void consumerMain(){
+  int idle = 0;
+  while( !stopping.load( std::memory_order_acquire ) ){
+    if( drain() ){
+      idle = 0;
+      continue;
+    }
+    if( idle < 10 )
+      idle++;
+    std::this_thread::sleep_for( std::chrono::microseconds( 100 * idle ) );
+  }
+  drain();
+}
+
+void shutdown(){
+  stopping.store( true, std::memory_order_release );
+  if( consumer.joinable() )
+    consumer.join();
+  unsigned long d = dropped.load();
+  if( d )
+    fprintf( stderr, "warning: %lu log messages dropped\n", d );
+}
+
+void start(){
+  for( size_t i = 0; i < QUEUE_SIZE; i++ )
+    slots[i].sequence.store( i, std::memory_order_relaxed );
+  consumer = std::thread( consumerMain );
+  atexit( shutdown );
+}
+
+}
+
+void logWrite( int level, const std::string & message ){
+  std::call_once( started, start );
+
+  size_t t = tail.load( std::memory_order_relaxed );
+  Slot * s;
+  for( ;; ){
+    s = &slots[ t % QUEUE_SIZE ];
+    size_t seq = s->sequence.load( std::memory_order_acquire );
+    if( seq == t ){
+      if( tail.compare_exchange_weak( t, t + 1, std::memory_order_relaxed ) )
+	break;
+    } else if( seq < t ){
+      //the consumer is a whole queue behind
+      dropped.fetch_add( 1, std::memory_order_relaxed );
+      return;
+    } else
+      t = tail.load( std::memory_order_relaxed );
+  }
+
+  size_t n = message.size() < MESSAGE_SIZE - 1 ? message.size() : MESSAGE_SIZE - 1;
+  memcpy( s->text, message.data(), n );
+  s->text[n] = 0;
+  s->level = level;
+  s->sequence.store( t + 1, std::memory_order_release );
+}
+
+void logFlush(){
+  size_t t = tail.load( std::memory_order_acquire );
+  while( head.load( std::memory_order_acquire ) < t && consumer.joinable()
+	 && !stopping.load( std::memory_order_acquire ) )
+    std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+}
+
+unsigned long logDropped(){
+  return dropped.load();
+}
@@ -0,0 +1,71 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <sstream>
+#include <string>
+
+/* Diagnostics with the level chosen at compile time.
+ *
+ *   LOG_DEBUG( "cdist: " << d );
+ *
+ * A statement above LOG_LEVEL expands to nothing, so its arguments are never
+ * evaluated and it costs nothing. Build with make LOG_LEVEL=4 to get the
+ * debug output back; the default, 3, keeps info and everything more severe.
+ *
+ * Enabled messages are formatted on the calling thread and put on a bounded
+ * lock-free queue. A background thread, started by the first message, writes
+ * them to stderr. Logging never blocks the caller: if the queue is full, the
+ * message is dropped and counted. Whatever is queued at exit is written out,
+ * along with the number of messages dropped.
+ */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT( level, msg ) do {		\
+    std::ostringstream logStream;		\
+    logStream << msg;				\
+    logWrite( level, logStream.str() );		\
+  } while( 0 )
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR( msg ) LOG_AT( LOG_LEVEL_ERROR, msg )
+#else
+#define LOG_ERROR( msg ) do {} while( 0 )
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN( msg ) LOG_AT( LOG_LEVEL_WARN, msg )
+#else
+#define LOG_WARN( msg ) do {} while( 0 )
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO( msg ) LOG_AT( LOG_LEVEL_INFO, msg )
+#else
+#define LOG_INFO( msg ) do {} while( 0 )
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG( msg ) LOG_AT( LOG_LEVEL_DEBUG, msg )
+#else
+#define LOG_DEBUG( msg ) do {} while( 0 )
+#endif
+
+//queues one message; messages longer than a queue slot are cut short
+void logWrite( int level, const std::string & message );
+
+//waits until everything queued so far has been written
+void logFlush();
+
+//messages dropped because the queue was full
+unsigned long logDropped();
+
+#endif
@@ -0,0 +1,76 @@
+#include "MappedFile.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(){
+  base = NULL;
+  length = 0;
+  mapped = false;
+}
+
+MappedFile::~MappedFile(){
+  close();
+}
+
+bool MappedFile::open( const std::string & path ){
+  close();
+  int fd = ::open( path.c_str(), O_RDONLY );
+  if( fd < 0 ){
+    error = path + ": " + strerror( errno );
+    return false;
+  }
+
+  struct stat st;
+  if( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) ){
+    length = st.st_size;
+    if( length == 0 ){
+      ::close( fd );
+      return true;
+    }
+    void * p = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( p != MAP_FAILED ){
+      //parsers read front to back; let the kernel read ahead further
+      madvise( p, length, MADV_SEQUENTIAL );
+      ::close( fd );
+      base = (const char *) p;
+      mapped = true;
+      return true;
+    }
+  }
+
+  //not mappable: read it all instead
+  length = 0;
+  char buf[1 << 16];
+  for( ;; ){
+    ssize_t n = read( fd, buf, sizeof( buf ) );
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n < 0 ){
+      error = path + ": " + strerror( errno );
+      ::close( fd );
+      fallback.clear();
+      return false;
+    }
+    if( n == 0 )
+      break;
+    fallback.insert( fallback.end(), buf, buf + n );
+  }
+  ::close( fd );
+  length = fallback.size();
+  base = length ? &fallback[0] : NULL;
+  return true;
+}
+
+void MappedFile::close(){
+  if( mapped )
+    munmap( (void *) base, length );
+  base = NULL;
+  length = 0;
+  mapped = false;
+  fallback.clear();
+  error.clear();
+}
@@ -0,0 +1,41 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#include <vector>
+
+/* MappedFile maps a whole file read-only into memory, so it can be scanned
+ * without copying it through stream buffers first. The mapping is private
+ * and lives until close() or the destructor.
+ *
+ * Files that cannot be mapped (pipes, some special files) are read into a
+ * heap buffer instead, so callers only ever see data() and size(). An empty
+ * file opens fine with size() == 0.
+ */
+class MappedFile {
+ private:
+  const char * base;
+  size_t length;
+  //true when base is an mmap region rather than fallback's storage
+  bool mapped;
+  std::vector<char> fallback;
+  std::string error;
+
+  MappedFile( const MappedFile & );
+  MappedFile & operator=( const MappedFile & );
+
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  //false if the file could not be opened or read; see getError()
+  bool open( const std::string & path );
+  void close();
+
+  const char * data() const { return base; }
+  size_t size() const { return length; }
+  bool isMapped() const { return mapped; }
+  const std::string & getError() const { return error; }
+};
+
+#endif
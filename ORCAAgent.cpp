@@ -1,89 +1,120 @@
 #include "ORCAAgent.h"
+#include "KdTree.h"
 #include "constants.h"
 #include <cmath>
 #include <algorithm>
-
-const float RVO_EPSILON = 0.00001f;
+#include <limits>
 
 ORCAAgent::ORCAAgent() : Agent() {
     timeHorizon = 2.0f;
     timeHorizonObst = 2.0f;
     neighborDist = 10.0f;
     maxNeighbors = 10;
+    numObstLines = 0;
+    hasGoal = false;
     v2fMult(prefVelocity, 0.0f, prefVelocity);
+    v2fMult(newVelocity, 0.0f, newVelocity);
+    v2fMult(goal, 0.0f, goal);
 }
 
 ORCAAgent::ORCAAgent(Json::Value a) : Agent(a) {
+    initORCA(a);
+}
+
+ORCAAgent::ORCAAgent(Json::Value a, AgentStore* s) : Agent(a, s) {
+    initORCA(a);
+}
+
+void ORCAAgent::initORCA(const Json::Value& a) {
     timeHorizon = a.get("timeHorizon", 2.0f).asFloat();
     timeHorizonObst = a.get("timeHorizonObst", 2.0f).asFloat();
     neighborDist = a.get("neighborDist", 10.0f).asFloat();
     maxNeighbors = a.get("maxNeighbors", 10).asInt();
+    numObstLines = 0;
     
     v2fMult(prefVelocity, 0.0f, prefVelocity);
+    v2fMult(newVelocity, 0.0f, newVelocity);
+    v2fMult(goal, 0.0f, goal);
+    hasGoal = a.isMember("attractor") && a["attractor"].isMember("pos");
+    if (hasGoal) {
+        goal[0] = a["attractor"]["pos"][0u].asFloat();
+        goal[1] = a["attractor"]["pos"][1u].asFloat();
+    }
 }
 
 ORCAAgent::~ORCAAgent() {
 }
 
-void ORCAAgent::calculateORCAVelocity(const std::vector<Agent*>& neighbors, float deltaT) {
-    // Simplified ORCA implementation
-    v2f myPos, myVel;
+void ORCAAgent::insertAgentNeighbor(Agent* other, float distSq, float& rangeSq) {
+    if (other == this || !(distSq < rangeSq)) {
+        return;
+    }
+
+    if ((int)agentNeighbors.size() < maxNeighbors) {
+        agentNeighbors.push_back(std::make_pair(distSq, other));
+    }
+
+    // Insertion step of an insertion sort; the farthest entry falls off the end
+    size_t i = agentNeighbors.size() - 1;
+    while (i != 0 && distSq < agentNeighbors[i - 1].first) {
+        agentNeighbors[i] = agentNeighbors[i - 1];
+        --i;
+    }
+    agentNeighbors[i] = std::make_pair(distSq, other);
+
+    if ((int)agentNeighbors.size() == maxNeighbors) {
+        rangeSq = agentNeighbors.back().first;
+    }
+}
+
+void ORCAAgent::insertObstacleNeighbor(const ORCAObstacle* obstacle, float rangeSq) {
+    v2f myPos;
     getPos(myPos);
-    getVelocity(myVel);
-    
-    // Get current max velocity
-    float currentMaxVel = getMaxVelocity();
-    
-    // Get goal direction from preferred velocity
-    v2f goalDirection;
-    v2fCopy(prefVelocity, goalDirection);
-    v2fNormalize(goalDirection, goalDirection);
-    
-    // Simple collision avoidance with neighbors
-    v2f avoidanceForce;
-    v2fMult(avoidanceForce, 0.0f, avoidanceForce);
-    
-    int neighborCount = 0;
-    for (Agent* neighbor : neighbors) {
-        if (neighbor == this) continue;
-        
-        v2f neighborPos;
-        neighbor->getPos(neighborPos);
-        
-        float distance = getDistance(neighborPos);
-        if (distance < neighborDist && distance > 0.1f) {
-            v2f avoidDirection;
-            v2fSub(myPos, neighborPos, avoidDirection);
-            v2fNormalize(avoidDirection, avoidDirection);
-            
-            // Weight by inverse distance
-            float weight = 1.0f / (distance + 0.1f);
-            v2f weightedAvoid;
-            v2fMult(avoidDirection, weight, weightedAvoid);
-            v2fAdd(avoidanceForce, weightedAvoid, avoidanceForce);
-            neighborCount++;
+    const float distSq = distSqPointLineSegment(obstacle->point, obstacle->next->point, myPos);
+
+    if (distSq < rangeSq) {
+        obstacleNeighbors.push_back(std::make_pair(distSq, obstacle));
+
+        size_t i = obstacleNeighbors.size() - 1;
+        while (i != 0 && distSq < obstacleNeighbors[i - 1].first) {
+            obstacleNeighbors[i] = obstacleNeighbors[i - 1];
+            --i;
         }
+        obstacleNeighbors[i] = std::make_pair(distSq, obstacle);
     }
-    
-    // Combine goal direction with avoidance
-    v2f newVelocity;
-    if (neighborCount > 0) {
-        v2fNormalize(avoidanceForce, avoidanceForce);
-        v2fMult(goalDirection, 0.5f, goalDirection);
-        v2fMult(avoidanceForce, 0.5f, avoidanceForce);
-        v2fAdd(goalDirection, avoidanceForce, newVelocity);
-    } else {
-        v2fCopy(goalDirection, newVelocity);
+}
+
+void ORCAAgent::calculateORCAVelocity(const std::vector<Agent*>& neighbors, float deltaT) {
+    obstacleNeighbors.clear();
+    agentNeighbors.clear();
+    if (maxNeighbors > 0) {
+        v2f myPos;
+        getPos(myPos);
+        float rangeSq = neighborDist * neighborDist;
+        for (Agent* neighbor : neighbors) {
+            v2f neighborPos, diff;
+            neighbor->getPos(neighborPos);
+            v2fSub(neighborPos, myPos, diff);
+            insertAgentNeighbor(neighbor, v2fLenSq(diff), rangeSq);
+        }
     }
-    
-    // Scale to max velocity
-    float speed = v2fLen(newVelocity);
-    if (speed > 0.001f) {
-        v2fNormalize(newVelocity, newVelocity);
-        v2fMult(newVelocity, fminf(speed, currentMaxVel), newVelocity);
+
+    computeNewVelocity(deltaT, newVelocity);
+}
+
+void ORCAAgent::calculateORCAVelocity(const AgentKdTree& tree, const ObstacleKdTree& obstacles, float deltaT) {
+    // Only edges we could reach within timeHorizonObst matter
+    obstacleNeighbors.clear();
+    float obstRange = timeHorizonObst * getMaxVelocity() + getRadius();
+    obstacles.computeObstacleNeighbors(this, obstRange * obstRange);
+
+    agentNeighbors.clear();
+    if (maxNeighbors > 0) {
+        float rangeSq = neighborDist * neighborDist;
+        tree.computeAgentNeighbors(this, rangeSq);
     }
-    
-    setVelocity(newVelocity);
+
+    computeNewVelocity(deltaT, newVelocity);
 }
 
 void ORCAAgent::setPrefVelocity(const v2f& goal) {
@@ -100,40 +131,537 @@ void ORCAAgent::setPrefVelocity(const v2f& goal) {
     float distance = v2fLen(direction);
     float currentMaxVel = getMaxVelocity();
     
-    if (distance > RVO_EPSILON) {
+    // Head for the goal at full speed, slowing down over the last stretch so
+    // the agent settles on the goal instead of overshooting it every step
+    if (distance > currentMaxVel) {
         v2fNormalize(direction, direction);
         v2fMult(direction, currentMaxVel, prefVelocity);
+    } else if (distance > RVO_EPSILON) {
+        v2fCopy(direction, prefVelocity);
     } else {
         v2fMult(prefVelocity, 0.0f, prefVelocity);
     }
 }
 
-// Simplified implementations for the rest
-void ORCAAgent::computeORCALines(const std::vector<Agent*>& neighbors, float deltaT) {
-    // Simplified - not implemented
+void ORCAAgent::updatePrefVelocity() {
+    if (hasGoal) {
+        setPrefVelocity(goal);
+    }
+}
+
+void ORCAAgent::computeORCALines(float deltaT) {
+    orcaLines.clear();
+
+    // Obstacle lines go first; linearProgram3 keeps them as hard constraints
+    for (size_t i = 0; i < obstacleNeighbors.size(); ++i) {
+        computeObstacleORCA(obstacleNeighbors[i].second, deltaT);
+    }
+    numObstLines = orcaLines.size();
+
+    for (size_t i = 0; i < agentNeighbors.size(); ++i) {
+        computeAgentORCA(agentNeighbors[i].second, deltaT);
+    }
 }
 
-void ORCAAgent::computeAgentORCA(const Agent* other, float deltaT) {
-    // Simplified - not implemented  
+void ORCAAgent::computeAgentORCA(Agent* other, float deltaT) {
+    v2f myPos, myVel, otherPos, otherVel;
+    getPos(myPos);
+    getVelocity(myVel);
+    other->getPos(otherPos);
+    other->getVelocity(otherVel);
+
+    const float invTimeHorizon = 1.0f / timeHorizon;
+    v2f relativePosition, relativeVelocity;
+    v2fSub(otherPos, myPos, relativePosition);
+    v2fSub(myVel, otherVel, relativeVelocity);
+
+    const float distSq = v2fLenSq(relativePosition);
+    const float combinedRadius = getRadius() + other->getRadius();
+    const float combinedRadiusSq = combinedRadius * combinedRadius;
+
+    ORCALine line;
+    v2f u;
+
+    if (distSq > combinedRadiusSq) {
+        // No collision yet. w is the vector from the cutoff center to the relative velocity
+        v2f w;
+        v2fAdd(relativeVelocity, relativePosition, -invTimeHorizon, w);
+        const float wLengthSq = v2fLenSq(w);
+        const float dotProduct1 = v2fDot(w, relativePosition);
+
+        if (dotProduct1 < 0.0f && dotProduct1 * dotProduct1 > combinedRadiusSq * wLengthSq) {
+            // Project on the cut-off circle
+            const float wLength = std::sqrt(wLengthSq);
+            v2f unitW;
+            v2fMult(w, 1.0f / wLength, unitW);
+            line.direction[0] = unitW[1];
+            line.direction[1] = -unitW[0];
+            v2fMult(unitW, combinedRadius * invTimeHorizon - wLength, u);
+        } else {
+            // Project on the legs of the velocity obstacle cone
+            const float leg = std::sqrt(distSq - combinedRadiusSq);
+            if (det(relativePosition, w) > 0.0f) {
+                // Left leg
+                line.direction[0] = (relativePosition[0] * leg - relativePosition[1] * combinedRadius) / distSq;
+                line.direction[1] = (relativePosition[0] * combinedRadius + relativePosition[1] * leg) / distSq;
+            } else {
+                // Right leg
+                line.direction[0] = -(relativePosition[0] * leg + relativePosition[1] * combinedRadius) / distSq;
+                line.direction[1] = -(-relativePosition[0] * combinedRadius + relativePosition[1] * leg) / distSq;
+            }
+            const float dotProduct2 = v2fDot(relativeVelocity, line.direction);
+            v2fMult(line.direction, dotProduct2, u);
+            v2fSub(u, relativeVelocity, u);
+        }
+    } else {
+        // Already overlapping: resolve within this time step
+        const float invTimeStep = 1.0f / deltaT;
+        v2f w;
+        v2fAdd(relativeVelocity, relativePosition, -invTimeStep, w);
+        const float wLength = v2fLen(w);
+        v2f unitW;
+        if (wLength > RVO_EPSILON) {
+            v2fMult(w, 1.0f / wLength, unitW);
+        } else {
+            // Coincident agents with equal velocity; any direction will do
+            unitW[0] = 1.0f;
+            unitW[1] = 0.0f;
+        }
+        line.direction[0] = unitW[1];
+        line.direction[1] = -unitW[0];
+        v2fMult(unitW, combinedRadius * invTimeStep - wLength, u);
+    }
+
+    // Each agent takes half of the responsibility for avoiding the collision
+    v2fAdd(myVel, u, 0.5f, line.point);
+    orcaLines.push_back(line);
+}
+
+// Left-hand leg direction of the cone from the agent tangent to a circle of
+// the given radius around relativePosition
+static void leftLeg(const v2f rel, float distSq, float radius, v2f res) {
+    const float leg = std::sqrt(distSq - radius * radius);
+    res[0] = (rel[0] * leg - rel[1] * radius) / distSq;
+    res[1] = (rel[0] * radius + rel[1] * leg) / distSq;
+}
+
+static void rightLeg(const v2f rel, float distSq, float radius, v2f res) {
+    const float leg = std::sqrt(distSq - radius * radius);
+    res[0] = (rel[0] * leg + rel[1] * radius) / distSq;
+    res[1] = (-rel[0] * radius + rel[1] * leg) / distSq;
+}
+
+void ORCAAgent::computeObstacleORCA(const ORCAObstacle* obstacle, float deltaT) {
+    const ORCAObstacle* obstacle1 = obstacle;
+    const ORCAObstacle* obstacle2 = obstacle1->next;
+
+    v2f myPos, myVel;
+    getPos(myPos);
+    getVelocity(myVel);
+    const float radius = getRadius();
+    const float invTimeHorizonObst = 1.0f / timeHorizonObst;
+
+    v2f relativePosition1, relativePosition2;
+    relativePosition1[0] = obstacle1->point[0] - myPos[0];
+    relativePosition1[1] = obstacle1->point[1] - myPos[1];
+    relativePosition2[0] = obstacle2->point[0] - myPos[0];
+    relativePosition2[1] = obstacle2->point[1] - myPos[1];
+
+    // Skip edges whose velocity obstacle an earlier obstacle line already covers
+    for (size_t j = 0; j < orcaLines.size(); ++j) {
+        v2f a, b;
+        v2fAdd(orcaLines[j].point, relativePosition1, -invTimeHorizonObst, a);
+        v2fAdd(orcaLines[j].point, relativePosition2, -invTimeHorizonObst, b);
+        v2fNegate(a);
+        v2fNegate(b);
+        if (det(a, orcaLines[j].direction) - invTimeHorizonObst * radius >= -RVO_EPSILON &&
+            det(b, orcaLines[j].direction) - invTimeHorizonObst * radius >= -RVO_EPSILON) {
+            return;
+        }
+    }
+
+    const float distSq1 = v2fLenSq(relativePosition1);
+    const float distSq2 = v2fLenSq(relativePosition2);
+    const float radiusSq = radius * radius;
+
+    v2f obstacleVector;
+    obstacleVector[0] = obstacle2->point[0] - obstacle1->point[0];
+    obstacleVector[1] = obstacle2->point[1] - obstacle1->point[1];
+    const float s = -v2fDot(relativePosition1, obstacleVector) / v2fLenSq(obstacleVector);
+    v2f toLine;
+    toLine[0] = -relativePosition1[0] - s * obstacleVector[0];
+    toLine[1] = -relativePosition1[1] - s * obstacleVector[1];
+    const float distSqLine = v2fLenSq(toLine);
+
+    ORCALine line;
+
+    // Already colliding with the edge: push straight out of it
+    if (s < 0.0f && distSq1 <= radiusSq) {
+        // Collision with left vertex; ignore if non-convex
+        if (obstacle1->isConvex) {
+            line.point[0] = line.point[1] = 0.0f;
+            v2f d;
+            d[0] = -relativePosition1[1];
+            d[1] = relativePosition1[0];
+            v2fNormalize(d, line.direction);
+            orcaLines.push_back(line);
+        }
+        return;
+    } else if (s > 1.0f && distSq2 <= radiusSq) {
+        // Collision with right vertex; ignore if non-convex or if the
+        // neighboring edge will take care of it
+        if (obstacle2->isConvex && det(relativePosition2, obstacle2->unitDir) >= 0.0f) {
+            line.point[0] = line.point[1] = 0.0f;
+            v2f d;
+            d[0] = -relativePosition2[1];
+            d[1] = relativePosition2[0];
+            v2fNormalize(d, line.direction);
+            orcaLines.push_back(line);
+        }
+        return;
+    } else if (s >= 0.0f && s < 1.0f && distSqLine <= radiusSq) {
+        // Collision with the edge itself
+        line.point[0] = line.point[1] = 0.0f;
+        line.direction[0] = -obstacle1->unitDir[0];
+        line.direction[1] = -obstacle1->unitDir[1];
+        orcaLines.push_back(line);
+        return;
+    }
+
+    // No collision: compute the legs of the velocity obstacle. Seen obliquely
+    // both legs can come from one vertex; at a non-convex vertex the leg
+    // extends the cut-off line instead
+    v2f leftLegDirection, rightLegDirection;
+
+    if (s < 0.0f && distSqLine <= radiusSq) {
+        // Left vertex defines the velocity obstacle
+        if (!obstacle1->isConvex) {
+            return;
+        }
+        obstacle2 = obstacle1;
+        leftLeg(relativePosition1, distSq1, radius, leftLegDirection);
+        rightLeg(relativePosition1, distSq1, radius, rightLegDirection);
+    } else if (s > 1.0f && distSqLine <= radiusSq) {
+        // Right vertex defines the velocity obstacle
+        if (!obstacle2->isConvex) {
+            return;
+        }
+        obstacle1 = obstacle2;
+        leftLeg(relativePosition2, distSq2, radius, leftLegDirection);
+        rightLeg(relativePosition2, distSq2, radius, rightLegDirection);
+    } else {
+        // Usual situation
+        if (obstacle1->isConvex) {
+            leftLeg(relativePosition1, distSq1, radius, leftLegDirection);
+        } else {
+            leftLegDirection[0] = -obstacle1->unitDir[0];
+            leftLegDirection[1] = -obstacle1->unitDir[1];
+        }
+
+        if (obstacle2->isConvex) {
+            rightLeg(relativePosition2, distSq2, radius, rightLegDirection);
+        } else {
+            rightLegDirection[0] = obstacle1->unitDir[0];
+            rightLegDirection[1] = obstacle1->unitDir[1];
+        }
+    }
+
+    // A leg may not point into the neighboring edge at a convex vertex; use
+    // that edge's cut-off line instead, and add no constraint if the velocity
+    // projects onto such a "foreign" leg
+    const ORCAObstacle* leftNeighbor = obstacle1->prev;
+    bool isLeftLegForeign = false;
+    bool isRightLegForeign = false;
+
+    v2f negLeftDir;
+    negLeftDir[0] = -leftNeighbor->unitDir[0];
+    negLeftDir[1] = -leftNeighbor->unitDir[1];
+    if (obstacle1->isConvex && det(leftLegDirection, negLeftDir) >= 0.0f) {
+        v2fCopy(negLeftDir, leftLegDirection);
+        isLeftLegForeign = true;
+    }
+
+    v2f rightDir;
+    rightDir[0] = obstacle2->unitDir[0];
+    rightDir[1] = obstacle2->unitDir[1];
+    if (obstacle2->isConvex && det(rightLegDirection, rightDir) <= 0.0f) {
+        v2fCopy(rightDir, rightLegDirection);
+        isRightLegForeign = true;
+    }
+
+    // Cut-off centers
+    v2f leftCutoff, rightCutoff, cutoffVec;
+    leftCutoff[0] = invTimeHorizonObst * (obstacle1->point[0] - myPos[0]);
+    leftCutoff[1] = invTimeHorizonObst * (obstacle1->point[1] - myPos[1]);
+    rightCutoff[0] = invTimeHorizonObst * (obstacle2->point[0] - myPos[0]);
+    rightCutoff[1] = invTimeHorizonObst * (obstacle2->point[1] - myPos[1]);
+    v2fSub(rightCutoff, leftCutoff, cutoffVec);
+
+    // Project the current velocity on the velocity obstacle
+    v2f velMinusLeft, velMinusRight;
+    v2fSub(myVel, leftCutoff, velMinusLeft);
+    v2fSub(myVel, rightCutoff, velMinusRight);
+    const float t = (obstacle1 == obstacle2) ? 0.5f : v2fDot(velMinusLeft, cutoffVec) / v2fLenSq(cutoffVec);
+    const float tLeft = v2fDot(velMinusLeft, leftLegDirection);
+    const float tRight = v2fDot(velMinusRight, rightLegDirection);
+
+    if ((t < 0.0f && tLeft < 0.0f) || (obstacle1 == obstacle2 && tLeft < 0.0f && tRight < 0.0f)) {
+        // Project on the left cut-off circle
+        v2f unitW;
+        v2fNormalize(velMinusLeft, unitW);
+        line.direction[0] = unitW[1];
+        line.direction[1] = -unitW[0];
+        v2fAdd(leftCutoff, unitW, radius * invTimeHorizonObst, line.point);
+        orcaLines.push_back(line);
+        return;
+    } else if (t > 1.0f && tRight < 0.0f) {
+        // Project on the right cut-off circle
+        v2f unitW;
+        v2fNormalize(velMinusRight, unitW);
+        line.direction[0] = unitW[1];
+        line.direction[1] = -unitW[0];
+        v2fAdd(rightCutoff, unitW, radius * invTimeHorizonObst, line.point);
+        orcaLines.push_back(line);
+        return;
+    }
+
+    // Project on the left leg, right leg or cut-off line, whichever is closest
+    const float inf = std::numeric_limits<float>::infinity();
+    float distSqCutoff = inf;
+    float distSqLeft = inf;
+    float distSqRight = inf;
+    v2f proj, diff;
+    if (!(t < 0.0f || t > 1.0f || obstacle1 == obstacle2)) {
+        v2fAdd(leftCutoff, cutoffVec, t, proj);
+        v2fSub(myVel, proj, diff);
+        distSqCutoff = v2fLenSq(diff);
+    }
+    if (!(tLeft < 0.0f)) {
+        v2fAdd(leftCutoff, leftLegDirection, tLeft, proj);
+        v2fSub(myVel, proj, diff);
+        distSqLeft = v2fLenSq(diff);
+    }
+    if (!(tRight < 0.0f)) {
+        v2fAdd(rightCutoff, rightLegDirection, tRight, proj);
+        v2fSub(myVel, proj, diff);
+        distSqRight = v2fLenSq(diff);
+    }
+
+    v2f normal;
+    if (distSqCutoff <= distSqLeft && distSqCutoff <= distSqRight) {
+        // Project on the cut-off line
+        line.direction[0] = -obstacle1->unitDir[0];
+        line.direction[1] = -obstacle1->unitDir[1];
+        normal[0] = -line.direction[1];
+        normal[1] = line.direction[0];
+        v2fAdd(leftCutoff, normal, radius * invTimeHorizonObst, line.point);
+        orcaLines.push_back(line);
+    } else if (distSqLeft <= distSqRight) {
+        // Project on the left leg
+        if (isLeftLegForeign) {
+            return;
+        }
+        v2fCopy(leftLegDirection, line.direction);
+        normal[0] = -line.direction[1];
+        normal[1] = line.direction[0];
+        v2fAdd(leftCutoff, normal, radius * invTimeHorizonObst, line.point);
+        orcaLines.push_back(line);
+    } else {
+        // Project on the right leg
+        if (isRightLegForeign) {
+            return;
+        }
+        line.direction[0] = -rightLegDirection[0];
+        line.direction[1] = -rightLegDirection[1];
+        normal[0] = -line.direction[1];
+        normal[1] = line.direction[0];
+        v2fAdd(rightCutoff, normal, radius * invTimeHorizonObst, line.point);
+        orcaLines.push_back(line);
+    }
 }
 
 void ORCAAgent::computeNewVelocity(float deltaT, v2f result) {
-    v2fCopy(prefVelocity, result);
+    computeORCALines(deltaT);
+
+    v2f velocity;
+    float maxSpeed = getMaxVelocity();
+    int lineFail = linearProgram2(orcaLines, maxSpeed, prefVelocity, false, velocity);
+    if (lineFail < (int)orcaLines.size()) {
+        linearProgram3(orcaLines, numObstLines, lineFail, maxSpeed, velocity);
+    }
+    v2fCopy(velocity, result);
 }
 
+// Solves the 1-D program on line lineNo subject to lines [0, lineNo) and the speed circle
 bool ORCAAgent::linearProgram1(const std::vector<ORCALine>& lines, int lineNo, 
                               float radius, const v2f& optVelocity, bool dirOpt, v2f& result) {
+    const ORCALine& line = lines[lineNo];
+    const float dotProduct = line.point[0] * line.direction[0] + line.point[1] * line.direction[1];
+    const float pointLenSq = line.point[0] * line.point[0] + line.point[1] * line.point[1];
+    const float discriminant = dotProduct * dotProduct + radius * radius - pointLenSq;
+
+    if (discriminant < 0.0f) {
+        // Max speed circle fully invalidates this line
+        return false;
+    }
+
+    const float sqrtDiscriminant = std::sqrt(discriminant);
+    float tLeft = -dotProduct - sqrtDiscriminant;
+    float tRight = -dotProduct + sqrtDiscriminant;
+
+    for (int i = 0; i < lineNo; ++i) {
+        v2f diff;
+        diff[0] = line.point[0] - lines[i].point[0];
+        diff[1] = line.point[1] - lines[i].point[1];
+        const float denominator = det(line.direction, lines[i].direction);
+        const float numerator = det(lines[i].direction, diff);
+
+        if (std::fabs(denominator) <= RVO_EPSILON) {
+            // Lines are (almost) parallel
+            if (numerator < 0.0f) {
+                return false;
+            }
+            continue;
+        }
+
+        const float t = numerator / denominator;
+        if (denominator >= 0.0f) {
+            tRight = std::min(tRight, t);
+        } else {
+            tLeft = std::max(tLeft, t);
+        }
+
+        if (tLeft > tRight) {
+            return false;
+        }
+    }
+
+    float t;
+    if (dirOpt) {
+        // Optimize direction: take the extreme point along optVelocity
+        if (optVelocity[0] * line.direction[0] + optVelocity[1] * line.direction[1] > 0.0f) {
+            t = tRight;
+        } else {
+            t = tLeft;
+        }
+    } else {
+        // Optimize closest point to optVelocity
+        t = line.direction[0] * (optVelocity[0] - line.point[0]) +
+            line.direction[1] * (optVelocity[1] - line.point[1]);
+        if (t < tLeft) {
+            t = tLeft;
+        } else if (t > tRight) {
+            t = tRight;
+        }
+    }
+
+    result[0] = line.point[0] + t * line.direction[0];
+    result[1] = line.point[1] + t * line.direction[1];
     return true;
 }
 
+// Incremental 2-D program; returns the index of the first line it could not satisfy
 int ORCAAgent::linearProgram2(const std::vector<ORCALine>& lines, float radius, 
                              const v2f& optVelocity, bool dirOpt, v2f& result) {
+    const float optLenSq = optVelocity[0] * optVelocity[0] + optVelocity[1] * optVelocity[1];
+    if (dirOpt) {
+        // optVelocity is a unit direction here
+        result[0] = optVelocity[0] * radius;
+        result[1] = optVelocity[1] * radius;
+    } else if (optLenSq > radius * radius) {
+        // Preferred velocity outside the speed circle: clamp it onto the circle
+        const float scale = radius / std::sqrt(optLenSq);
+        result[0] = optVelocity[0] * scale;
+        result[1] = optVelocity[1] * scale;
+    } else {
+        result[0] = optVelocity[0];
+        result[1] = optVelocity[1];
+    }
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        v2f diff;
+        diff[0] = lines[i].point[0] - result[0];
+        diff[1] = lines[i].point[1] - result[1];
+        if (det(lines[i].direction, diff) > 0.0f) {
+            // result violates constraint i; move it onto line i
+            v2f tempResult;
+            tempResult[0] = result[0];
+            tempResult[1] = result[1];
+            if (!linearProgram1(lines, i, radius, optVelocity, dirOpt, result)) {
+                result[0] = tempResult[0];
+                result[1] = tempResult[1];
+                return i;
+            }
+        }
+    }
+
     return lines.size();
 }
 
+// Infeasible program: minimize the largest penetration into the agent lines,
+// keeping the first numObstLines (obstacle) constraints hard
 void ORCAAgent::linearProgram3(const std::vector<ORCALine>& lines, int numObstLines, 
                               int beginLine, float radius, v2f& result) {
-    // Simplified - not implemented
+    float distance = 0.0f;
+
+    for (size_t i = beginLine; i < lines.size(); ++i) {
+        v2f diff;
+        diff[0] = lines[i].point[0] - result[0];
+        diff[1] = lines[i].point[1] - result[1];
+        if (det(lines[i].direction, diff) <= distance) {
+            continue;
+        }
+
+        // result does not satisfy line i within the current penetration
+        std::vector<ORCALine> projLines(lines.begin(), lines.begin() + numObstLines);
+
+        for (size_t j = numObstLines; j < i; ++j) {
+            ORCALine line;
+            const float determinant = det(lines[i].direction, lines[j].direction);
+
+            if (std::fabs(determinant) <= RVO_EPSILON) {
+                // Line i and line j are parallel
+                if (lines[i].direction[0] * lines[j].direction[0] +
+                    lines[i].direction[1] * lines[j].direction[1] > 0.0f) {
+                    // Same direction
+                    continue;
+                }
+                // Opposite direction
+                line.point[0] = 0.5f * (lines[i].point[0] + lines[j].point[0]);
+                line.point[1] = 0.5f * (lines[i].point[1] + lines[j].point[1]);
+            } else {
+                v2f ij;
+                ij[0] = lines[i].point[0] - lines[j].point[0];
+                ij[1] = lines[i].point[1] - lines[j].point[1];
+                const float s = det(lines[j].direction, ij) / determinant;
+                line.point[0] = lines[i].point[0] + s * lines[i].direction[0];
+                line.point[1] = lines[i].point[1] + s * lines[i].direction[1];
+            }
+
+            v2f dir;
+            dir[0] = lines[j].direction[0] - lines[i].direction[0];
+            dir[1] = lines[j].direction[1] - lines[i].direction[1];
+            v2fNormalize(dir, line.direction);
+            projLines.push_back(line);
+        }
+
+        v2f tempResult;
+        tempResult[0] = result[0];
+        tempResult[1] = result[1];
+        v2f optDir;
+        optDir[0] = -lines[i].direction[1];
+        optDir[1] = lines[i].direction[0];
+        if (linearProgram2(projLines, radius, optDir, true, result) < (int)projLines.size()) {
+            // Should not happen in principle: result lies in the feasible region
+            // of this program by definition. Floating point error; keep the old result
+            result[0] = tempResult[0];
+            result[1] = tempResult[1];
+        }
+
+        diff[0] = lines[i].point[0] - result[0];
+        diff[1] = lines[i].point[1] - result[1];
+        distance = det(lines[i].direction, diff);
+    }
 }
 
 float ORCAAgent::det(const v2f& vector1, const v2f& vector2) {
@@ -141,8 +669,9 @@ float ORCAAgent::det(const v2f& vector1, const v2f& vector2) {
 }
 
 void ORCAAgent::applyForces(float deltaT) {
-    // For ORCA agents, directly integrate velocity to update position
-    // Get current position and velocity
+    // For ORCA agents, adopt the velocity picked by the solver and integrate it
+    setVelocity(newVelocity);
+
     v2f currentPos, currentVel;
     getPos(currentPos);
     getVelocity(currentVel);
@@ -156,6 +685,26 @@ void ORCAAgent::applyForces(float deltaT) {
     setPos(currentPos);
 }
 
+// Squared distance from point vector3 to the segment vector1-vector2
 float ORCAAgent::distSqPointLineSegment(const v2f& vector1, const v2f& vector2, const v2f& vector3) {
-    return 0.0f; // Simplified
+    v2f seg, rel;
+    seg[0] = vector2[0] - vector1[0];
+    seg[1] = vector2[1] - vector1[1];
+    rel[0] = vector3[0] - vector1[0];
+    rel[1] = vector3[1] - vector1[1];
+
+    const float segLenSq = v2fLenSq(seg);
+    const float r = segLenSq > 0.0f ? v2fDot(rel, seg) / segLenSq : 0.0f;
+
+    v2f d;
+    if (r < 0.0f) {
+        v2fCopy(rel, d);
+    } else if (r > 1.0f) {
+        d[0] = vector3[0] - vector2[0];
+        d[1] = vector3[1] - vector2[1];
+    } else {
+        d[0] = rel[0] - r * seg[0];
+        d[1] = rel[1] - r * seg[1];
+    }
+    return v2fLenSq(d);
 }
@@ -4,6 +4,12 @@
 #include "Agent.h"
 #include <vector>
 #include <algorithm>
+#include <utility>
+
+class AgentKdTree;
+class ObstacleKdTree;
+
+const float RVO_EPSILON = 0.00001f;
 
 // ORCA Line structure representing a linear constraint
 struct ORCALine {
@@ -11,6 +17,17 @@ struct ORCALine {
     v2f direction;  // Direction of the line (normalized)
 };
 
+// One vertex of a static obstacle. Vertices of an obstacle form a closed
+// loop through next/prev; each vertex also stands for the edge to its next.
+struct ORCAObstacle {
+    v2f point;              // Vertex position
+    v2f unitDir;            // Unit direction of the edge point -> next->point
+    bool isConvex;          // Whether the polygon is convex at this vertex
+    ORCAObstacle* next;
+    ORCAObstacle* prev;
+    int id;
+};
+
 class ORCAAgent : public Agent {
 private:
     float timeHorizon;          // Time horizon for collision avoidance (default: 2.0)
@@ -20,12 +37,20 @@ private:
     
     std::vector<ORCALine> orcaLines;  // ORCA constraints for this timestep
     v2f prefVelocity;           // Preferred velocity (toward goal)
-    std::vector<const Agent*> currentNeighbors;  // Store current neighbors for collision avoidance
+    v2f newVelocity;            // Velocity chosen by the solver, applied in applyForces
+    v2f goal;                   // Attractor position the preferred velocity points at
+    bool hasGoal;
+
+    // Nearest agents as (squared distance, agent), sorted by distance
+    std::vector<std::pair<float, Agent*> > agentNeighbors;
+    // Obstacle edges within reach this step, sorted by distance
+    std::vector<std::pair<float, const ORCAObstacle*> > obstacleNeighbors;
+    int numObstLines;           // Leading entries of orcaLines that came from obstacles
     
     // Helper functions for ORCA computation
-    void computeORCALines(const std::vector<Agent*>& neighbors, float deltaT);
-    void computeAgentORCA(const Agent* other, float deltaT);
-    void computeObstacleORCA(const CrowdObject* obstacle, float deltaT);
+    void computeORCALines(float deltaT);
+    void computeAgentORCA(Agent* other, float deltaT);
+    void computeObstacleORCA(const ORCAObstacle* obstacle, float deltaT);
     
     void computeNewVelocity(float deltaT, v2f result);
     bool linearProgram1(const std::vector<ORCALine>& lines, int lineNo, 
@@ -35,16 +60,29 @@ private:
     void linearProgram3(const std::vector<ORCALine>& lines, int numObstLines, 
                        int beginLine, float radius, v2f& result);
     
+    // Reads the ORCA parameters and goal from the agent's JSON
+    void initORCA(const Json::Value& a);
+
     float det(const v2f& vector1, const v2f& vector2);
     float distSqPointLineSegment(const v2f& vector1, const v2f& vector2, const v2f& vector3);
 
 public:
     ORCAAgent();
     ORCAAgent(Json::Value a);
+    ORCAAgent(Json::Value a, AgentStore* s);
     ~ORCAAgent();
     
-    // Override force calculation to use ORCA
+    // Pick neighbors by scanning the given agents (small scenes and demos)
     void calculateORCAVelocity(const std::vector<Agent*>& neighbors, float deltaT);
+    // Pick the maxNeighbors nearest agents within neighborDist from the k-d
+    // tree, and the obstacle edges reachable within timeHorizonObst
+    void calculateORCAVelocity(const AgentKdTree& tree, const ObstacleKdTree& obstacles, float deltaT);
+
+    // Offer a candidate neighbor; keeps the maxNeighbors closest and shrinks
+    // rangeSq to the farthest kept distance once the list is full
+    void insertAgentNeighbor(Agent* other, float distSq, float& rangeSq);
+    // Offer the obstacle edge starting at this vertex; kept if within rangeSq
+    void insertObstacleNeighbor(const ORCAObstacle* obstacle, float rangeSq);
     
     // ORCA-specific setters
     void setTimeHorizon(float th) { timeHorizon = th; }
@@ -55,6 +93,10 @@ public:
     // Goal-directed behavior
     void setPrefVelocity(const v2f& goal);
     void getPrefVelocity(v2f ret) { v2fCopy(prefVelocity, ret); }
+    // Re-aim the preferred velocity at the attractor given in the config
+    void updatePrefVelocity();
+    // Replace that attractor
+    void setGoal(float x, float y) { goal[0] = x; goal[1] = y; hasGoal = true; }
     
     // Override physics to use velocity directly
     void applyForces(float deltaT);
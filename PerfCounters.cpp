@@ -0,0 +1,237 @@
+#include "PerfCounters.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace {
+
+const char * names[PERF_COUNTERS] = {
+  "cycles", "instructions", "L1D misses", "LLC misses", "branch misses"
+};
+
+//one thread's group; slot[c] is counter c's position in a group read, or -1
+struct Group {
+  int leader;
+  std::vector<int> fds;
+  int slot[PERF_COUNTERS];
+};
+
+std::mutex lock;
+std::vector<Group> groups;
+//what the groups of threads that have left had counted
+PerfSample retired;
+std::atomic<bool> active( false );
+bool available[PERF_COUNTERS];
+std::string error;
+//leader of the calling thread's group, or -1
+thread_local int ownLeader = -1;
+
+#ifdef __linux__
+
+void describe( int counter, perf_event_attr & attr ){
+  memset( &attr, 0, sizeof( attr ) );
+  attr.size = sizeof( attr );
+  switch( counter ){
+  case PERF_CYCLES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PERF_INSTRUCTIONS:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PERF_L1D_MISSES:
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_L1D
+      | ( PERF_COUNT_HW_CACHE_OP_READ << 8 )
+      | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+    break;
+  case PERF_LLC_MISSES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case PERF_BRANCH_MISSES:
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  }
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP
+    | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+int openCounter( perf_event_attr & attr, int leader ){
+  return syscall( __NR_perf_event_open, &attr, 0, -1, leader, 0 );
+}
+
+void closeGroup( Group & g ){
+  for( size_t i = 0; i < g.fds.size(); i++ )
+    close( g.fds[i] );
+  g.fds.clear();
+  g.leader = -1;
+}
+
+//adds the group's counts to s, scaled up if the kernel multiplexed them
+void readGroup( const Group & g, PerfSample & s ){
+  //nr, time enabled, time running, then one value per counter
+  unsigned long long buf[3 + PERF_COUNTERS];
+  if( read( g.leader, buf, sizeof( buf ) ) < (ssize_t) ( 3 * sizeof( buf[0] ) ) )
+    return;
+  unsigned long long enabled = buf[1], running = buf[2];
+  for( int c = 0; c < PERF_COUNTERS; c++ ){
+    if( g.slot[c] < 0 || (unsigned long long) g.slot[c] >= buf[0] )
+      continue;
+    unsigned long long v = buf[3 + g.slot[c]];
+    if( running && running < enabled )
+      v = (unsigned long long) ( (double) v * enabled / running );
+    s.v[c] += v;
+  }
+}
+
+//opens every counter in `want` for the calling thread. The first one that
+//opens leads the group. Whatever g held before is closed
+bool openGroup( const bool * want, Group & g, bool * opened, std::string * why ){
+  closeGroup( g );
+  for( int c = 0; c < PERF_COUNTERS; c++ ){
+    g.slot[c] = -1;
+    opened[c] = false;
+    if( !want[c] )
+      continue;
+    perf_event_attr attr;
+    describe( c, attr );
+    int fd = openCounter( attr, g.leader );
+    if( fd < 0 ){
+      if( why && why->empty() )
+	*why = std::string( names[c] ) + ": " + strerror( errno );
+      continue;
+    }
+    if( g.leader < 0 )
+      g.leader = fd;
+    g.slot[c] = g.fds.size();
+    g.fds.push_back( fd );
+    opened[c] = true;
+  }
+  return g.leader >= 0;
+}
+
+#endif
+
+}
+
+bool perfCountersStart(){
+#ifdef __linux__
+  std::lock_guard<std::mutex> l( lock );
+  if( active )
+    return true;
+  bool all[PERF_COUNTERS];
+  for( int c = 0; c < PERF_COUNTERS; c++ )
+    all[c] = true;
+  Group g;
+  g.leader = -1;
+  std::string why;
+  if( !openGroup( all, g, available, &why ) ){
+    error = why + " (see /proc/sys/kernel/perf_event_paranoid)";
+    return false;
+  }
+  groups.push_back( g );
+  ownLeader = g.leader;
+  for( int c = 0; c < PERF_COUNTERS; c++ )
+    retired.v[c] = 0;
+  static bool registered = false;
+  if( !registered ){
+    atexit( perfCountersStop );
+    registered = true;
+  }
+  active = true;
+  return true;
+#else
+  error = "hardware counters need Linux perf_event_open";
+  return false;
+#endif
+}
+
+bool perfCountersActive(){
+  return active;
+}
+
+bool perfCounterAvailable( int counter ){
+  return active && available[counter];
+}
+
+const char * perfCounterName( int counter ){
+  return names[counter];
+}
+
+const char * perfCountersError(){
+  return error.c_str();
+}
+
+void perfCountersAttachThread(){
+#ifdef __linux__
+  if( !active )
+    return;
+  //only what opened on the first thread, so every group has the same layout
+  //as far as the totals are concerned
+  Group g;
+  g.leader = -1;
+  bool opened[PERF_COUNTERS];
+  if( !openGroup( available, g, opened, NULL ) )
+    return;
+  std::lock_guard<std::mutex> l( lock );
+  groups.push_back( g );
+  ownLeader = g.leader;
+#endif
+}
+
+void perfCountersDetachThread(){
+#ifdef __linux__
+  if( ownLeader < 0 )
+    return;
+  std::lock_guard<std::mutex> l( lock );
+  for( size_t i = 0; i < groups.size(); i++ ){
+    if( groups[i].leader != ownLeader )
+      continue;
+    //its counts stay in the totals
+    readGroup( groups[i], retired );
+    closeGroup( groups[i] );
+    groups.erase( groups.begin() + i );
+    break;
+  }
+  ownLeader = -1;
+#endif
+}
+
+void perfCountersStop(){
+#ifdef __linux__
+  std::lock_guard<std::mutex> l( lock );
+  active = false;
+  for( size_t i = 0; i < groups.size(); i++ )
+    closeGroup( groups[i] );
+  groups.clear();
+  ownLeader = -1;
+#endif
+}
+
+void perfCountersRead( PerfSample & s ){
+  for( int c = 0; c < PERF_COUNTERS; c++ )
+    s.v[c] = 0;
+#ifdef __linux__
+  if( !active )
+    return;
+  std::lock_guard<std::mutex> l( lock );
+  s = retired;
+  for( size_t i = 0; i < groups.size(); i++ )
+    readGroup( groups[i], s );
+#endif
+}
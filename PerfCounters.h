@@ -0,0 +1,61 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+/* Hardware event counts from Linux perf_event_open, summed over every thread
+ * that does simulation work.
+ *
+ * perfCountersStart() opens a counter group on the calling thread. Threads
+ * created after that (the TaskScheduler workers) join by calling
+ * perfCountersAttachThread() when they start, and close their counters with
+ * perfCountersDetachThread() before they exit. perfCountersRead() adds up
+ * the counts of all those threads, so the difference between two reads is
+ * what the whole program spent between them. The profiler takes
+ * these readings around each phase (see PROFILE_PHASE in Profiler.h).
+ *
+ * Counting is user space only. Counters the kernel or CPU refuses (common in
+ * VMs and containers, or with a strict perf_event_paranoid) are left out and
+ * read as zero; perfCounterAvailable() says which ones are live. If none
+ * can be opened, or the platform is not Linux, perfCountersStart() returns
+ * false and everything else does nothing.
+ */
+
+enum PerfCounter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_COUNTERS
+};
+
+struct PerfSample {
+  unsigned long long v[PERF_COUNTERS];
+};
+
+//opens the counters; false (see perfCountersError) if none are available
+bool perfCountersStart();
+
+//closes every counter; perfCountersStart() has it run at exit
+void perfCountersStop();
+
+//true between a successful perfCountersStart() and perfCountersStop()
+bool perfCountersActive();
+
+bool perfCounterAvailable( int counter );
+const char * perfCounterName( int counter );
+
+//why perfCountersStart() failed, or an empty string
+const char * perfCountersError();
+
+//adds the calling thread to the counted ones; a no-op unless active
+void perfCountersAttachThread();
+
+//closes the calling thread's counters before it exits; what they counted
+//stays in the totals
+void perfCountersDetachThread();
+
+//current totals over all attached threads, scaled up if the kernel had to
+//multiplex the counters
+void perfCountersRead( PerfSample & s );
+
+#endif
@@ -0,0 +1,253 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//events kept per thread; about 1.5MB each
+const unsigned long RING_SIZE = 1 << 16;
+//distinct phases counted per thread; more than that only reach the ring
+const int MAX_PHASES = 64;
+
+struct Event {
+  const char * name;
+  unsigned long long start, duration;
+};
+
+struct PhaseStats {
+  const char * name;
+  unsigned long long calls, total, min, max;
+  //calls that came with hardware counts, and their sums
+  unsigned long long counted;
+  unsigned long long events[PERF_COUNTERS];
+};
+
+//everything one thread has recorded. Only that thread writes to it; written
+//is published last, so a dump sees complete events
+struct ThreadLog {
+  int tid;
+  bool main;
+  std::vector<Event> ring;
+  std::atomic<unsigned long> written;
+  PhaseStats phases[MAX_PHASES];
+  std::atomic<int> numPhases;
+};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+//static initialisation runs on the main thread
+const std::thread::id mainThread = std::this_thread::get_id();
+
+//logs outlive their threads: a scheduler's workers are usually gone by the
+//time the dump at exit runs. They are never freed
+std::mutex registryLock;
+std::vector<ThreadLog *> registry;
+
+thread_local ThreadLog * localLog = NULL;
+
+ThreadLog * threadLog(){
+  if( !localLog ){
+    ThreadLog * l = new ThreadLog();
+    l->ring.resize( RING_SIZE );
+    l->written = 0;
+    l->numPhases = 0;
+    l->main = std::this_thread::get_id() == mainThread;
+    std::lock_guard<std::mutex> g( registryLock );
+    l->tid = registry.size();
+    registry.push_back( l );
+    localLog = l;
+  }
+  return localLog;
+}
+
+//phases merged across threads by name
+struct Summary {
+  std::string name;
+  unsigned long long calls, total, min, max;
+  unsigned long long counted;
+  unsigned long long events[PERF_COUNTERS];
+};
+
+bool slowerTotal( const Summary & a, const Summary & b ){
+  return a.total > b.total;
+}
+
+}
+
+unsigned long long profilerNow(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - epoch ).count();
+}
+
+void profilerRecord( const char * name, unsigned long long start, unsigned long long end,
+		     const PerfSample * counted ){
+  ThreadLog * l = threadLog();
+  unsigned long long duration = end - start;
+
+  unsigned long w = l->written.load( std::memory_order_relaxed );
+  Event & e = l->ring[ w % RING_SIZE ];
+  e.name = name;
+  e.start = start;
+  e.duration = duration;
+  l->written.store( w + 1, std::memory_order_release );
+
+  //a handful of phases per thread, so a linear search on the pointer is
+  //cheaper than anything hashed
+  int n = l->numPhases.load( std::memory_order_relaxed );
+  int p = 0;
+  while( p < n && l->phases[p].name != name )
+    p++;
+  if( p == n ){
+    if( n == MAX_PHASES )
+      return;
+    PhaseStats & s = l->phases[p];
+    s.name = name;
+    s.calls = 0;
+    s.total = 0;
+    s.min = duration;
+    s.max = duration;
+    s.counted = 0;
+    for( int c = 0; c < PERF_COUNTERS; c++ )
+      s.events[c] = 0;
+    l->numPhases.store( n + 1, std::memory_order_release );
+  }
+  PhaseStats & s = l->phases[p];
+  s.calls++;
+  s.total += duration;
+  if( duration < s.min )
+    s.min = duration;
+  if( duration > s.max )
+    s.max = duration;
+  if( counted ){
+    s.counted++;
+    for( int c = 0; c < PERF_COUNTERS; c++ )
+      s.events[c] += counted->v[c];
+  }
+}
+
+void profilerWriteTrace( std::ostream & out ){
+  std::lock_guard<std::mutex> g( registryLock );
+  std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision( 3 );
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  for( size_t t = 0; t < registry.size(); t++ ){
+    ThreadLog * l = registry[t];
+    out << ( first ? "" : ",\n" )
+	<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << l->tid
+	<< ",\"args\":{\"name\":\"" << ( l->main ? "main" : "thread " + std::to_string( l->tid ) )
+	<< "\"}}";
+    first = false;
+
+    //oldest surviving event first
+    unsigned long w = l->written.load( std::memory_order_acquire );
+    unsigned long begin = w > RING_SIZE ? w - RING_SIZE : 0;
+    for( unsigned long i = begin; i < w; i++ ){
+      const Event & e = l->ring[ i % RING_SIZE ];
+      out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << l->tid
+	  << ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << e.duration / 1000.0 << "}";
+    }
+  }
+  out << "\n]}\n";
+  out.flags( flags );
+}
+
+void profilerPrintSummary( std::ostream & out ){
+  std::vector<Summary> phases;
+  unsigned long dropped = 0;
+  {
+    std::lock_guard<std::mutex> g( registryLock );
+    for( size_t t = 0; t < registry.size(); t++ ){
+      ThreadLog * l = registry[t];
+      unsigned long w = l->written.load( std::memory_order_acquire );
+      if( w > RING_SIZE )
+	dropped += w - RING_SIZE;
+      int n = l->numPhases.load( std::memory_order_acquire );
+      for( int p = 0; p < n; p++ ){
+	const PhaseStats & s = l->phases[p];
+	size_t k = 0;
+	while( k < phases.size() && phases[k].name != s.name )
+	  k++;
+	if( k == phases.size() ){
+	  Summary m = { s.name, 0, 0, s.min, s.max, 0, { 0 } };
+	  phases.push_back( m );
+	}
+	Summary & m = phases[k];
+	m.counted += s.counted;
+	for( int c = 0; c < PERF_COUNTERS; c++ )
+	  m.events[c] += s.events[c];
+	m.calls += s.calls;
+	m.total += s.total;
+	m.min = std::min( m.min, s.min );
+	m.max = std::max( m.max, s.max );
+      }
+    }
+  }
+  std::sort( phases.begin(), phases.end(), slowerTotal );
+
+  std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision( 3 );
+  out << "Phase timings (ms):\n";
+  out << "  " << std::left << std::setw( 40 ) << "phase" << std::right
+      << std::setw( 10 ) << "calls" << std::setw( 12 ) << "total"
+      << std::setw( 10 ) << "mean" << std::setw( 10 ) << "min"
+      << std::setw( 10 ) << "max" << "\n";
+  for( size_t k = 0; k < phases.size(); k++ ){
+    const Summary & m = phases[k];
+    out << "  " << std::left << std::setw( 40 ) << m.name << std::right
+	<< std::setw( 10 ) << m.calls
+	<< std::setw( 12 ) << m.total / 1e6
+	<< std::setw( 10 ) << m.total / 1e6 / m.calls
+	<< std::setw( 10 ) << m.min / 1e6
+	<< std::setw( 10 ) << m.max / 1e6 << "\n";
+  }
+  if( dropped )
+    out << "  (" << dropped << " older events are not in the trace)\n";
+
+  //hardware events per call, all threads together
+  bool counted = false;
+  for( size_t k = 0; k < phases.size(); k++ )
+    counted = counted || phases[k].counted;
+  if( counted ){
+    out << std::setprecision( 0 ) << "Hardware events per call:\n";
+    out << "  " << std::left << std::setw( 40 ) << "phase" << std::right;
+    for( int c = 0; c < PERF_COUNTERS; c++ )
+      out << std::setw( 15 ) << perfCounterName( c );
+    out << std::setw( 8 ) << "IPC" << "\n";
+    for( size_t k = 0; k < phases.size(); k++ ){
+      const Summary & m = phases[k];
+      if( !m.counted )
+	continue;
+      out << "  " << std::left << std::setw( 40 ) << m.name << std::right;
+      for( int c = 0; c < PERF_COUNTERS; c++ ){
+	if( perfCounterAvailable( c ) )
+	  out << std::setw( 15 ) << (double) m.events[c] / m.counted;
+	else
+	  out << std::setw( 15 ) << "n/a";
+      }
+      if( perfCounterAvailable( PERF_CYCLES ) && perfCounterAvailable( PERF_INSTRUCTIONS )
+	  && m.events[PERF_CYCLES] )
+	out << std::setw( 8 ) << std::setprecision( 2 )
+	    << (double) m.events[PERF_INSTRUCTIONS] / m.events[PERF_CYCLES]
+	    << std::setprecision( 0 );
+      else
+	out << std::setw( 8 ) << "n/a";
+      out << "\n";
+    }
+  }
+  out.flags( flags );
+}
+
+void profilerReset(){
+  std::lock_guard<std::mutex> g( registryLock );
+  for( size_t t = 0; t < registry.size(); t++ ){
+    registry[t]->written = 0;
+    registry[t]->numPhases = 0;
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include "PerfCounters.h"
+#include <ostream>
+
+/* Scoped timers for the phases of a step.
+ *
+ *   PROFILE_SCOPE( "CrowdWorld::calcForces" );
+ *
+ * times the rest of the enclosing block. Each thread records into its own
+ * ring buffer, so timing a scope takes no lock. A thread's ring keeps its
+ * newest events. Per-phase totals are counted separately and include every
+ * call, even ones the ring has already overwritten.
+ *
+ * Timers exist only in builds with PROFILING defined (make PROFILE=1). In
+ * any other build PROFILE_SCOPE expands to nothing, and the dump functions
+ * find no events.
+ *
+ * PROFILE_PHASE is PROFILE_SCOPE for the coarse phases of a step: while
+ * hardware counters are active (PerfCounters.h) it also records what the
+ * whole program counted during the phase. Reading the counters costs a few
+ * system calls, so fine-grained scopes stay on PROFILE_SCOPE.
+ *
+ * Names must be string literals (or otherwise outlive the program), since
+ * only the pointer is stored.
+ */
+
+#ifdef PROFILING
+#define PROFILE_CONCAT2( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT2( a, b )
+#define PROFILE_SCOPE( name ) ProfileScope PROFILE_CONCAT( profileScope, __LINE__ )( name )
+#define PROFILE_PHASE( name ) ProfilePhase PROFILE_CONCAT( profilePhase, __LINE__ )( name )
+#else
+#define PROFILE_SCOPE( name ) do {} while( 0 )
+#define PROFILE_PHASE( name ) do {} while( 0 )
+#endif
+
+//true in builds where PROFILE_SCOPE records anything
+inline bool profilerEnabled(){
+#ifdef PROFILING
+  return true;
+#else
+  return false;
+#endif
+}
+
+//nanoseconds since the program started
+unsigned long long profilerNow();
+
+//adds one finished interval to the calling thread's log, with the hardware
+//events counted during it if there are any
+void profilerRecord( const char * name, unsigned long long start, unsigned long long end,
+		     const PerfSample * counted = NULL );
+
+class ProfileScope {
+  const char * name;
+  unsigned long long start;
+
+  ProfileScope( const ProfileScope & );
+  ProfileScope & operator=( const ProfileScope & );
+
+ public:
+  explicit ProfileScope( const char * n ) : name( n ), start( profilerNow() ) {}
+  ~ProfileScope(){ profilerRecord( name, start, profilerNow() ); }
+};
+
+class ProfilePhase {
+  const char * name;
+  bool counting;
+  PerfSample before;
+  unsigned long long start;
+
+  ProfilePhase( const ProfilePhase & );
+  ProfilePhase & operator=( const ProfilePhase & );
+
+ public:
+  explicit ProfilePhase( const char * n ) : name( n ), counting( perfCountersActive() ) {
+    if( counting )
+      perfCountersRead( before );
+    start = profilerNow();
+  }
+  ~ProfilePhase(){
+    unsigned long long end = profilerNow();
+    if( !counting ){
+      profilerRecord( name, start, end );
+      return;
+    }
+    PerfSample after;
+    perfCountersRead( after );
+    for( int c = 0; c < PERF_COUNTERS; c++ )
+      after.v[c] -= before.v[c];
+    profilerRecord( name, start, end, &after );
+  }
+};
+
+//The dumps read every thread's log, so call them while no timed scope is
+//running (between steps, or at exit)
+
+//Chrome trace_event JSON, for chrome://tracing or ui.perfetto.dev
+void profilerWriteTrace( std::ostream & out );
+
+//calls, total, mean, min and max per phase, slowest total first. Phases
+//with hardware counts get a second table of per-call counts
+void profilerPrintSummary( std::ostream & out );
+
+//forgets everything recorded so far
+void profilerReset();
+
+#endif
@@ -1,4 +1,5 @@
 #include "Render.h"
+#include "Profiler.h"
 
 DrawObject::DrawObject(){
 }
@@ -170,6 +171,7 @@ Ogre::Entity * Render::newEntity( string name, string model){
 
 
 void Render::update( float f) {
+  PROFILE_PHASE( "Render::update" );
   for( std::vector< DrawObject *>::iterator a = drawObjects.begin();
        a != drawObjects.end();
        a++){
@@ -0,0 +1,251 @@
+#include "RolloutHarness.h"
+#include "ORCAAgent.h"
+#include "TaskScheduler.h"
+#include "VectorBatch.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Scores of one window, summed over its scored pedestrians and its steps
+struct WindowScore {
+    double errorSum;
+    size_t points;
+    double finalSum;
+    int agents;
+    size_t simulated;
+    size_t agentFrames;
+    size_t collisions;
+    double nearestSum;
+    float minDistance;
+};
+
+}
+
+static WindowScore emptyScore() {
+    WindowScore s = { 0.0, 0, 0.0, 0, 0, 0, 0, 0.0, std::numeric_limits<float>::infinity() };
+    return s;
+}
+
+// One worker's simulation, kept from one rollout to the next. Store slot i
+// is pool[i]; a rollout with n agents uses the first n and leaves the rest
+// idle, so the pool only grows to the largest crowd seen
+struct RolloutHarness::Instance {
+    AgentStore store;
+    std::vector<ORCAAgent*> pool;
+    std::vector<Agent*> active;
+    AgentKdTree tree;
+
+    // Slots scored this rollout, and for scored agent k the ground truth
+    // point of predicted step s at truth[k * predicted + s]
+    std::vector<int> scored;
+    std::vector<uint32_t> truth;
+    std::vector<float> dx, dy, error, nearest;
+
+    ~Instance() {
+        for (ORCAAgent* agent : pool) {
+            delete agent;
+        }
+    }
+
+    void reserve(int n, const RolloutOptions& o);
+    WindowScore run(const TrajectoryFile& dataset, const std::vector<int>& frames, int start,
+                    const RolloutOptions& o, const ObstacleKdTree& obstacles);
+};
+
+void RolloutHarness::Instance::reserve(int n, const RolloutOptions& o) {
+    if ((int)pool.size() >= n) {
+        return;
+    }
+    Json::Value config;
+    config["pos"].append(0.0f);
+    config["pos"].append(0.0f);
+    config["radius"] = o.radius;
+    config["timeHorizon"] = o.timeHorizon;
+    config["neighborDist"] = o.neighborDist;
+    config["maxNeighbors"] = o.maxNeighbors;
+    while ((int)pool.size() < n) {
+        pool.push_back(new ORCAAgent(config, &store));
+    }
+}
+
+WindowScore RolloutHarness::Instance::run(const TrajectoryFile& dataset, const std::vector<int>& frames,
+                                          int start, const RolloutOptions& o, const ObstacleKdTree& obstacles) {
+    WindowScore score = emptyScore();
+    const PointColumns& c = dataset.getColumns();
+    const int span = o.observed + o.predicted;
+    const float frameRate = dataset.frameRate();
+    const int last = frames[start + o.observed - 1];
+    const int before = o.observed > 1 ? frames[start + o.observed - 2] : last;
+    // Goals lie twice the horizon ahead, so agents keep their speed to the end
+    const float reach = 2.0f * (frames[start + span - 1] - last) / frameRate;
+
+    FrameView seen = dataset.frame(last);
+    int n = seen.size();
+    reserve(n, o);
+    active.assign(pool.begin(), pool.begin() + n);
+    scored.clear();
+    truth.clear();
+    for (int i = 0; i < n; ++i) {
+        size_t p = seen.pointIndex(i);
+        int id = c.agent[p];
+        float vx = 0.0f, vy = 0.0f;
+        size_t q;
+        // Only observed positions count, unlike the dataset's velocities,
+        // which look one frame ahead
+        if (before != last && dataset.findPoint(id, before, q)) {
+            float dt = (last - before) / frameRate;
+            vx = (c.x[p] - c.x[q]) / dt;
+            vy = (c.y[p] - c.y[q]) / dt;
+        }
+        store.x[i] = c.x[p];
+        store.y[i] = c.y[p];
+        store.vx[i] = vx;
+        store.vy[i] = vy;
+        store.maxVelocity[i] = std::sqrt(vx * vx + vy * vy);
+        store.radius[i] = o.radius;
+        pool[i]->setGoal(c.x[p] + vx * reach, c.y[p] + vy * reach);
+
+        // Scored if seen in every frame of the window
+        size_t mark = truth.size();
+        bool whole = true;
+        for (int j = 0; j < span && whole; ++j) {
+            whole = dataset.findPoint(id, frames[start + j], q);
+            if (whole && j >= o.observed) {
+                truth.push_back(q);
+            }
+        }
+        if (whole) {
+            scored.push_back(i);
+        } else {
+            truth.resize(mark);
+        }
+    }
+    if (scored.empty()) {
+        return score;
+    }
+
+    const int m = scored.size();
+    dx.resize(m * o.predicted);
+    dy.resize(m * o.predicted);
+    nearest.resize(n);
+    for (int s = 0; s < o.predicted; ++s) {
+        const int frame = frames[start + o.observed + s];
+        const float dt = (frame - frames[start + o.observed + s - 1]) / frameRate;
+        tree.build(active);
+        for (int i = 0; i < n; ++i) {
+            pool[i]->updatePrefVelocity();
+            pool[i]->calculateORCAVelocity(tree, obstacles, dt);
+        }
+        for (int i = 0; i < n; ++i) {
+            pool[i]->applyForces(dt);
+        }
+
+        for (int k = 0; k < m; ++k) {
+            size_t t = truth[k * o.predicted + s];
+            dx[k * o.predicted + s] = store.x[scored[k]] - c.x[t];
+            dy[k * o.predicted + s] = store.y[scored[k]] - c.y[t];
+        }
+        score.simulated += n;
+        if (n > 1) {
+            nearestDistances(store.x.data(), store.y.data(), n, nearest.data());
+            for (int i = 0; i < n; ++i) {
+                score.nearestSum += nearest[i];
+                score.minDistance = std::min(score.minDistance, nearest[i]);
+                if (nearest[i] < o.collisionDistance) {
+                    ++score.collisions;
+                }
+            }
+            score.agentFrames += n;
+        }
+    }
+
+    error.resize(m * o.predicted);
+    v2fBatchLen(dx.data(), dy.data(), error.data(), m * o.predicted);
+    for (int k = 0; k < m; ++k) {
+        for (int s = 0; s < o.predicted; ++s) {
+            score.errorSum += error[k * o.predicted + s];
+        }
+        score.finalSum += error[k * o.predicted + o.predicted - 1];
+    }
+    score.points = m * o.predicted;
+    score.agents = m;
+    return score;
+}
+
+RolloutHarness::RolloutHarness(const RolloutOptions& o) : options(o) {
+    options.observed = std::max(1, options.observed);
+    options.predicted = std::max(1, options.predicted);
+    options.stride = std::max(1, options.stride);
+    openGround.build();
+}
+
+RolloutHarness::~RolloutHarness() {
+}
+
+RolloutResult RolloutHarness::run(const TrajectoryFile& dataset) {
+    // Windows run over recorded frames; frame ids in between are skipped
+    std::vector<int> frames;
+    for (int f = 0; f < dataset.numFrames(); ++f) {
+        if (!dataset.frame(dataset.firstFrame() + f).empty()) {
+            frames.push_back(dataset.firstFrame() + f);
+        }
+    }
+    const int span = options.observed + options.predicted;
+    RolloutResult result;
+    result.windows = (int)frames.size() < span ? 0 : ((int)frames.size() - span) / options.stride + 1;
+    result.rollouts = 0;
+
+    int workers = options.scheduler ? options.scheduler->size() : 1;
+    while ((int)instances.size() < workers) {
+        instances.push_back(std::unique_ptr<Instance>(new Instance()));
+    }
+    const ObstacleKdTree& obstacles = options.obstacles ? *options.obstacles : openGround;
+    std::vector<WindowScore> scores(result.windows);
+    TaskScheduler::RangeBody body = [&](int begin, int end, int worker) {
+        for (int w = begin; w < end; ++w) {
+            scores[w] = instances[worker]->run(dataset, frames, w * options.stride, options, obstacles);
+        }
+    };
+    if (options.scheduler) {
+        // Small grains: rollouts differ a lot in crowd size
+        options.scheduler->parallelFor(result.windows, 1, body);
+    } else {
+        body(0, result.windows, 0);
+    }
+
+    EvaluationResult& r = result.scores;
+    r.matchedPoints = 0;
+    r.predictedPoints = 0;
+    r.groundTruthPoints = dataset.numPoints();
+    r.matchedAgents = 0;
+    r.agentFrames = 0;
+    r.collisions = 0;
+    r.minDistance = std::numeric_limits<float>::infinity();
+    double errorSum = 0.0, finalSum = 0.0, nearestSum = 0.0;
+    for (const WindowScore& s : scores) {
+        if (s.agents > 0) {
+            ++result.rollouts;
+        }
+        errorSum += s.errorSum;
+        finalSum += s.finalSum;
+        nearestSum += s.nearestSum;
+        r.matchedPoints += s.points;
+        r.matchedAgents += s.agents;
+        r.predictedPoints += s.simulated;
+        r.agentFrames += s.agentFrames;
+        r.collisions += s.collisions;
+        r.minDistance = std::min(r.minDistance, s.minDistance);
+    }
+    r.ade = r.matchedPoints ? errorSum / r.matchedPoints : 0.0;
+    r.fde = r.matchedAgents ? finalSum / r.matchedAgents : 0.0;
+    r.collisionRate = r.agentFrames ? (double)r.collisions / r.agentFrames : 0.0;
+    r.meanMinDistance = r.agentFrames ? nearestSum / r.agentFrames : 0.0;
+    return result;
+}
+
+void printRollouts(std::ostream& out, const RolloutResult& result) {
+    out << "  Rollouts: " << result.rollouts << " of " << result.windows << " windows" << std::endl;
+    printEvaluation(out, result.scores);
+}
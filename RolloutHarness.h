@@ -0,0 +1,76 @@
+#ifndef _ROLLOUT_HARNESS_H_
+#define _ROLLOUT_HARNESS_H_
+
+#include <memory>
+#include <vector>
+#include "Evaluation.h"
+#include "KdTree.h"
+#include "TrajectoryFile.h"
+
+class TaskScheduler;
+
+// Observe-then-predict benchmarking. Every window of observed + predicted
+// consecutive recorded frames of a dataset is one rollout: the pedestrians
+// of the window's last observed frame become ORCA agents, each walking on
+// at the velocity of its last two observed positions, and the simulation
+// runs for the predicted frames. Pedestrians present through the whole
+// window are scored against where they really went; the others only take
+// part as neighbours. A step lasts as long as the gap between the frames
+// it predicts (frame id difference over the frame rate), as velocities do
+// elsewhere in DatasetLoader.
+//
+// Rollouts run concurrently on a TaskScheduler, each worker reusing one
+// simulation instance (agent store, ORCA agents, k-d tree, buffers) for
+// every rollout it is handed, so nothing is rebuilt per window beyond the
+// agents' state. The obstacles, if any, are shared by all of them.
+//
+// The scores come back as an EvaluationResult: ADE and FDE over scored
+// (pedestrian, window) pairs, and the crowd statistics over every
+// simulated agent and step. Per-window scores are summed in window order,
+// so results do not depend on the thread count.
+
+struct RolloutOptions {
+    int observed;              // frames seen before the prediction starts
+    int predicted;             // frames simulated and scored
+    int stride;                // recorded frames between window starts
+    float radius;              // agent radius, meters
+    float timeHorizon;         // ORCA parameters, as in ORCAAgent
+    float neighborDist;
+    int maxNeighbors;
+    float collisionDistance;   // see EvaluationOptions
+    const ObstacleKdTree* obstacles;  // null for open ground
+    TaskScheduler* scheduler;  // null runs every rollout on the calling thread
+
+    RolloutOptions()
+        : observed(8), predicted(12), stride(1), radius(0.2f), timeHorizon(2.0f), neighborDist(10.0f),
+          maxNeighbors(10), collisionDistance(0.2f), obstacles(nullptr), scheduler(nullptr) {}
+};
+
+struct RolloutResult {
+    int windows;               // windows the dataset has
+    int rollouts;              // of those, windows with someone to score
+    EvaluationResult scores;
+};
+
+class RolloutHarness {
+private:
+    struct Instance;
+
+    RolloutOptions options;
+    std::vector<std::unique_ptr<Instance> > instances;  // one per worker
+    ObstacleKdTree openGround;
+
+    RolloutHarness(const RolloutHarness&);
+    RolloutHarness& operator=(const RolloutHarness&);
+
+public:
+    explicit RolloutHarness(const RolloutOptions& options = RolloutOptions());
+    ~RolloutHarness();
+
+    // Every window of dataset, scored. Instances are kept for the next call
+    RolloutResult run(const TrajectoryFile& dataset);
+};
+
+void printRollouts(std::ostream& out, const RolloutResult& result);
+
+#endif
@@ -0,0 +1,104 @@
+#include "SpatialHash.h"
+#include <cmath>
+#include <climits>
+
+SpatialHash::SpatialHash(){
+  cellSize = 1.0;
+  invCellSize = 1.0;
+  tableMask = 0;
+}
+
+void SpatialHash::setCellSize( float size ){
+  if( size < MY_EPSILON )
+    size = MY_EPSILON;
+  cellSize = size;
+  invCellSize = 1.0 / size;
+}
+
+int SpatialHash::cellCoord( float x ) const {
+  double c = std::floor( (double) x * invCellSize );
+  if( c < INT_MIN )
+    return INT_MIN;
+  if( c > INT_MAX )
+    return INT_MAX;
+  return (int) c;
+}
+
+unsigned int SpatialHash::hashCell( int ix, int iy ) const {
+  //the usual large-prime xor hash for 2d grids
+  unsigned int h = ((unsigned int) ix * 73856093u) ^ ((unsigned int) iy * 19349663u);
+  return h & tableMask;
+}
+
+void SpatialHash::build( const float * x, const float * y, int n ){
+  //keep roughly two buckets per point so most cells get a bucket of their own
+  unsigned int tableSize = 64;
+  while( tableSize < 2u * (unsigned int) n )
+    tableSize <<= 1;
+  tableMask = tableSize - 1;
+
+  cellStart.assign( tableSize + 1, 0 );
+  bucketOf.resize( n );
+
+  //count points per bucket. Non-finite positions can never pass the exact
+  //tests, so they are left out of the table entirely
+  for( int i = 0; i < n; i++ ){
+    if( !std::isfinite( x[i] ) || !std::isfinite( y[i] ) ){
+      bucketOf[i] = -1;
+      continue;
+    }
+    unsigned int b = hashCell( cellCoord( x[i] ), cellCoord( y[i] ) );
+    bucketOf[i] = (int) b;
+    cellStart[b + 1]++;
+  }
+
+  for( unsigned int b = 0; b < tableSize; b++ )
+    cellStart[b + 1] += cellStart[b];
+
+  //scatter; walking points in order keeps each bucket sorted by index
+  entries.resize( cellStart[tableSize] );
+  cursor.assign( cellStart.begin(), cellStart.end() - 1 );
+  for( int i = 0; i < n; i++ ){
+    if( bucketOf[i] < 0 )
+      continue;
+    entries[ cursor[ bucketOf[i] ]++ ] = i;
+  }
+}
+
+void SpatialHash::query( v2f lo, v2f hi, std::vector<int> & result ) const {
+  if( tableMask == 0 || entries.empty() )
+    return;
+  if( !std::isfinite( lo[0] ) || !std::isfinite( lo[1] ) ||
+      !std::isfinite( hi[0] ) || !std::isfinite( hi[1] ) )
+    return;
+
+  int x0 = cellCoord( lo[0] ), x1 = cellCoord( hi[0] );
+  int y0 = cellCoord( lo[1] ), y1 = cellCoord( hi[1] );
+
+  //a box covering more cells than there are buckets visits every bucket anyway
+  long long cells = ((long long) x1 - x0 + 1) * ((long long) y1 - y0 + 1);
+  if( cells > (long long) tableMask + 1 ){
+    result.insert( result.end(), entries.begin(), entries.end() );
+    return;
+  }
+
+  for( int ix = x0; ; ix++ ){
+    for( int iy = y0; ; iy++ ){
+      unsigned int b = hashCell( ix, iy );
+      for( int e = cellStart[b]; e < cellStart[b + 1]; e++ )
+	result.push_back( entries[e] );
+      if( iy == y1 )
+	break;
+    }
+    if( ix == x1 )
+      break;
+  }
+}
+
+void SpatialHash::cellOrder( std::vector<int> & order ) const {
+  order.assign( entries.begin(), entries.end() );
+  for( size_t i = 0; i < bucketOf.size(); i++ ){
+    if( bucketOf[i] < 0 )
+      order.push_back( i );
+  }
+}
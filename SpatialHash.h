@@ -0,0 +1,54 @@
+#ifndef _SPATIAL_HASH_H_
+#define _SPATIAL_HASH_H_
+
+#include "constants.h"
+#include <vector>
+
+/* SpatialHash is a uniform-grid broadphase over agent positions.
+ * Positions are bucketed into square cells of side cellSize, and cells are
+ * folded into a fixed-size hash table so the grid is unbounded. The table is
+ * rebuilt from scratch once per step with a counting sort, so after the first
+ * few steps a rebuild does not allocate.
+ *
+ * Queries return candidate indices only; hash collisions and cell granularity
+ * mean callers still have to run the exact visibility/collision tests.
+ */
+class SpatialHash {
+ private:
+  float cellSize;
+  float invCellSize;
+
+  //number of hash buckets minus one (bucket count is a power of two)
+  unsigned int tableMask;
+
+  //bucket b holds entries[ cellStart[b] .. cellStart[b+1] )
+  std::vector<int> cellStart;
+  std::vector<int> entries;
+
+  //bucket of each inserted point, -1 for points that could not be hashed
+  std::vector<int> bucketOf;
+  std::vector<int> cursor;
+
+  int cellCoord( float x ) const;
+  unsigned int hashCell( int ix, int iy ) const;
+
+ public:
+  SpatialHash();
+
+  void setCellSize( float size );
+  float getCellSize() const { return cellSize; }
+
+  //rebuilds the table from n points given as separate x and y arrays
+  void build( const float * x, const float * y, int n );
+
+  //appends the index of every point whose cell overlaps the box [lo, hi].
+  //an index can be appended more than once
+  void query( v2f lo, v2f hi, std::vector<int> & result ) const;
+
+  //fills order with every point index, grouped by bucket (points that could
+  //not be hashed come last). Walking points in this order keeps neighbours
+  //close together
+  void cellOrder( std::vector<int> & order ) const;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "TaskScheduler.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include <chrono>
+
+TaskScheduler::TaskScheduler( int n ){
+  if( n <= 0 )
+    n = std::thread::hardware_concurrency();
+  if( n <= 0 )
+    n = 1;
+
+  generation = 0;
+  stopping = false;
+  busyThreads = 0;
+  body = NULL;
+  remaining = 0;
+
+  for( int i = 0; i < n; i++ ){
+    workers.push_back( new Worker() );
+    workers[i]->rng = 2654435761u * ( i + 1 );
+  }
+  resetStats();
+
+  for( int i = 1; i < n; i++ )
+    threads.push_back( std::thread( &TaskScheduler::threadMain, this, i ) );
+}
+
+TaskScheduler::~TaskScheduler(){
+  {
+    std::lock_guard<std::mutex> l( lock );
+    stopping = true;
+  }
+  wake.notify_all();
+  for( size_t i = 0; i < threads.size(); i++ )
+    threads[i].join();
+  for( size_t i = 0; i < workers.size(); i++ )
+    delete workers[i];
+}
+
+void TaskScheduler::resetStats(){
+  for( size_t i = 0; i < workers.size(); i++ ){
+    WorkerStats & s = workers[i]->stats;
+    s.tasks = 0;
+    s.steals = 0;
+    s.failedSteals = 0;
+    s.idleSeconds = 0.0;
+  }
+}
+
+void TaskScheduler::printStats( std::ostream & out ) const {
+  for( size_t i = 0; i < workers.size(); i++ ){
+    const WorkerStats & s = workers[i]->stats;
+    out << "  worker " << i << ": " << s.tasks << " tasks, "
+	<< s.steals << " stolen, " << s.failedSteals << " failed steals, "
+	<< s.idleSeconds * 1000.0 << " ms idle\n";
+  }
+}
+
+void TaskScheduler::threadMain( int worker ){
+  //hardware counters are per thread; this one's count towards every phase
+  perfCountersAttachThread();
+  unsigned long seen = 0;
+  for( ;; ){
+    {
+      std::unique_lock<std::mutex> l( lock );
+      while( !stopping && generation == seen )
+	wake.wait( l );
+      if( stopping )
+	break;
+      seen = generation;
+    }
+
+    work( worker );
+
+    std::lock_guard<std::mutex> l( lock );
+    if( --busyThreads == 0 )
+      done.notify_one();
+  }
+  perfCountersDetachThread();
+}
+
+//the owner works through its chunks in order
+bool TaskScheduler::popLocal( int worker, Task & t ){
+  Worker * w = workers[worker];
+  std::lock_guard<std::mutex> l( w->lock );
+  if( w->tasks.empty() )
+    return false;
+  t = w->tasks.front();
+  w->tasks.pop_front();
+  return true;
+}
+
+//thieves take from the far end, away from where the owner is working.
+//Victims are tried starting from a random one so thieves spread out
+bool TaskScheduler::steal( int worker, Task & t ){
+  Worker * me = workers[worker];
+  int n = workers.size();
+  me->rng ^= me->rng << 13;
+  me->rng ^= me->rng >> 17;
+  me->rng ^= me->rng << 5;
+  int start = me->rng % n;
+  for( int k = 0; k < n; k++ ){
+    int v = ( start + k ) % n;
+    if( v == worker )
+      continue;
+    Worker * w = workers[v];
+    std::lock_guard<std::mutex> l( w->lock );
+    if( w->tasks.empty() )
+      continue;
+    t = w->tasks.back();
+    w->tasks.pop_back();
+    return true;
+  }
+  return false;
+}
+
+void TaskScheduler::work( int worker ){
+  WorkerStats & s = workers[worker]->stats;
+  bool idle = false;
+  std::chrono::steady_clock::time_point idleStart;
+
+  while( remaining.load( std::memory_order_acquire ) > 0 ){
+    Task t;
+    bool stolen = false;
+    if( !popLocal( worker, t ) ){
+      stolen = steal( worker, t );
+      if( !stolen ){
+	//everything left is already running somewhere; wait for it
+	s.failedSteals++;
+	if( !idle ){
+	  idle = true;
+	  idleStart = std::chrono::steady_clock::now();
+	}
+	std::this_thread::yield();
+	continue;
+      }
+      s.steals++;
+    }
+
+    if( idle ){
+      idle = false;
+      s.idleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - idleStart ).count();
+    }
+    {
+      //one span per chunk shows how the loop was spread over the threads
+      PROFILE_SCOPE( "TaskScheduler::chunk" );
+      (*body)( t.begin, t.end, worker );
+    }
+    s.tasks++;
+    remaining.fetch_sub( 1, std::memory_order_acq_rel );
+  }
+
+  if( idle )
+    s.idleSeconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - idleStart ).count();
+}
+
+void TaskScheduler::parallelFor( int n, int grain, const RangeBody & b ){
+  if( n <= 0 )
+    return;
+  int nw = workers.size();
+  if( nw == 1 ){
+    b( 0, n, 0 );
+    workers[0]->stats.tasks++;
+    return;
+  }
+
+  //several chunks per worker leave room for stealing without making the
+  //per-chunk overhead noticeable
+  if( grain <= 0 ){
+    grain = n / ( nw * 8 );
+    if( grain < 16 )
+      grain = 16;
+    if( grain > 1024 )
+      grain = 1024;
+  }
+
+  //worker w starts with the w-th contiguous run of chunks
+  int chunks = ( n + grain - 1 ) / grain;
+  for( int w = 0; w < nw; w++ ){
+    int first = (long) chunks * w / nw;
+    int last = (long) chunks * ( w + 1 ) / nw;
+    std::lock_guard<std::mutex> l( workers[w]->lock );
+    for( int c = first; c < last; c++ ){
+      Task t;
+      t.begin = c * grain;
+      t.end = c * grain + grain < n ? c * grain + grain : n;
+      workers[w]->tasks.push_back( t );
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> l( lock );
+    body = &b;
+    remaining.store( chunks, std::memory_order_release );
+    busyThreads = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  work( 0 );
+
+  //the other threads may still be between their last chunk and noticing
+  //that nothing is left; body has to outlive them
+  std::unique_lock<std::mutex> l( lock );
+  while( busyThreads > 0 )
+    done.wait( l );
+  body = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef _TASK_SCHEDULER_H_
+#define _TASK_SCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <ostream>
+
+/* TaskScheduler runs one loop at a time across a fixed set of threads with
+ * work stealing. The calling thread takes part as worker 0, so a scheduler
+ * of size 1 has no extra threads and runs everything inline.
+ *
+ * parallelFor cuts the index space into chunks of `grain` indices. Each
+ * worker starts with a contiguous run of chunks in its own deque and takes
+ * them from the front; a worker that runs dry steals from the back of
+ * another worker's deque. Chunks that are slow to process (dense parts of a
+ * crowd) therefore end up spread over whichever threads are free, instead
+ * of holding up the one thread a static split assigned them to.
+ *
+ * parallelFor returns once every chunk is done, so the caller can treat it
+ * as a barrier between phases.
+ */
+class TaskScheduler {
+ public:
+  //body( begin, end, worker ) processes indices [begin, end) on worker
+  typedef std::function<void( int, int, int )> RangeBody;
+
+  //load-balance counters of one worker, since the last resetStats()
+  struct WorkerStats {
+    unsigned long tasks;        //chunks run
+    unsigned long steals;       //chunks taken from another worker
+    unsigned long failedSteals; //sweeps over all other workers that found nothing
+    double idleSeconds;         //time spent looking for work without finding any
+  };
+
+ private:
+  struct Task {
+    int begin, end;
+  };
+
+  //one per thread, kept on separate cache lines
+  struct alignas( 64 ) Worker {
+    std::mutex lock;
+    std::deque<Task> tasks;
+    WorkerStats stats;
+    unsigned int rng;
+  };
+
+  std::vector<Worker *> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  //bumped for every loop; threads run each generation once
+  unsigned long generation;
+  bool stopping;
+  int busyThreads;
+
+  //the loop in progress
+  const RangeBody * body;
+  std::atomic<int> remaining;
+
+  void threadMain( int worker );
+  void work( int worker );
+  bool popLocal( int worker, Task & t );
+  bool steal( int worker, Task & t );
+
+  TaskScheduler( const TaskScheduler & );
+  TaskScheduler & operator=( const TaskScheduler & );
+
+ public:
+  //threads <= 0 uses one thread per hardware thread
+  TaskScheduler( int threads );
+  ~TaskScheduler();
+
+  int size() const { return workers.size(); }
+
+  //grain <= 0 picks a chunk size from n and the number of workers
+  void parallelFor( int n, int grain, const RangeBody & body );
+  void parallelFor( int n, const RangeBody & body ) { parallelFor( n, 0, body ); }
+
+  const WorkerStats & getStats( int worker ) const { return workers[worker]->stats; }
+  void resetStats();
+  void printStats( std::ostream & out ) const;
+};
+
+#endif
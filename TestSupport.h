@@ -0,0 +1,53 @@
+#ifndef _TEST_SUPPORT_H_
+#define _TEST_SUPPORT_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Trajectory.h"
+
+// What the test_*.cpp self-checks share: a CHECK that reports a failed
+// condition and carries on, scratch files, and the exit code for make test.
+
+inline int failures = 0;
+
+#define CHECK(cond) do {                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+            ++failures;                                                    \
+        }                                                                  \
+    } while (0)
+
+// A new empty file under /tmp whose name ends in suffix
+inline std::string tempPath(const char* suffix) {
+    std::string path = std::string("/tmp/crowdsim_testXXXXXX") + suffix;
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemps(name.data(), strlen(suffix));
+    if (fd < 0) {
+        std::cerr << "cannot make a temporary file" << std::endl;
+        exit(1);
+    }
+    close(fd);
+    return name.data();
+}
+
+inline TrajectoryPoint makePoint(int frame, int agent, float x, float y) {
+    TrajectoryPoint p = { frame, agent, x, y, 0.0f, 0.0f };
+    return p;
+}
+
+// Reports how the test went; the result is main's return value
+inline int finish(const char* name) {
+    if (failures) {
+        std::cerr << name << ": " << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << name << ": ok" << std::endl;
+    return 0;
+}
+
+#endif
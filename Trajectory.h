@@ -0,0 +1,81 @@
+#ifndef _TRAJECTORY_H_
+#define _TRAJECTORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Structure to hold trajectory data for a single agent
+struct TrajectoryPoint {
+    int frameId;
+    int agentId;
+    float x, y;
+    float vx, vy;  // velocities (calculated)
+};
+
+// Structure to hold agent trajectory
+struct AgentTrajectory {
+    int agentId;
+    std::vector<TrajectoryPoint> points;
+    float startTime;
+    float endTime;
+};
+
+// Point data stored one column per field, all indexed by the same point
+// index
+struct PointColumns {
+    const int32_t* frame;
+    const int32_t* agent;
+    const float* x;
+    const float* y;
+    const float* vx;
+    const float* vy;
+
+    TrajectoryPoint point(size_t i) const {
+        TrajectoryPoint p;
+        p.frameId = frame[i];
+        p.agentId = agent[i];
+        p.x = x[i];
+        p.y = y[i];
+        p.vx = vx[i];
+        p.vy = vy[i];
+        return p;
+    }
+};
+
+// The points of one frame, read in place: points [first, last) of the
+// columns. Iterating yields TrajectoryPoint values, so a range-for over a
+// frame looks the same as over a vector, without the copy. A view stays
+// valid while its dataset is loaded
+class FrameView {
+private:
+    const PointColumns* columns;
+    size_t first, last;
+
+public:
+    class iterator {
+        const PointColumns* columns;
+        size_t i;
+
+    public:
+        iterator(const PointColumns* c, size_t index) : columns(c), i(index) {}
+        TrajectoryPoint operator*() const { return columns->point(i); }
+        iterator& operator++() { ++i; return *this; }
+        bool operator==(const iterator& o) const { return i == o.i; }
+        bool operator!=(const iterator& o) const { return i != o.i; }
+    };
+
+    FrameView() : columns(nullptr), first(0), last(0) {}
+    FrameView(const PointColumns* c, size_t begin, size_t end) : columns(c), first(begin), last(end) {}
+
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    TrajectoryPoint operator[](size_t i) const { return columns->point(first + i); }
+    // Point index of the view's i-th point, for the column store
+    size_t pointIndex(size_t i) const { return first + i; }
+
+    iterator begin() const { return iterator(columns, first); }
+    iterator end() const { return iterator(columns, last); }
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include "TrajectoryFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+static const char trajectoryMagic[8] = { 'C', 'R', 'W', 'D', 'T', 'R', 'A', 'J' };
+static const uint32_t trajectoryVersion = 1;
+static const uint64_t sectionAlign = 64;
+
+static_assert(sizeof(TrajectoryFileHeader) == 128, "trajectory file header layout changed");
+
+// Bytes per entry of each section, in TrajectorySection order
+static const uint64_t entryBytes[TRAJ_SECTIONS] = { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 };
+
+// Entries in each section of a file with the given counts
+static void sectionSizes(uint64_t points, uint64_t agents, uint64_t frames, uint64_t* entries) {
+    for (int s = TRAJ_FRAME; s <= TRAJ_VY; ++s) {
+        entries[s] = points;
+    }
+    entries[TRAJ_FRAME_OFFSETS] = frames + 1;
+    entries[TRAJ_AGENT_IDS] = agents;
+    entries[TRAJ_AGENT_OFFSETS] = agents + 1;
+    entries[TRAJ_AGENT_POINTS] = points;
+}
+
+static uint64_t alignUp(uint64_t n) {
+    return (n + sectionAlign - 1) / sectionAlign * sectionAlign;
+}
+
+namespace {
+
+// Open-addressing map from agent ids to dense indices 0, 1, 2, ... in order
+// of first appearance. Grows at half full, so probes stay short
+class AgentIdMap {
+    std::vector<int> keys;
+    std::vector<int> values;  // -1 marks an empty slot
+    size_t mask;
+    int count;
+
+    static size_t hash(int id) {
+        unsigned int h = (unsigned int)id * 2654435761u;
+        return h ^ (h >> 16);
+    }
+
+    void grow() {
+        std::vector<int> oldKeys, oldValues;
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+        size_t capacity = oldKeys.empty() ? 256 : oldKeys.size() * 2;
+        keys.assign(capacity, 0);
+        values.assign(capacity, -1);
+        mask = capacity - 1;
+        for (size_t i = 0; i < oldKeys.size(); ++i) {
+            if (oldValues[i] >= 0) {
+                size_t s = hash(oldKeys[i]) & mask;
+                while (values[s] >= 0) {
+                    s = (s + 1) & mask;
+                }
+                keys[s] = oldKeys[i];
+                values[s] = oldValues[i];
+            }
+        }
+    }
+
+public:
+    AgentIdMap() : mask(0), count(0) { grow(); }
+
+    int size() const { return count; }
+
+    int insert(int id) {
+        size_t s = hash(id) & mask;
+        while (values[s] >= 0) {
+            if (keys[s] == id) {
+                return values[s];
+            }
+            s = (s + 1) & mask;
+        }
+        if ((size_t)(count + 1) * 2 > keys.size()) {
+            grow();
+            return insert(id);
+        }
+        keys[s] = id;
+        values[s] = count;
+        return count++;
+    }
+};
+
+}
+
+TrajectoryFile::TrajectoryFile() {
+    clear();
+}
+
+bool TrajectoryFile::fail(const std::string& why) {
+    clear();
+    error = why;
+    return false;
+}
+
+void TrajectoryFile::clear() {
+    build(std::vector<TrajectoryPoint>(), 0.0f, 0.0f);
+}
+
+bool TrajectoryFile::open(const std::string& path) {
+    if (!file.open(path)) {
+        return fail(file.getError());
+    }
+    std::vector<char>().swap(image);
+    return attach(file.data(), file.size(), path);
+}
+
+bool TrajectoryFile::attach(const char* base, uint64_t size, const std::string& name) {
+    if (size < sizeof(TrajectoryFileHeader) || memcmp(base, trajectoryMagic, sizeof(trajectoryMagic)) != 0) {
+        return fail(name + ": not a trajectory file");
+    }
+    header = reinterpret_cast<const TrajectoryFileHeader*>(base);
+    if (header->version != trajectoryVersion || header->headerBytes != sizeof(TrajectoryFileHeader)) {
+        return fail(name + ": unsupported trajectory file version");
+    }
+
+    // Every section has to fit in the file before anything points into it
+    uint64_t entries[TRAJ_SECTIONS];
+    sectionSizes(header->numPoints, header->numAgents, header->numFrames, entries);
+    for (int s = 0; s < TRAJ_SECTIONS; ++s) {
+        uint64_t offset = header->sections[s];
+        if (offset % sectionAlign != 0 || offset > size ||
+            entries[s] > (size - offset) / entryBytes[s]) {
+            return fail(name + ": truncated or corrupt trajectory file");
+        }
+    }
+    columns.frame = reinterpret_cast<const int32_t*>(base + header->sections[TRAJ_FRAME]);
+    columns.agent = reinterpret_cast<const int32_t*>(base + header->sections[TRAJ_AGENT]);
+    columns.x = reinterpret_cast<const float*>(base + header->sections[TRAJ_X]);
+    columns.y = reinterpret_cast<const float*>(base + header->sections[TRAJ_Y]);
+    columns.vx = reinterpret_cast<const float*>(base + header->sections[TRAJ_VX]);
+    columns.vy = reinterpret_cast<const float*>(base + header->sections[TRAJ_VY]);
+    frameOffsets = reinterpret_cast<const uint32_t*>(base + header->sections[TRAJ_FRAME_OFFSETS]);
+    agentIds = reinterpret_cast<const int32_t*>(base + header->sections[TRAJ_AGENT_IDS]);
+    agentOffsets = reinterpret_cast<const uint32_t*>(base + header->sections[TRAJ_AGENT_OFFSETS]);
+    agentPoints = reinterpret_cast<const uint32_t*>(base + header->sections[TRAJ_AGENT_POINTS]);
+
+    // Indexes are trusted from here on, so check they stay in bounds
+    uint64_t n = header->numPoints;
+    bool ok = frameOffsets[0] == 0 && frameOffsets[header->numFrames] == n &&
+              agentOffsets[0] == 0 && agentOffsets[header->numAgents] == n;
+    for (uint32_t f = 0; ok && f < header->numFrames; ++f) {
+        ok = frameOffsets[f] <= frameOffsets[f + 1];
+    }
+    for (uint32_t a = 0; ok && a < header->numAgents; ++a) {
+        ok = agentOffsets[a] <= agentOffsets[a + 1] && (a == 0 || agentIds[a - 1] < agentIds[a]);
+    }
+    for (uint64_t i = 0; ok && i < n; ++i) {
+        ok = agentPoints[i] < n;
+    }
+    if (!ok) {
+        return fail(name + ": corrupt trajectory file index");
+    }
+
+    // The lookups binary-search both orders: agent ids within each frame,
+    // and frames along each agent's points. Points are in frame order, so
+    // the latter holds when each agent's point indices increase. An agent
+    // seen twice in a frame is allowed, as build() keeps such points
+    for (uint32_t f = 0; ok && f < header->numFrames; ++f) {
+        int32_t frameId = header->firstFrame + (int32_t)f;
+        for (uint32_t i = frameOffsets[f]; ok && i < frameOffsets[f + 1]; ++i) {
+            ok = columns.frame[i] == frameId && (i == frameOffsets[f] || columns.agent[i - 1] <= columns.agent[i]);
+        }
+    }
+    for (uint32_t a = 0; ok && a < header->numAgents; ++a) {
+        for (uint32_t k = agentOffsets[a] + 1; ok && k < agentOffsets[a + 1]; ++k) {
+            ok = agentPoints[k - 1] < agentPoints[k];
+        }
+    }
+    if (!ok) {
+        return fail(name + ": trajectory file points out of order");
+    }
+    error.clear();
+    return true;
+}
+
+bool TrajectoryFile::build(const std::vector<TrajectoryPoint>& points, float frameRate, float pixelToMeter) {
+    size_t n = points.size();
+    if (n > UINT32_MAX - 1) {
+        return fail("too many points for a trajectory file");
+    }
+
+    // Number the agents in order of first appearance, then renumber them in
+    // id order, which is the order of the agent index
+    AgentIdMap idMap;
+    std::vector<int32_t> ids;
+    std::vector<uint32_t> agentOf(n);
+    int firstFrame = n ? points[0].frameId : 0;
+    int lastFrame = firstFrame;
+    for (size_t i = 0; i < n; ++i) {
+        int d = idMap.insert(points[i].agentId);
+        if (d == (int)ids.size()) {
+            ids.push_back(points[i].agentId);
+        }
+        agentOf[i] = d;
+        firstFrame = std::min(firstFrame, points[i].frameId);
+        lastFrame = std::max(lastFrame, points[i].frameId);
+    }
+    uint64_t numFrames = n ? (int64_t)lastFrame - firstFrame + 1 : 0;
+    if (numFrames > UINT32_MAX - 1) {
+        return fail("frame ids span too wide a range");
+    }
+    std::vector<uint32_t> byId(ids.size());
+    for (size_t d = 0; d < ids.size(); ++d) {
+        byId[d] = d;
+    }
+    std::sort(byId.begin(), byId.end(), [&ids](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+    std::vector<uint32_t> rank(ids.size());
+    for (size_t r = 0; r < ids.size(); ++r) {
+        rank[byId[r]] = r;
+    }
+    std::sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < n; ++i) {
+        agentOf[i] = rank[agentOf[i]];
+    }
+
+    // Lay the image out, then fill every section in place
+    TrajectoryFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, trajectoryMagic, sizeof(trajectoryMagic));
+    h.version = trajectoryVersion;
+    h.headerBytes = sizeof(h);
+    h.numPoints = n;
+    h.numAgents = ids.size();
+    h.firstFrame = firstFrame;
+    h.numFrames = numFrames;
+    h.frameRate = frameRate;
+    h.pixelToMeter = pixelToMeter;
+    uint64_t entries[TRAJ_SECTIONS];
+    sectionSizes(n, ids.size(), numFrames, entries);
+    uint64_t size = sizeof(h);
+    for (int s = 0; s < TRAJ_SECTIONS; ++s) {
+        h.sections[s] = size;
+        size += alignUp(entries[s] * entryBytes[s]);
+    }
+
+    file.close();
+    std::vector<char> built(size, 0);
+    char* base = built.data();
+    memcpy(base, &h, sizeof(h));
+    int32_t* frame = reinterpret_cast<int32_t*>(base + h.sections[TRAJ_FRAME]);
+    int32_t* agent = reinterpret_cast<int32_t*>(base + h.sections[TRAJ_AGENT]);
+    float* x = reinterpret_cast<float*>(base + h.sections[TRAJ_X]);
+    float* y = reinterpret_cast<float*>(base + h.sections[TRAJ_Y]);
+    float* vx = reinterpret_cast<float*>(base + h.sections[TRAJ_VX]);
+    float* vy = reinterpret_cast<float*>(base + h.sections[TRAJ_VY]);
+    uint32_t* frameIndex = reinterpret_cast<uint32_t*>(base + h.sections[TRAJ_FRAME_OFFSETS]);
+    int32_t* agentIndex = reinterpret_cast<int32_t*>(base + h.sections[TRAJ_AGENT_IDS]);
+    uint32_t* agentStart = reinterpret_cast<uint32_t*>(base + h.sections[TRAJ_AGENT_OFFSETS]);
+    uint32_t* agentList = reinterpret_cast<uint32_t*>(base + h.sections[TRAJ_AGENT_POINTS]);
+
+    std::copy(ids.begin(), ids.end(), agentIndex);
+    for (size_t i = 0; i < n; ++i) {
+        agentStart[agentOf[i] + 1]++;
+        frameIndex[points[i].frameId - firstFrame + 1]++;
+    }
+    for (size_t a = 0; a < ids.size(); ++a) {
+        agentStart[a + 1] += agentStart[a];
+    }
+    for (uint64_t f = 0; f < numFrames; ++f) {
+        frameIndex[f + 1] += frameIndex[f];
+    }
+
+    // Two stable counting sorts, by agent and then by frame, put the points
+    // in frame order, agents in id order within a frame, and input order
+    // within an agent's frame. The agent list and frame column are free
+    // until the final pass, so they hold the two permutations instead of
+    // scratch arrays
+    uint32_t* byAgent = agentList;
+    uint32_t* order = reinterpret_cast<uint32_t*>(frame);
+    std::vector<uint32_t> cursor(agentStart, agentStart + ids.size());
+    for (size_t i = 0; i < n; ++i) {
+        byAgent[cursor[agentOf[i]]++] = i;
+    }
+    cursor.assign(frameIndex, frameIndex + numFrames);
+    for (size_t k = 0; k < n; ++k) {
+        uint32_t i = byAgent[k];
+        order[cursor[points[i].frameId - firstFrame]++] = i;
+    }
+
+    // Copy the points into their columns, and list each agent's new point
+    // indices, which come out in frame order. Entry k of order is read
+    // before frame[k] overwrites it
+    cursor.assign(agentStart, agentStart + ids.size());
+    for (size_t k = 0; k < n; ++k) {
+        uint32_t i = order[k];
+        const TrajectoryPoint& p = points[i];
+        frame[k] = p.frameId;
+        agent[k] = p.agentId;
+        x[k] = p.x;
+        y[k] = p.y;
+        vx[k] = p.vx;
+        vy[k] = p.vy;
+        agentList[cursor[agentOf[i]]++] = k;
+    }
+
+    image.swap(built);
+    return attach(image.data(), image.size(), "trajectory image");
+}
+
+float* TrajectoryFile::writableColumn(TrajectorySection section) {
+    if (image.empty() || section < TRAJ_X || section > TRAJ_VY) {
+        return nullptr;
+    }
+    return reinterpret_cast<float*>(image.data() + header->sections[section]);
+}
+
+bool TrajectoryFile::save(const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    // The header's size fields say how far the image runs
+    uint64_t size = header->sections[TRAJ_AGENT_POINTS] +
+                    alignUp(header->numPoints * entryBytes[TRAJ_AGENT_POINTS]);
+    out.write(reinterpret_cast<const char*>(header), size);
+    out.close();
+    if (!out) {
+        error = path + ": write failed";
+        return false;
+    }
+    return true;
+}
+
+FrameView TrajectoryFile::frame(int frameId) const {
+    int64_t f = (int64_t)frameId - header->firstFrame;
+    if (f < 0 || f >= header->numFrames) {
+        return FrameView();
+    }
+    return FrameView(&columns, frameOffsets[f], frameOffsets[f + 1]);
+}
+
+bool TrajectoryFile::findPoint(int agentId, int frameId, size_t& index) const {
+    int64_t f = (int64_t)frameId - header->firstFrame;
+    if (f < 0 || f >= header->numFrames) {
+        return false;
+    }
+    const int32_t* begin = columns.agent + frameOffsets[f];
+    const int32_t* end = columns.agent + frameOffsets[f + 1];
+    const int32_t* it = std::lower_bound(begin, end, agentId);
+    if (it == end || *it != agentId) {
+        return false;
+    }
+    index = it - columns.agent;
+    return true;
+}
+
+int TrajectoryFile::findAgent(int agentId) const {
+    const int32_t* end = agentIds + header->numAgents;
+    const int32_t* it = std::lower_bound(agentIds, end, agentId);
+    return it != end && *it == agentId ? (int)(it - agentIds) : -1;
+}
+
+bool TrajectoryFile::nextPoint(int agentId, int frameId, size_t& index) const {
+    int agent = findAgent(agentId);
+    if (agent < 0) {
+        return false;
+    }
+    const uint32_t* begin = agentPointIndices(agent);
+    const uint32_t* end = begin + agentSize(agent);
+    const int32_t* frames = columns.frame;
+    const uint32_t* it = std::upper_bound(begin, end, frameId,
+        [frames](int f, uint32_t i) { return f < frames[i]; });
+    if (it == end) {
+        return false;
+    }
+    index = *it;
+    return true;
+}
+
+void TrajectoryFile::readTrajectory(int agent, AgentTrajectory& out) const {
+    out.agentId = agentIds[agent];
+    out.points.clear();
+    const uint32_t* indices = agentPointIndices(agent);
+    for (size_t i = 0; i < agentSize(agent); ++i) {
+        out.points.push_back(point(indices[i]));
+    }
+    out.startTime = out.points.empty() ? 0.0f : out.points.front().frameId / header->frameRate;
+    out.endTime = out.points.empty() ? 0.0f : out.points.back().frameId / header->frameRate;
+}
@@ -0,0 +1,115 @@
+#ifndef _TRAJECTORY_FILE_H_
+#define _TRAJECTORY_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Trajectory.h"
+#include "MappedFile.h"
+
+// Native binary trajectory file. Text datasets are converted once (see
+// trajconvert) and every later run maps the result instead of parsing it.
+//
+// Layout, version 1, all little-endian:
+//   header (TrajectoryFileHeader, 128 bytes)
+//   point columns, one entry per point, ordered by frame and then by agent
+//   id:
+//     frame int32, agent int32, x, y, vx, vy float32
+//   frame index: uint32[numFrames + 1]; frame firstFrame + f owns points
+//     [frameOffsets[f], frameOffsets[f + 1])
+//   agent index: agentIds int32[numAgents] ascending, agentOffsets
+//     uint32[numAgents + 1], and agentPoints uint32[numPoints]; agent a's
+//     points, in frame order, are agentPoints[agentOffsets[a] ..
+//     agentOffsets[a + 1])
+// Every section starts on a 64-byte boundary. Positions are in meters and
+// velocities in meters per second: pixelToMeter and frameRate were applied
+// when the file was written and are kept for reference.
+
+enum TrajectorySection {
+    TRAJ_FRAME, TRAJ_AGENT, TRAJ_X, TRAJ_Y, TRAJ_VX, TRAJ_VY,
+    TRAJ_FRAME_OFFSETS, TRAJ_AGENT_IDS, TRAJ_AGENT_OFFSETS, TRAJ_AGENT_POINTS,
+    TRAJ_SECTIONS
+};
+
+struct TrajectoryFileHeader {
+    char magic[8];             // "CRWDTRAJ"
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t numPoints;
+    uint32_t numAgents;
+    int32_t firstFrame;
+    uint32_t numFrames;
+    float frameRate;
+    float pixelToMeter;
+    uint32_t reserved;
+    uint64_t sections[TRAJ_SECTIONS];  // byte offset of each section
+};
+
+// A trajectory file image: either a mapped file or one built in memory in
+// the same layout, which is how DatasetLoader keeps text datasets too.
+// Nothing is copied or parsed on open; the header, the indexes and the
+// point order they rely on are checked, then every query reads the image. A new TrajectoryFile holds an empty
+// dataset.
+class TrajectoryFile {
+private:
+    MappedFile file;
+    std::vector<char> image;  // built in memory rather than mapped
+    const TrajectoryFileHeader* header;
+    PointColumns columns;
+    const uint32_t* frameOffsets;
+    const int32_t* agentIds;
+    const uint32_t* agentOffsets;
+    const uint32_t* agentPoints;
+    std::string error;
+
+    bool attach(const char* base, uint64_t size, const std::string& name);
+    bool fail(const std::string& why);
+
+    TrajectoryFile(const TrajectoryFile&);
+    TrajectoryFile& operator=(const TrajectoryFile&);
+
+public:
+    TrajectoryFile();
+
+    // False, with getError() set and the dataset empty, if the file is
+    // missing or not a valid trajectory file
+    bool open(const std::string& path);
+    // Takes points in any order; an agent's points in the same frame keep
+    // their order
+    bool build(const std::vector<TrajectoryPoint>& points, float frameRate, float pixelToMeter);
+    void clear();
+    bool save(const std::string& path);
+    const std::string& getError() const { return error; }
+
+    size_t numPoints() const { return header->numPoints; }
+    int numAgents() const { return header->numAgents; }
+    int firstFrame() const { return header->firstFrame; }
+    int numFrames() const { return header->numFrames; }
+    float frameRate() const { return header->frameRate; }
+    float pixelToMeter() const { return header->pixelToMeter; }
+
+    // Raw columns, numPoints() long, in frame order
+    const PointColumns& getColumns() const { return columns; }
+    TrajectoryPoint point(size_t i) const { return columns.point(i); }
+    // One of the point columns of a built image, for filling in derived
+    // values such as velocities; null for mapped files, which are read-only
+    float* writableColumn(TrajectorySection section);
+
+    // Empty for frames outside the dataset
+    FrameView frame(int frameId) const;
+    // Index of agentId's point in frameId: the frame from the offset
+    // table, then a binary search over the frame's agent ids
+    bool findPoint(int agentId, int frameId, size_t& index) const;
+
+    // Agents are numbered 0 .. numAgents() - 1 in id order
+    int agentId(int agent) const { return agentIds[agent]; }
+    int findAgent(int agentId) const;  // -1 if there is no such agent
+    size_t agentSize(int agent) const { return agentOffsets[agent + 1] - agentOffsets[agent]; }
+    // Point indices of the agent, in frame order
+    const uint32_t* agentPointIndices(int agent) const { return agentPoints + agentOffsets[agent]; }
+    // First point of agentId after frameId
+    bool nextPoint(int agentId, int frameId, size_t& index) const;
+    void readTrajectory(int agent, AgentTrajectory& out) const;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "TrajectoryRecorder.h"
+#include <algorithm>
+#include <cstring>
+
+//blocks in the ring, and the positions each is sized for
+static const int recorderBlocks = 4;
+static const int recorderBlockPoints = 1 << 16;
+
+TrajectoryRecorder::TrajectoryRecorder(){
+  capacity = 0;
+  framesPerBlock = 0;
+  every = 1;
+  calls = 0;
+  filling = -1;
+  writing = false;
+  closing = false;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder(){
+  close();
+}
+
+bool TrajectoryRecorder::open( const std::string & path, int agents, int n ){
+  close();
+  error.clear();
+  if( !out.open( path ) ){
+    error = out.getError();
+    return false;
+  }
+  every = std::max( 1, n );
+  calls = 0;
+  blocks.assign( recorderBlocks, Block() );
+  sizeBlocks( std::max( 1, agents ) );
+  spare.clear();
+  full.clear();
+  for( int b = 0; b < recorderBlocks; b++ )
+    spare.push_back( b );
+  writing = false;
+  closing = false;
+  filling = -1;
+  writer = std::thread( &TrajectoryRecorder::writerMain, this );
+  takeSpare();
+  return true;
+}
+
+void TrajectoryRecorder::record( const AgentStore & store, int n, int frame ){
+  if( filling < 0 || calls++ % every != 0 )
+    return;
+  if( n > capacity )
+    grow( n );
+  Block * b = &blocks[filling];
+  if( b->frames == framesPerBlock ){
+    handOff();
+    takeSpare();
+    b = &blocks[filling];
+  }
+  int f = b->frames++;
+  b->frameId[f] = frame;
+  b->count[f] = n;
+  if( n > 0 ){
+    memcpy( &b->x[(size_t) f * capacity], &store.x[0], n * sizeof( float ) );
+    memcpy( &b->y[(size_t) f * capacity], &store.y[0], n * sizeof( float ) );
+  }
+}
+
+bool TrajectoryRecorder::close(){
+  if( !writer.joinable() )
+    return error.empty();
+  handOff();
+  filling = -1;
+  {
+    std::lock_guard<std::mutex> guard( lock );
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+  if( !out.close() && error.empty() )
+    error = out.getError();
+  blocks.clear();
+  return error.empty();
+}
+
+void TrajectoryRecorder::handOff(){
+  if( filling < 0 )
+    return;
+  if( blocks[filling].frames == 0 ){
+    std::lock_guard<std::mutex> guard( lock );
+    spare.push_back( filling );
+  } else {
+    {
+      std::lock_guard<std::mutex> guard( lock );
+      full.push_back( filling );
+    }
+    wake.notify_one();
+  }
+  filling = -1;
+}
+
+void TrajectoryRecorder::takeSpare(){
+  std::unique_lock<std::mutex> guard( lock );
+  returned.wait( guard, [this]{ return !spare.empty(); } );
+  filling = spare.back();
+  spare.pop_back();
+  blocks[filling].frames = 0;
+}
+
+void TrajectoryRecorder::grow( int agents ){
+  //the writer has to finish with every block before they can be resized
+  handOff();
+  {
+    std::unique_lock<std::mutex> guard( lock );
+    returned.wait( guard, [this]{ return full.empty() && !writing; } );
+  }
+  sizeBlocks( std::max( agents, capacity * 2 ) );
+  takeSpare();
+}
+
+//fewer frames per block as the agent count grows, so a block stays the size
+//of recorderBlockPoints positions
+void TrajectoryRecorder::sizeBlocks( int agents ){
+  capacity = agents;
+  framesPerBlock = std::max( 1, recorderBlockPoints / capacity );
+  for( size_t b = 0; b < blocks.size(); b++ ){
+    blocks[b].frameId.resize( framesPerBlock );
+    blocks[b].count.resize( framesPerBlock );
+    blocks[b].x.resize( (size_t) framesPerBlock * capacity );
+    blocks[b].y.resize( (size_t) framesPerBlock * capacity );
+    blocks[b].frames = 0;
+  }
+}
+
+void TrajectoryRecorder::writerMain(){
+  for( ;; ){
+    int b;
+    {
+      std::unique_lock<std::mutex> guard( lock );
+      wake.wait( guard, [this]{ return closing || !full.empty(); } );
+      if( full.empty() )
+        return;
+      b = full.front();
+      full.pop_front();
+      writing = true;
+    }
+    writeBlock( blocks[b] );
+    {
+      std::lock_guard<std::mutex> guard( lock );
+      writing = false;
+      spare.push_back( b );
+    }
+    returned.notify_one();
+  }
+}
+
+void TrajectoryRecorder::writeBlock( const Block & b ){
+  for( int f = 0; f < b.frames; f++ ){
+    const float * x = &b.x[(size_t) f * capacity];
+    const float * y = &b.y[(size_t) f * capacity];
+    for( int i = 0; i < b.count[f]; i++ ){
+      out.putInt( b.frameId[f] );
+      out.put( ' ' );
+      out.putInt( i );
+      out.put( ' ' );
+      out.putFloat( x[i] );
+      out.put( ' ' );
+      out.putFloat( y[i] );
+      out.put( '\n' );
+    }
+  }
+}
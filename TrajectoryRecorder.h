@@ -0,0 +1,86 @@
+#ifndef _TRAJECTORY_RECORDER_H_
+#define _TRAJECTORY_RECORDER_H_
+
+#include "AgentStore.h"
+#include "BufferedWriter.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* TrajectoryRecorder writes the agent positions of a running simulation to
+ * a file in the ETH text layout, one "frame agent x y" line per agent and
+ * step, so DatasetLoader can replay or evaluate the run (load it with a
+ * pixelToMeter of 1, and a frame rate of one over the timeslice). The agent
+ * is its slot in the store.
+ *
+ * The step loop only copies the positions into one of a few blocks that are
+ * allocated up front, each holding a run of frames; a writer thread formats
+ * full blocks and writes them out. Nothing is allocated per step, unless
+ * the agent count outgrows the blocks, which doubles their width. If the
+ * writer falls a whole ring of blocks behind, record() waits for it rather
+ * than drop frames.
+ */
+class TrajectoryRecorder {
+ private:
+  //frames [0, frames) of a block: frame f's agent i is at f * capacity + i
+  struct Block {
+    std::vector<int> frameId;
+    std::vector<int> count;
+    std::vector<float> x, y;
+    int frames;
+  };
+
+  std::vector<Block> blocks;
+  int capacity;        //agents per frame a block has room for
+  int framesPerBlock;
+  int every;
+  long calls;
+  //block the step loop is filling, or -1
+  int filling;
+
+  //block indices waiting for the writer, and ready for the step loop
+  std::deque<int> full;
+  std::vector<int> spare;
+  bool writing;        //the writer holds a block
+  bool closing;
+  std::thread writer;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable returned;
+
+  BufferedWriter out;
+  std::string error;
+
+  void writerMain();
+  void writeBlock( const Block & b );
+  //queues the block being filled, if it holds anything
+  void handOff();
+  //waits for a spare block and starts filling it
+  void takeSpare();
+  //makes room for agents agents per frame
+  void grow( int agents );
+  void sizeBlocks( int agents );
+
+  TrajectoryRecorder( const TrajectoryRecorder & );
+  TrajectoryRecorder & operator=( const TrajectoryRecorder & );
+
+ public:
+  TrajectoryRecorder();
+  ~TrajectoryRecorder();
+
+  //starts a recording sized for agents agents, keeping every nth step;
+  //false with getError() set if the file cannot be created
+  bool open( const std::string & path, int agents, int every = 1 );
+  //the positions of slots [0, n) of store as frame
+  void record( const AgentStore & store, int n, int frame );
+  //writes out what is left and closes; false if any write failed
+  bool close();
+
+  bool isOpen() const { return writer.joinable(); }
+  const std::string & getError() const { return error; }
+};
+
+#endif
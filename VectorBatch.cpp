@@ -0,0 +1,132 @@
+#include "VectorBatch.h"
+#include "VectorBatchKernels.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//defined in VectorBatchAVX2.cpp; false when that file was built without AVX2
+bool vectorBatchAvx2Table( VectorBatchTable * t );
+
+#ifdef __SSE2__
+namespace {
+
+//4 lanes; SSE2 is part of every x86-64 CPU
+struct Sse2Lanes {
+  typedef __m128 T;
+  typedef __m128 M;
+  enum { W = 4 };
+  static T load( const float * p ) { return _mm_loadu_ps( p ); }
+  static void store( float * p, T v ) { _mm_storeu_ps( p, v ); }
+  static T set1( float f ) { return _mm_set1_ps( f ); }
+  static T add( T a, T b ) { return _mm_add_ps( a, b ); }
+  static T sub( T a, T b ) { return _mm_sub_ps( a, b ); }
+  static T mul( T a, T b ) { return _mm_mul_ps( a, b ); }
+  static T div( T a, T b ) { return _mm_div_ps( a, b ); }
+  static T sqrt( T a ) { return _mm_sqrt_ps( a ); }
+  static T neg( T a ) { return _mm_xor_ps( a, _mm_set1_ps( -0.0f ) ); }
+  static M le( T a, T b ) { return _mm_cmple_ps( a, b ); }
+  static M ge( T a, T b ) { return _mm_cmpge_ps( a, b ); }
+  static M eq( T a, T b ) { return _mm_cmpeq_ps( a, b ); }
+  static M andnot( M a, M b ) { return _mm_andnot_ps( b, a ); }
+  static T select( M m, T a, T b ){
+    return _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) );
+  }
+};
+
+}
+#endif
+
+static VectorBatchTable kernels;
+static VectorIsa activeIsa = v2fBatchUseIsa( VECTOR_AVX2 );
+
+static bool isaSupported( VectorIsa isa ){
+  switch( isa ){
+  case VECTOR_AVX2:
+#if defined(__x86_64__) || defined(__i386__)
+    {
+      VectorBatchTable t;
+      //may run from a static initializer, before the runtime has probed the CPU
+      __builtin_cpu_init();
+      return __builtin_cpu_supports( "avx2" ) && vectorBatchAvx2Table( &t );
+    }
+#else
+    return false;
+#endif
+  case VECTOR_SSE2:
+#ifdef __SSE2__
+    return true;
+#else
+    return false;
+#endif
+  default:
+    return true;
+  }
+}
+
+VectorIsa v2fBatchUseIsa( VectorIsa isa ){
+  while( isa != VECTOR_SCALAR && !isaSupported( isa ) )
+    isa = (VectorIsa) (isa - 1);
+
+  switch( isa ){
+  case VECTOR_AVX2:
+    vectorBatchAvx2Table( &kernels );
+    break;
+#ifdef __SSE2__
+  case VECTOR_SSE2:
+    kernels = makeVectorBatchTable<Sse2Lanes>();
+    break;
+#endif
+  default:
+    kernels = makeVectorBatchTable<ScalarLanes>();
+    break;
+  }
+  activeIsa = isa;
+  return isa;
+}
+
+VectorIsa v2fBatchIsa(){
+  return activeIsa;
+}
+
+const char * v2fBatchIsaName( VectorIsa isa ){
+  switch( isa ){
+  case VECTOR_AVX2: return "avx2";
+  case VECTOR_SSE2: return "sse2";
+  default: return "scalar";
+  }
+}
+
+void v2fBatchLen( const float * x, const float * y, float * out, int n ){
+  kernels.len( x, y, out, n );
+}
+
+void v2fBatchNormalize( const float * x, const float * y,
+			float * rx, float * ry, int n ){
+  kernels.normalize( x, y, rx, ry, n );
+}
+
+void v2fBatchDot( const float * x, const float * y, v2f v, float * out, int n ){
+  kernels.dot( x, y, v, out, n );
+}
+
+void v2fBatchCross( const float * x, const float * y, v2f v, float * out, int n ){
+  kernels.cross( x, y, v, out, n );
+}
+
+void v2fBatchCrossAndRecross( const float * x, const float * y, v2f v,
+			      float * rx, float * ry, int n ){
+  kernels.crossAndRecross( x, y, v, rx, ry, n );
+}
+
+void v2fBatchDist( const float * x, const float * y, v2f from, float * out, int n ){
+  kernels.dist( x, y, from, out, n );
+}
+
+void v2fBatchPtToLineDist( const float * x, const float * y,
+			   v2f start, v2f dir, float len, float * out, int n ){
+  //ptToLineDist normalizes dir first
+  v2f d;
+  v2fNormalize( dir, d );
+  kernels.ptToLineDist( x, y, start, d, len, out, n );
+}
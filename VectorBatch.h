@@ -0,0 +1,51 @@
+#ifndef _VECTOR_BATCH_H_
+#define _VECTOR_BATCH_H_
+
+#include "constants.h"
+
+/* Batched versions of the v2f helpers. Each kernel works on n vectors stored
+ * as separate x and y arrays (structure of arrays) and computes, for every
+ * element, exactly what the scalar helper in vector.cpp computes: the same
+ * operations in the same order, with no fused multiply-add. Results are
+ * therefore bit-identical whichever instruction set ends up running them.
+ *
+ * The implementation is picked once at startup from what the CPU supports
+ * (AVX2: 8 lanes, SSE2: 4 lanes, otherwise scalar). Output arrays may alias
+ * input arrays.
+ */
+
+enum VectorIsa { VECTOR_SCALAR, VECTOR_SSE2, VECTOR_AVX2 };
+
+//instruction set the kernels currently run on
+VectorIsa v2fBatchIsa();
+const char * v2fBatchIsaName( VectorIsa isa );
+
+//switches to isa, or the best supported one below it. Returns the one in use
+VectorIsa v2fBatchUseIsa( VectorIsa isa );
+
+//out = v2fLen( (x,y) )
+void v2fBatchLen( const float * x, const float * y, float * out, int n );
+
+//(rx,ry) = v2fNormalize( (x,y) )
+void v2fBatchNormalize( const float * x, const float * y,
+			float * rx, float * ry, int n );
+
+//out = v2fDot( v, (x,y) )
+void v2fBatchDot( const float * x, const float * y, v2f v, float * out, int n );
+
+//out = v2fCross( (x,y), v )
+void v2fBatchCross( const float * x, const float * y, v2f v, float * out, int n );
+
+//(rx,ry) = ((x,y) x v) x (x,y), as crossAndRecross in Agent.cpp
+void v2fBatchCrossAndRecross( const float * x, const float * y, v2f v,
+			      float * rx, float * ry, int n );
+
+//out = v2fLen( from - (x,y) )
+void v2fBatchDist( const float * x, const float * y, v2f from, float * out, int n );
+
+//out = ptToLineDist( (x,y), start, dir, len ). Unlike ptToLineDist, dir is
+//not normalized in place
+void v2fBatchPtToLineDist( const float * x, const float * y,
+			   v2f start, v2f dir, float len, float * out, int n );
+
+#endif
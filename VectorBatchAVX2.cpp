@@ -0,0 +1,47 @@
+/* AVX2 instantiation of the VectorBatch kernels. This file alone is compiled
+ * with -mavx2 (see the Makefile), so it must not include anything that
+ * defines shared inline code: only the intrinsics and the kernel header.
+ * VectorBatch.cpp checks the CPU before calling in.
+ */
+#include "VectorBatchKernels.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace {
+
+//8 lanes
+struct Avx2Lanes {
+  typedef __m256 T;
+  typedef __m256 M;
+  enum { W = 8 };
+  static T load( const float * p ) { return _mm256_loadu_ps( p ); }
+  static void store( float * p, T v ) { _mm256_storeu_ps( p, v ); }
+  static T set1( float f ) { return _mm256_set1_ps( f ); }
+  static T add( T a, T b ) { return _mm256_add_ps( a, b ); }
+  static T sub( T a, T b ) { return _mm256_sub_ps( a, b ); }
+  static T mul( T a, T b ) { return _mm256_mul_ps( a, b ); }
+  static T div( T a, T b ) { return _mm256_div_ps( a, b ); }
+  static T sqrt( T a ) { return _mm256_sqrt_ps( a ); }
+  static T neg( T a ) { return _mm256_xor_ps( a, _mm256_set1_ps( -0.0f ) ); }
+  static M le( T a, T b ) { return _mm256_cmp_ps( a, b, _CMP_LE_OQ ); }
+  static M ge( T a, T b ) { return _mm256_cmp_ps( a, b, _CMP_GE_OQ ); }
+  static M eq( T a, T b ) { return _mm256_cmp_ps( a, b, _CMP_EQ_OQ ); }
+  static M andnot( M a, M b ) { return _mm256_andnot_ps( b, a ); }
+  static T select( M m, T a, T b ) { return _mm256_blendv_ps( b, a, m ); }
+};
+
+}
+
+bool vectorBatchAvx2Table( VectorBatchTable * t ){
+  *t = makeVectorBatchTable<Avx2Lanes>();
+  return true;
+}
+
+#else
+
+bool vectorBatchAvx2Table( VectorBatchTable * t ){
+  return false;
+}
+
+#endif
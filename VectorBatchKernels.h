@@ -0,0 +1,198 @@
+#ifndef _VECTOR_BATCH_KERNELS_H_
+#define _VECTOR_BATCH_KERNELS_H_
+
+/* Kernel bodies shared by every VectorBatch implementation. Each kernel is
+ * written once against a lane type L that provides W-wide operations:
+ *
+ *   L::T, L::M          value and comparison-mask types
+ *   load store set1     memory and broadcast
+ *   add sub mul div sqrt neg
+ *   le ge eq            ordered compares (false on NaN, as in C)
+ *   andnot( a, b )      a && !b on masks
+ *   select( m, a, b )   m ? a : b per lane
+ *
+ * Each source file that includes this header instantiates the kernels with
+ * its own lane types, compiled for its own instruction set. Only the
+ * operations listed above are used, in the order vector.cpp uses them, so
+ * every lane width produces the scalar helpers' results bit for bit.
+ *
+ * Apart from the table type, everything here sits in an anonymous namespace
+ * and the header includes nothing: the AVX2 file is compiled with -mavx2, and
+ * none of the code it generates may be picked up by the rest of the program.
+ */
+
+/* one implementation of every kernel */
+struct VectorBatchTable {
+  void (*len)( const float *, const float *, float *, int );
+  void (*normalize)( const float *, const float *, float *, float *, int );
+  void (*dot)( const float *, const float *, const float *, float *, int );
+  void (*cross)( const float *, const float *, const float *, float *, int );
+  void (*crossAndRecross)( const float *, const float *, const float *,
+			   float *, float *, int );
+  void (*dist)( const float *, const float *, const float *, float *, int );
+  void (*ptToLineDist)( const float *, const float *, const float *, const float *,
+			float, float *, int );
+};
+
+namespace {
+
+//tail elements are finished one at a time
+struct ScalarLanes {
+  typedef float T;
+  typedef bool M;
+  enum { W = 1 };
+  static T load( const float * p ) { return *p; }
+  static void store( float * p, T v ) { *p = v; }
+  static T set1( float f ) { return f; }
+  static T add( T a, T b ) { return a + b; }
+  static T sub( T a, T b ) { return a - b; }
+  static T mul( T a, T b ) { return a * b; }
+  static T div( T a, T b ) { return a / b; }
+  static T sqrt( T a ) { return __builtin_sqrtf( a ); }
+  static T neg( T a ) { return -a; }
+  static M le( T a, T b ) { return a <= b; }
+  static M ge( T a, T b ) { return a >= b; }
+  static M eq( T a, T b ) { return a == b; }
+  static M andnot( M a, M b ) { return a && !b; }
+  static T select( M m, T a, T b ) { return m ? a : b; }
+};
+
+//v2fLen: zero for non-positive squared length
+template < class L >
+inline typename L::T batchLen( typename L::T x, typename L::T y ){
+  typename L::T s = L::add( L::mul( x, x ), L::mul( y, y ) );
+  typename L::T zero = L::set1( 0.0 );
+  return L::select( L::le( s, zero ), zero, L::sqrt( s ) );
+}
+
+template < class L >
+void kernelLen( const float * x, const float * y, float * out, int n ){
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W )
+    L::store( out + i, batchLen<L>( L::load( x + i ), L::load( y + i ) ) );
+  if( L::W > 1 && i < n )
+    kernelLen<ScalarLanes>( x + i, y + i, out + i, n - i );
+}
+
+template < class L >
+void kernelNormalize( const float * x, const float * y,
+		      float * rx, float * ry, int n ){
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W ){
+    typename L::T vx = L::load( x + i );
+    typename L::T vy = L::load( y + i );
+    typename L::T len = batchLen<L>( vx, vy );
+    typename L::M keep = L::eq( len, L::set1( 0.0 ) );
+    L::store( rx + i, L::select( keep, vx, L::div( vx, len ) ) );
+    L::store( ry + i, L::select( keep, vy, L::div( vy, len ) ) );
+  }
+  if( L::W > 1 && i < n )
+    kernelNormalize<ScalarLanes>( x + i, y + i, rx + i, ry + i, n - i );
+}
+
+template < class L >
+void kernelDot( const float * x, const float * y, const float * v,
+		float * out, int n ){
+  typename L::T v0 = L::set1( v[0] );
+  typename L::T v1 = L::set1( v[1] );
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W )
+    L::store( out + i, L::add( L::mul( v0, L::load( x + i ) ),
+			       L::mul( v1, L::load( y + i ) ) ) );
+  if( L::W > 1 && i < n )
+    kernelDot<ScalarLanes>( x + i, y + i, v, out + i, n - i );
+}
+
+template < class L >
+void kernelCross( const float * x, const float * y, const float * v,
+		  float * out, int n ){
+  typename L::T v0 = L::set1( v[0] );
+  typename L::T v1 = L::set1( v[1] );
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W )
+    L::store( out + i, L::sub( L::mul( L::load( x + i ), v1 ),
+			       L::mul( L::load( y + i ), v0 ) ) );
+  if( L::W > 1 && i < n )
+    kernelCross<ScalarLanes>( x + i, y + i, v, out + i, n - i );
+}
+
+template < class L >
+void kernelCrossAndRecross( const float * x, const float * y, const float * v,
+			    float * rx, float * ry, int n ){
+  typename L::T v0 = L::set1( v[0] );
+  typename L::T v1 = L::set1( v[1] );
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W ){
+    typename L::T px = L::load( x + i );
+    typename L::T py = L::load( y + i );
+    typename L::T c = L::sub( L::mul( px, v1 ), L::mul( py, v0 ) );
+    L::store( rx + i, L::mul( L::neg( c ), py ) );
+    L::store( ry + i, L::mul( c, px ) );
+  }
+  if( L::W > 1 && i < n )
+    kernelCrossAndRecross<ScalarLanes>( x + i, y + i, v, rx + i, ry + i, n - i );
+}
+
+template < class L >
+void kernelDist( const float * x, const float * y, const float * from,
+		 float * out, int n ){
+  typename L::T f0 = L::set1( from[0] );
+  typename L::T f1 = L::set1( from[1] );
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W )
+    L::store( out + i, batchLen<L>( L::sub( f0, L::load( x + i ) ),
+				    L::sub( f1, L::load( y + i ) ) ) );
+  if( L::W > 1 && i < n )
+    kernelDist<ScalarLanes>( x + i, y + i, from, out + i, n - i );
+}
+
+//dir must already be normalized
+template < class L >
+void kernelPtToLineDist( const float * x, const float * y,
+			 const float * start, const float * dir, float len,
+			 float * out, int n ){
+  typename L::T s0 = L::set1( start[0] );
+  typename L::T s1 = L::set1( start[1] );
+  typename L::T d0 = L::set1( dir[0] );
+  typename L::T d1 = L::set1( dir[1] );
+  typename L::T vlen = L::set1( len );
+  typename L::T zero = L::set1( 0.0 );
+  int i = 0;
+  for( ; i + L::W <= n; i += L::W ){
+    typename L::T px = L::load( x + i );
+    typename L::T py = L::load( y + i );
+    typename L::T diff0 = L::sub( px, s0 );
+    typename L::T diff1 = L::sub( py, s1 );
+    typename L::T t = L::add( L::mul( d0, diff0 ), L::mul( d1, diff1 ) );
+
+    //past the end: measure from start + dir*len; before the start: from
+    //start itself; otherwise from the foot of the perpendicular
+    typename L::M pastEnd = L::ge( t, vlen );
+    typename L::M beforeStart = L::andnot( L::le( t, zero ), pastEnd );
+    typename L::T along = L::select( pastEnd, vlen, t );
+    typename L::T e0 = L::sub( px, L::add( s0, L::mul( d0, along ) ) );
+    typename L::T e1 = L::sub( py, L::add( s1, L::mul( d1, along ) ) );
+    e0 = L::select( beforeStart, diff0, e0 );
+    e1 = L::select( beforeStart, diff1, e1 );
+    L::store( out + i, batchLen<L>( e0, e1 ) );
+  }
+  if( L::W > 1 && i < n )
+    kernelPtToLineDist<ScalarLanes>( x + i, y + i, start, dir, len, out + i, n - i );
+}
+
+template < class L >
+VectorBatchTable makeVectorBatchTable(){
+  VectorBatchTable t;
+  t.len = kernelLen<L>;
+  t.normalize = kernelNormalize<L>;
+  t.dot = kernelDot<L>;
+  t.cross = kernelCross<L>;
+  t.crossAndRecross = kernelCrossAndRecross<L>;
+  t.dist = kernelDist<L>;
+  t.ptToLineDist = kernelPtToLineDist<L>;
+  return t;
+}
+
+}
+
+#endif
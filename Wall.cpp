@@ -117,6 +117,11 @@ void Wall::getDirection( v2f pos, v2f res ){
   return;
 }
 
+bool Wall::isReverseOf( Wall * w ){
+  return start[0] == w->end[0] && start[1] == w->end[1] &&
+    end[0] == w->start[0] && end[1] == w->start[1];
+}
+
 int Wall::getType(){
   return myType;
 }
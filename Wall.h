@@ -23,6 +23,9 @@ class Wall : public CrowdObject {
   void getStart( v2f r) {v2fCopy(start, r);}
   void getEnd( v2f r) {v2fCopy(end, r);}
 
+  //true if w is this wall's back-to-back partner (same segment, reversed)
+  bool isReverseOf( Wall * w );
+
 
   //each wall will be represented as two back-to-back walls. 
 
@@ -0,0 +1,117 @@
+#include "WallBVH.h"
+#include "Wall.h"
+#include <algorithm>
+
+//segments per leaf before we stop splitting
+#define BVH_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 64
+
+WallBVH::WallBVH(){
+}
+
+void WallBVH::build( const std::vector<CrowdObject *> & objects ){
+  segments.clear();
+  nodes.clear();
+
+  for( size_t i = 0; i < objects.size(); i++ ){
+    if( objects[i]->getType() != WALL )
+      continue;
+    Wall * w = static_cast<Wall *>( objects[i] );
+
+    Segment s;
+    v2f st, en;
+    w->getStart( st );
+    w->getEnd( en );
+    s.lo[0] = fminf( st[0], en[0] );
+    s.lo[1] = fminf( st[1], en[1] );
+    s.hi[0] = fmaxf( st[0], en[0] );
+    s.hi[1] = fmaxf( st[1], en[1] );
+    s.center[0] = 0.5 * (st[0] + en[0]);
+    s.center[1] = 0.5 * (st[1] + en[1]);
+    s.face[0] = i;
+    s.face[1] = -1;
+
+    //createNewObject pushes the two faces of a wall next to each other
+    if( i + 1 < objects.size() && objects[i + 1]->getType() == WALL &&
+	w->isReverseOf( static_cast<Wall *>( objects[i + 1] ) ) ){
+      s.face[1] = i + 1;
+      i++;
+    }
+    segments.push_back( s );
+  }
+
+  if( !segments.empty() ){
+    nodes.reserve( 2 * segments.size() );
+    buildNode( 0, segments.size() );
+  }
+}
+
+int WallBVH::buildNode( int first, int count ){
+  int id = nodes.size();
+  nodes.push_back( Node() );
+
+  Node n;
+  n.left = n.right = -1;
+  n.first = first;
+  n.count = count;
+  n.lo[0] = n.lo[1] = INFINITY;
+  n.hi[0] = n.hi[1] = -INFINITY;
+  float clo[2] = { INFINITY, INFINITY };
+  float chi[2] = { -INFINITY, -INFINITY };
+  for( int i = first; i < first + count; i++ ){
+    const Segment & s = segments[i];
+    for( int k = 0; k < 2; k++ ){
+      n.lo[k] = fminf( n.lo[k], s.lo[k] );
+      n.hi[k] = fmaxf( n.hi[k], s.hi[k] );
+      clo[k] = fminf( clo[k], s.center[k] );
+      chi[k] = fmaxf( chi[k], s.center[k] );
+    }
+  }
+
+  if( count > BVH_LEAF_SIZE ){
+    //median split along the wider axis of the segment centers
+    int axis = ( chi[0] - clo[0] >= chi[1] - clo[1] ) ? 0 : 1;
+    int half = count / 2;
+    std::nth_element( segments.begin() + first,
+		      segments.begin() + first + half,
+		      segments.begin() + first + count,
+		      [axis]( const Segment & a, const Segment & b ){
+			return a.center[axis] < b.center[axis];
+		      } );
+    n.left = buildNode( first, half );
+    n.right = buildNode( first + half, count - half );
+    n.count = 0;
+  }
+
+  nodes[id] = n;
+  return id;
+}
+
+void WallBVH::query( v2f lo, v2f hi, std::vector<int> & result ) const {
+  if( nodes.empty() )
+    return;
+
+  int stack[BVH_MAX_DEPTH];
+  int top = 0;
+  stack[top++] = 0;
+  while( top > 0 ){
+    const Node & n = nodes[ stack[--top] ];
+    if( n.lo[0] > hi[0] || n.hi[0] < lo[0] || n.lo[1] > hi[1] || n.hi[1] < lo[1] )
+      continue;
+
+    if( n.left < 0 ){
+      for( int i = n.first; i < n.first + n.count; i++ ){
+	const Segment & s = segments[i];
+	if( s.lo[0] > hi[0] || s.hi[0] < lo[0] || s.lo[1] > hi[1] || s.hi[1] < lo[1] )
+	  continue;
+	result.push_back( s.face[0] );
+	if( s.face[1] >= 0 )
+	  result.push_back( s.face[1] );
+      }
+      continue;
+    }
+
+    stack[top++] = n.left;
+    stack[top++] = n.right;
+  }
+}
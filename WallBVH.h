@@ -0,0 +1,51 @@
+#ifndef _WALL_BVH_H_
+#define _WALL_BVH_H_
+
+#include "constants.h"
+#include "CrowdObject.h"
+#include <vector>
+
+/* WallBVH is a static bounding-volume hierarchy over the walls in a world.
+ * Walls never move, so it is built once and only queried afterwards.
+ *
+ * CrowdWorld stores every wall as two back-to-back Wall objects. The tree
+ * keeps one leaf entry per physical segment which remembers the objectList
+ * index of both faces, so a query touching a segment reports both of them.
+ */
+class WallBVH {
+ private:
+  struct Segment {
+    float lo[2], hi[2];
+    float center[2];
+    //objectList indices of the faces of this segment, face[1] is -1 for a
+    //wall without a back-to-back partner
+    int face[2];
+  };
+
+  struct Node {
+    float lo[2], hi[2];
+    //children for inner nodes, -1 for leaves
+    int left, right;
+    //leaves cover segments[ first .. first + count )
+    int first, count;
+  };
+
+  std::vector<Segment> segments;
+  std::vector<Node> nodes;
+
+  int buildNode( int first, int count );
+
+ public:
+  WallBVH();
+
+  //indexes every WALL in objects, pairing consecutive back-to-back walls
+  void build( const std::vector<CrowdObject *> & objects );
+
+  int getNumSegments() const { return segments.size(); }
+
+  //appends the objectList index of every wall face whose bounds overlap the
+  //box [lo, hi]. Each face is appended at most once per call
+  void query( v2f lo, v2f hi, std::vector<int> & result ) const;
+};
+
+#endif
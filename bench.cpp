@@ -0,0 +1,479 @@
+// Benchmarks for the simulation hot paths.
+//
+// Microbenchmarks time the vector kernels, Wall::getDirection,
+// Agent::calculateForces and ORCAAgent::calculateORCAVelocity in isolation.
+// Macrobenchmarks step whole headless worlds of 100 to 100k agents in social
+// force and ORCA mode. Results are written as JSON so runs of different
+// builds can be compared.
+//
+//   make bench
+//   ./crowdbench [--quick] [--threads n] [--max-agents n] [--min-time s]
+//                [--filter text] [--out file]
+
+#include "Agent.h"
+#include "ORCAAgent.h"
+#include "Wall.h"
+#include "EnhancedCrowdWorld.h"
+#include "KdTree.h"
+#include "VectorBatch.h"
+#include <json/value.h>
+#include <json/writer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Every allocation through operator new is counted so the macrobenchmarks can
+// report allocations per step
+static std::atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    int threads = 1;
+    int maxAgents = 100000;
+    double minTime = 0.5;
+    std::string filter;
+    std::string out;
+};
+
+Options options;
+
+bool selected(const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+double seconds(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double>(b - a).count();
+}
+
+// Keeps results alive so the optimizer cannot drop the benchmarked work
+volatile float sink;
+
+// Runs op (which performs opsPerCall operations) until minTime has passed,
+// and returns nanoseconds per operation
+template <class F>
+double timeOp(F op, int opsPerCall) {
+    op();
+    long calls = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    long batch = 1;
+    while (elapsed < options.minTime) {
+        for (long i = 0; i < batch; ++i) {
+            op();
+        }
+        calls += batch;
+        batch *= 2;
+        elapsed = seconds(start, Clock::now());
+    }
+    return elapsed * 1e9 / ((double)calls * opsPerCall);
+}
+
+void addMicro(Json::Value& results, const std::string& name, double nsPerOp) {
+    Json::Value r;
+    r["name"] = name;
+    r["ns_per_op"] = nsPerOp;
+    results.append(r);
+    std::cerr << "  " << name << ": " << nsPerOp << " ns/op" << std::endl;
+}
+
+// Scene with n social-force agents and n/10 short walls scattered over a
+// square sized to keep the density constant
+Json::Value socialScene(int n, unsigned seed) {
+    std::mt19937 rng(seed);
+    float half = std::max(20.0f, std::sqrt((float)n) * 1.2f);
+    std::uniform_real_distribution<float> coord(-half, half);
+    std::uniform_real_distribution<float> offset(-4.0f, 4.0f);
+
+    Json::Value scene;
+    scene["headless"] = true;
+    scene["threads"] = options.threads;
+    scene["timeslice"] = 0.5;
+    for (int i = 0; i < n; ++i) {
+        Json::Value a;
+        a["attractor"]["type"] = "attractor";
+        a["attractor"]["pos"].append(coord(rng));
+        a["attractor"]["pos"].append(coord(rng));
+        a["atWeight"] = 0.5;
+        a["waWeight"] = 0.6;
+        a["obWeight"] = 0.5;
+        a["agWeight"] = 0.3;
+        a["accel"] = 0.2;
+        a["maxVel"] = 0.5;
+        a["visDist"] = 3.0;
+        a["visWid"] = 2.0;
+        a["pspace"] = 0.1;
+        a["radius"] = (i % 2) ? 0.3 : 0.5;
+        a["mesh"] = "blue.mesh";
+        a["pos"].append(coord(rng));
+        a["pos"].append(coord(rng));
+        scene["agents"].append(a);
+    }
+    for (int i = 0; i < n / 10; ++i) {
+        float x = coord(rng), y = coord(rng);
+        Json::Value w;
+        w["type"] = "wall";
+        w["start"].append(x);
+        w["start"].append(y);
+        w["end"].append(x + offset(rng));
+        w["end"].append(y + offset(rng));
+        scene["objects"].append(w);
+    }
+    return scene;
+}
+
+// The same layout for ORCA agents; the walls become ORCA obstacles
+Json::Value orcaScene(int n, unsigned seed) {
+    Json::Value scene = socialScene(n, seed);
+    scene["simulation"]["mode"] = "orca";
+    scene["timeslice"] = 0.25;
+    for (Json::Value& a : scene["agents"]) {
+        a["maxVel"] = 1.2;
+        a["neighborDist"] = 5.0;
+        a["maxNeighbors"] = 10;
+        a["timeHorizon"] = 2.0;
+        a["timeHorizonObst"] = 2.0;
+    }
+    scene["walls"] = scene["objects"];
+    scene["objects"] = Json::Value(Json::arrayValue);
+    return scene;
+}
+
+// Gives the benchmarks the world's agents
+class BenchWorld : public CrowdWorld {
+public:
+    BenchWorld(const Json::Value& scene) : CrowdWorld(scene) {}
+    std::vector<Agent*>& agents() { return agentList; }
+};
+
+void vectorMicros(Json::Value& results) {
+    const int n = 4096;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+    std::vector<float> x(n), y(n), rx(n), ry(n), out(n);
+    for (int i = 0; i < n; ++i) {
+        x[i] = coord(rng);
+        y[i] = coord(rng);
+    }
+    v2f start = {-1.0f, 2.0f}, dir = {0.6f, 0.8f}, v = {0.3f, -0.7f};
+
+    if (selected("v2fLen")) {
+        addMicro(results, "v2fLen", timeOp([&]() {
+            float s = 0;
+            for (int i = 0; i < n; ++i) {
+                v2f p = {x[i], y[i]};
+                s += v2fLen(p);
+            }
+            sink = s;
+        }, n));
+    }
+    if (selected("v2fNormalize")) {
+        addMicro(results, "v2fNormalize", timeOp([&]() {
+            for (int i = 0; i < n; ++i) {
+                v2f p = {x[i], y[i]}, r;
+                v2fNormalize(p, r);
+                rx[i] = r[0];
+                ry[i] = r[1];
+            }
+        }, n));
+    }
+    if (selected("v2fDot")) {
+        addMicro(results, "v2fDot", timeOp([&]() {
+            float s = 0;
+            for (int i = 0; i < n; ++i) {
+                v2f p = {x[i], y[i]};
+                s += v2fDot(v, p);
+            }
+            sink = s;
+        }, n));
+    }
+    if (selected("ptToLineDist")) {
+        addMicro(results, "ptToLineDist", timeOp([&]() {
+            float s = 0;
+            for (int i = 0; i < n; ++i) {
+                v2f p = {x[i], y[i]}, d = {dir[0], dir[1]};
+                s += ptToLineDist(p, start, d, 5.0f);
+            }
+            sink = s;
+        }, n));
+    }
+
+    // The batched kernels on every instruction set this CPU has
+    VectorIsa best = v2fBatchIsa();
+    for (int level = VECTOR_SCALAR; level <= best; ++level) {
+        VectorIsa isa = v2fBatchUseIsa((VectorIsa)level);
+        if (isa != level) {
+            continue;
+        }
+        std::string suffix = std::string("/") + v2fBatchIsaName(isa);
+        if (selected("v2fBatchLen" + suffix)) {
+            addMicro(results, "v2fBatchLen" + suffix, timeOp([&]() {
+                v2fBatchLen(x.data(), y.data(), out.data(), n);
+            }, n));
+        }
+        if (selected("v2fBatchNormalize" + suffix)) {
+            addMicro(results, "v2fBatchNormalize" + suffix, timeOp([&]() {
+                v2fBatchNormalize(x.data(), y.data(), rx.data(), ry.data(), n);
+            }, n));
+        }
+        if (selected("v2fBatchCrossAndRecross" + suffix)) {
+            addMicro(results, "v2fBatchCrossAndRecross" + suffix, timeOp([&]() {
+                v2fBatchCrossAndRecross(x.data(), y.data(), v, rx.data(), ry.data(), n);
+            }, n));
+        }
+        if (selected("v2fBatchPtToLineDist" + suffix)) {
+            addMicro(results, "v2fBatchPtToLineDist" + suffix, timeOp([&]() {
+                v2fBatchPtToLineDist(x.data(), y.data(), start, dir, 5.0f, out.data(), n);
+            }, n));
+        }
+    }
+    v2fBatchUseIsa(best);
+}
+
+void wallMicro(Json::Value& results) {
+    if (!selected("Wall::getDirection")) {
+        return;
+    }
+    const int walls = 256, points = 64;
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+    std::vector<Wall> w;
+    for (int i = 0; i < walls; ++i) {
+        v2f s = {coord(rng), coord(rng)}, e = {coord(rng), coord(rng)};
+        w.push_back(Wall(s, e));
+    }
+    std::vector<float> px(points), py(points);
+    for (int i = 0; i < points; ++i) {
+        px[i] = coord(rng);
+        py[i] = coord(rng);
+    }
+    addMicro(results, "Wall::getDirection", timeOp([&]() {
+        float s = 0;
+        for (int i = 0; i < walls; ++i) {
+            for (int j = 0; j < points; ++j) {
+                v2f p = {px[j], py[j]}, r;
+                w[i].getDirection(p, r);
+                s += r[0];
+            }
+        }
+        sink = s;
+    }, walls * points));
+}
+
+void forceMicro(Json::Value& results) {
+    if (!selected("Agent::calculateForces")) {
+        return;
+    }
+    // One step in, so agents are moving and have neighbours to react to
+    BenchWorld world(socialScene(1000, 3));
+    world.updateAgents();
+    world.calcForces();
+    world.stepWorld(0.5);
+    world.updateAgents();
+    std::vector<Agent*>& agents = world.agents();
+    addMicro(results, "Agent::calculateForces", timeOp([&]() {
+        for (Agent* a : agents) {
+            a->calculateForces();
+        }
+    }, agents.size()));
+}
+
+void orcaMicro(Json::Value& results) {
+    if (!selected("ORCAAgent::calculateORCAVelocity")) {
+        return;
+    }
+    Json::Value scene = orcaScene(1000, 4);
+    AgentStore store;
+    std::vector<ORCAAgent*> agents;
+    std::vector<Agent*> all;
+    for (const Json::Value& a : scene["agents"]) {
+        ORCAAgent* o = new ORCAAgent(a, &store);
+        o->updatePrefVelocity();
+        agents.push_back(o);
+        all.push_back(o);
+    }
+    AgentKdTree tree;
+    tree.build(all);
+    ObstacleKdTree obstacles;
+    for (const Json::Value& w : scene["walls"]) {
+        std::vector<std::pair<float, float> > vertices;
+        vertices.push_back(std::make_pair(w["start"][0u].asFloat(), w["start"][1u].asFloat()));
+        vertices.push_back(std::make_pair(w["end"][0u].asFloat(), w["end"][1u].asFloat()));
+        obstacles.addObstacle(vertices);
+    }
+    obstacles.build();
+
+    addMicro(results, "ORCAAgent::calculateORCAVelocity", timeOp([&]() {
+        for (ORCAAgent* a : agents) {
+            a->calculateORCAVelocity(tree, obstacles, 0.25f);
+        }
+    }, agents.size()));
+
+    for (ORCAAgent* a : agents) {
+        delete a;
+    }
+}
+
+struct StepStats {
+    int steps;
+    double seconds;
+    unsigned long allocations;
+};
+
+// Steps a world (after one warm-up step) until minTime has passed, at least
+// three times
+template <class World, class Step>
+StepStats runSteps(World& world, Step step) {
+    step(world);
+    StepStats s;
+    s.steps = 0;
+    unsigned long before = allocations.load();
+    Clock::time_point start = Clock::now();
+    do {
+        step(world);
+        s.steps++;
+        s.seconds = seconds(start, Clock::now());
+    } while (s.seconds < options.minTime || s.steps < 3);
+    s.allocations = allocations.load() - before;
+    return s;
+}
+
+void addMacro(Json::Value& results, const std::string& mode, int agents, const StepStats& s) {
+    Json::Value r;
+    r["name"] = mode + "/" + std::to_string(agents);
+    r["mode"] = mode;
+    r["agents"] = agents;
+    r["threads"] = options.threads;
+    r["steps"] = s.steps;
+    r["steps_per_sec"] = s.steps / s.seconds;
+    r["ns_per_agent_step"] = s.seconds * 1e9 / ((double)s.steps * agents);
+    r["allocs_per_step"] = (double)s.allocations / s.steps;
+    results.append(r);
+    std::cerr << "  " << r["name"].asString() << ": " << r["steps_per_sec"].asDouble()
+              << " steps/s, " << r["ns_per_agent_step"].asDouble() << " ns/agent-step, "
+              << r["allocs_per_step"].asDouble() << " allocs/step" << std::endl;
+}
+
+void macros(Json::Value& results) {
+    const int sizes[] = {100, 1000, 10000, 100000};
+    for (int n : sizes) {
+        if (n > options.maxAgents) {
+            continue;
+        }
+        std::string name = "social/" + std::to_string(n);
+        if (selected(name)) {
+            BenchWorld world(socialScene(n, 5));
+            addMacro(results, "social", n, runSteps(world, [](BenchWorld& w) {
+                w.updateAgents();
+                w.calcForces();
+                w.stepWorld(0.5);
+            }));
+        }
+        name = "orca/" + std::to_string(n);
+        if (selected(name)) {
+            EnhancedCrowdWorld world(orcaScene(n, 6));
+            world.play();
+            addMacro(results, "orca", n, runSteps(world, [](EnhancedCrowdWorld& w) {
+                w.step(0.25);
+            }));
+        }
+    }
+}
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+              << "  --quick          up to 10k agents, shorter runs" << std::endl
+              << "  --threads <n>    threads for the world steps (default 1, 0 = all cores)" << std::endl
+              << "  --max-agents <n> skip larger macrobenchmarks" << std::endl
+              << "  --min-time <s>   minimum time per measurement (default 0.5)" << std::endl
+              << "  --filter <text>  only run benchmarks whose name contains text" << std::endl
+              << "  --out <file>     write the JSON there instead of stdout" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") {
+            options.maxAgents = std::min(options.maxAgents, 10000);
+            options.minTime = 0.2;
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (arg == "--max-agents" && hasValue) {
+            options.maxAgents = atoi(argv[++i]);
+        } else if (arg == "--min-time" && hasValue) {
+            options.minTime = atof(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    Json::Value report;
+    report["build"]["compiler"] = __VERSION__;
+    report["build"]["vector_isa"] = v2fBatchIsaName(v2fBatchIsa());
+    report["build"]["threads"] = options.threads;
+    report["build"]["min_time"] = options.minTime;
+    report["micro"] = Json::Value(Json::arrayValue);
+    report["macro"] = Json::Value(Json::arrayValue);
+
+    std::cerr << "micro:" << std::endl;
+    vectorMicros(report["micro"]);
+    wallMicro(report["micro"]);
+    forceMicro(report["micro"]);
+    orcaMicro(report["micro"]);
+    std::cerr << "macro:" << std::endl;
+    macros(report["macro"]);
+
+    Json::StyledWriter writer;
+    if (options.out.empty()) {
+        std::cout << writer.write(report);
+    } else {
+        std::ofstream out(options.out.c_str());
+        out << writer.write(report);
+    }
+    return 0;
+}
@@ -4,7 +4,13 @@
 #include "Wall.h"
 #include "EnhancedCrowdWorld.h"
 #include "DatasetLoader.h"
+#include "RolloutHarness.h"
+#include "TaskScheduler.h"
+#include "Profiler.h"
+#include "Log.h"
+#ifndef HEADLESS
 #include "Render.h"
+#endif
 #include <stdlib.h>
 #include <fstream>
 #include <iostream>
@@ -23,6 +29,19 @@ void printUsage(const char* programName);
 void runOriginalSimulation(const Json::Value& data);
 void runORCASimulation(const Json::Value& data);
 void runDatasetPlayback(const Json::Value& data);
+void runRollouts(const Json::Value& data);
+bool isHeadless(const Json::Value& data);
+std::string trajectoryFile(const Json::Value& data);
+std::string formatOf(const std::string& filename);
+bool beginRecording(CrowdWorld& world, const Json::Value& data);
+void endRecording(CrowdWorld& world, const Json::Value& data);
+int restoreRun(CrowdWorld& world, const Json::Value& data, double& time);
+void checkpointStep(CrowdWorld& world, const Json::Value& data, int step, double time);
+void endCheckpoints(CrowdWorld& world, const Json::Value& data, int start, int end);
+void dumpProfile();
+
+// Where dumpProfile writes the Chrome trace
+static std::string traceFile = "trace.json";
 
 int mysleep(unsigned long millis) {
     struct timespec req = {0};
@@ -63,15 +82,28 @@ Json::Value readJsonFromFile(const char* file) {
 void printUsage(const char* programName) {
     std::cout << "Usage: " << programName << " [options] <config_file>" << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  --mode <mode>     Simulation mode: original, orca, dataset" << std::endl;
+    std::cout << "  --mode <mode>     Simulation mode: original, orca, dataset, rollout" << std::endl;
     std::cout << "  --dataset <file>  ETH/UCY dataset file for dataset mode" << std::endl;
-    std::cout << "  --format <fmt>    Dataset format: eth, ucy, trajnet (default: eth)" << std::endl;
+    std::cout << "  --format <fmt>    Dataset format: eth, ucy, trajnet, binary (default: eth)" << std::endl;
+    std::cout << "  --stream          Play an eth/ucy dataset through a window instead of loading it" << std::endl;
+    std::cout << "  --ground-truth <file> Score the dataset against this one (ADE, FDE, collisions)" << std::endl;
+    std::cout << "  --ground-truth-format <fmt> Format of the ground truth (default: binary for .traj, else eth)" << std::endl;
+    std::cout << "  --threads <n>     Worker threads for a step, 0 for all cores (default: 1)" << std::endl;
+    std::cout << "  --headless        No window and no frame delay; write trajectories to a file" << std::endl;
+    std::cout << "  --output <file>   Record agent positions to a file; headless runs always do (default: trajectories.txt)" << std::endl;
+    std::cout << "  --record-every <n> Record every nth step (default: 1)" << std::endl;
+    std::cout << "  --checkpoint <file> Snapshot the world every --checkpoint-every steps (default: checkpoint.snap)" << std::endl;
+    std::cout << "  --checkpoint-every <n> Steps between snapshots; turns snapshots on" << std::endl;
+    std::cout << "  --restore <file>  Resume from a snapshot of a run of the same scene" << std::endl;
+    std::cout << "  --trace <file>    Chrome trace of a PROFILE=1 build (default: trace.json)" << std::endl;
+    std::cout << "  --counters        Hardware counters per phase in a PROFILE=1 build (Linux)" << std::endl;
     std::cout << "  --help            Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  " << programName << " data/test.json                    # Original simulation" << std::endl;
     std::cout << "  " << programName << " --mode orca data/orca_demo.json  # ORCA simulation" << std::endl;
     std::cout << "  " << programName << " --mode dataset --dataset data/sample_eth.txt data/dataset_config.json" << std::endl;
+    std::cout << "  " << programName << " --mode rollout --threads 0 --dataset data/sample_eth.txt data/dataset_config.json  # 8/12 prediction benchmark" << std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -80,6 +112,17 @@ int main(int argc, char** argv) {
     std::string configFile;
     std::string datasetFile;
     std::string datasetFormat = "eth";
+    bool stream = false;
+    std::string groundTruthFile;
+    std::string groundTruthFormat;
+    int threads = -1;
+    bool headless = false;
+    bool counters = false;
+    std::string outputFile;
+    int recordEvery = 0;
+    std::string checkpointFile;
+    int checkpointEvery = 0;
+    std::string restoreFile;
     
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -108,6 +151,75 @@ int main(int argc, char** argv) {
                 std::cerr << "Error: --format requires an argument" << std::endl;
                 return 1;
             }
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--ground-truth") {
+            if (i + 1 < argc) {
+                groundTruthFile = argv[++i];
+            } else {
+                std::cerr << "Error: --ground-truth requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--ground-truth-format") {
+            if (i + 1 < argc) {
+                groundTruthFormat = argv[++i];
+            } else {
+                std::cerr << "Error: --ground-truth-format requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads") {
+            if (i + 1 < argc) {
+                threads = atoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --threads requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--counters") {
+            counters = true;
+        } else if (arg == "--output") {
+            if (i + 1 < argc) {
+                outputFile = argv[++i];
+            } else {
+                std::cerr << "Error: --output requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--record-every") {
+            if (i + 1 < argc) {
+                recordEvery = atoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --record-every requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--checkpoint") {
+            if (i + 1 < argc) {
+                checkpointFile = argv[++i];
+            } else {
+                std::cerr << "Error: --checkpoint requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--checkpoint-every") {
+            if (i + 1 < argc) {
+                checkpointEvery = atoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --checkpoint-every requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--restore") {
+            if (i + 1 < argc) {
+                restoreFile = argv[++i];
+            } else {
+                std::cerr << "Error: --restore requires an argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace") {
+            if (i + 1 < argc) {
+                traceFile = argv[++i];
+            } else {
+                std::cerr << "Error: --trace requires an argument" << std::endl;
+                return 1;
+            }
         } else if (arg[0] != '-') {
             configFile = arg;
         } else {
@@ -125,17 +237,57 @@ int main(int argc, char** argv) {
     // Load configuration
     Json::Value data = readJsonFromFile(configFile.c_str());
     std::srand(0);
+    if (threads >= 0) {
+        data["threads"] = threads;
+    }
+#ifdef HEADLESS
+    // Built without OGRE: there is nothing to render to
+    headless = true;
+#endif
+    if (headless) {
+        data["headless"] = true;
+    }
+    if (!outputFile.empty()) {
+        data["output"] = outputFile;
+    }
+    if (recordEvery > 0) {
+        data["recordEvery"] = recordEvery;
+    }
+    if (!checkpointFile.empty()) {
+        data["checkpoint"] = checkpointFile;
+    }
+    if (checkpointEvery > 0) {
+        data["checkpointEvery"] = checkpointEvery;
+    }
+    if (!restoreFile.empty()) {
+        data["restore"] = restoreFile;
+    }
     
+    if (profilerEnabled()) {
+        atexit(dumpProfile);
+    }
+    // Before any world exists, so the scheduler's threads are counted too
+    if (counters) {
+        if (!profilerEnabled()) {
+            std::cerr << "Warning: --counters needs a PROFILE=1 build, ignored" << std::endl;
+        } else if (!perfCountersStart()) {
+            std::cerr << "Warning: hardware counters unavailable, timings only: "
+                      << perfCountersError() << std::endl;
+        }
+    }
+
     // Run simulation based on mode
     std::cout << "Running simulation in " << mode << " mode..." << std::endl;
     
     if (mode == "original") {
         runOriginalSimulation(data);
     } else if (mode == "orca") {
+        // Make the world build ORCA agents even if the config names no mode
+        data["simulation"]["mode"] = "orca";
         runORCASimulation(data);
-    } else if (mode == "dataset") {
+    } else if (mode == "dataset" || mode == "rollout") {
         if (datasetFile.empty()) {
-            std::cerr << "Error: dataset mode requires --dataset argument" << std::endl;
+            std::cerr << "Error: " << mode << " mode requires --dataset argument" << std::endl;
             return 1;
         }
         // Override dataset configuration
@@ -144,42 +296,183 @@ int main(int argc, char** argv) {
         }
         data["simulation"]["dataset"]["filename"] = datasetFile;
         data["simulation"]["dataset"]["format"] = datasetFormat;
-        runDatasetPlayback(data);
+        if (stream) {
+            data["simulation"]["dataset"]["stream"] = true;
+        }
+        if (!groundTruthFile.empty()) {
+            data["analysis"]["groundTruthFile"] = groundTruthFile;
+            data["analysis"]["calculateMetrics"] = true;
+        }
+        if (!groundTruthFormat.empty()) {
+            data["analysis"]["groundTruthFormat"] = groundTruthFormat;
+        }
+        if (mode == "rollout") {
+            runRollouts(data);
+        } else {
+            runDatasetPlayback(data);
+        }
     } else {
         std::cerr << "Unknown mode: " << mode << std::endl;
-        std::cerr << "Valid modes: original, orca, dataset" << std::endl;
+        std::cerr << "Valid modes: original, orca, dataset, rollout" << std::endl;
         return 1;
     }
     
     return 0;
 }
 
+bool isHeadless(const Json::Value& data) {
+    return data.get("headless", false).asBool();
+}
+
+std::string trajectoryFile(const Json::Value& data) {
+    return data.get("output", "trajectories.txt").asString();
+}
+
+// The format a dataset file is read in when none is given: binary for the
+// native .traj files, the ETH text layout otherwise
+std::string formatOf(const std::string& filename) {
+    const std::string ext = ".traj";
+    if (filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0) {
+        return "binary";
+    }
+    return "eth";
+}
+
+// Headless runs, and any run given an output file, record their trajectories
+bool beginRecording(CrowdWorld& world, const Json::Value& data) {
+    if (!isHeadless(data) && !data.isMember("output")) {
+        return false;
+    }
+    if (!world.startRecording(trajectoryFile(data), data.get("recordEvery", 1).asInt())) {
+        LOG_ERROR("Could not record trajectories: " << world.getRecordingError());
+        return false;
+    }
+    return true;
+}
+
+void endRecording(CrowdWorld& world, const Json::Value& data) {
+    if (world.stopRecording()) {
+        std::cout << "Trajectories written to: " << trajectoryFile(data) << std::endl;
+    } else {
+        LOG_ERROR("Could not write trajectories: " << world.getRecordingError());
+    }
+}
+
+// The step a run starts at: 0, or the one its --restore snapshot was taken
+// after. Exits if the snapshot cannot be used, rather than start over
+int restoreRun(CrowdWorld& world, const Json::Value& data, double& time) {
+    time = 0.0;
+    if (!data.isMember("restore")) {
+        return 0;
+    }
+    std::string file = data["restore"].asString();
+    int64_t step;
+    if (!world.restoreCheckpoint(file, step, time)) {
+        LOG_ERROR("Could not restore: " << world.getCheckpointError());
+        exit(1);
+    }
+    std::cout << "Resuming from " << file << " at step " << step << std::endl;
+    return (int)step;
+}
+
+// With --checkpoint-every n, snapshots the world after every nth step. A
+// failed write is reported once, and stops further snapshots
+void checkpointStep(CrowdWorld& world, const Json::Value& data, int step, double time) {
+    int every = data.get("checkpointEvery", 0).asInt();
+    if (every <= 0 || step % every != 0 || !world.getCheckpointError().empty()) {
+        return;
+    }
+    std::string file = data.get("checkpoint", "checkpoint.snap").asString();
+    if (!world.saveCheckpoint(file, step, time)) {
+        LOG_ERROR("Could not write checkpoint: " << world.getCheckpointError());
+    }
+}
+
+// Waits for the last snapshot of a run over steps [start, end)
+void endCheckpoints(CrowdWorld& world, const Json::Value& data, int start, int end) {
+    int every = data.get("checkpointEvery", 0).asInt();
+    if (every <= 0 || end / every <= start / every) {
+        return;
+    }
+    bool reported = !world.getCheckpointError().empty();
+    if (world.finishCheckpoint()) {
+        std::cout << "Last checkpoint written to: "
+                  << data.get("checkpoint", "checkpoint.snap").asString() << std::endl;
+    } else if (!reported) {
+        LOG_ERROR("Could not write checkpoint: " << world.getCheckpointError());
+    }
+}
+
+// Phase timings of a profiling build, printed and traced at exit
+void dumpProfile() {
+    profilerPrintSummary(std::cout);
+    std::ofstream out(traceFile.c_str());
+    profilerWriteTrace(out);
+    std::cout << "Trace written to: " << traceFile << std::endl;
+}
+
 void runOriginalSimulation(const Json::Value& data) {
     std::cout << "Starting original social force simulation..." << std::endl;
     
     int steps = data["steps"].asInt();
     float deltat = data["timeslice"].asDouble();
     
+    if (isHeadless(data)) {
+        // Step as fast as possible and record every frame instead of drawing it
+        CrowdWorld c(data);
+        double time;
+        int start = restoreRun(c, data, time);
+        bool recording = beginRecording(c, data);
+        for (int i = start; i < steps; i++) {
+            {
+                PROFILE_PHASE("step");
+                c.updateAgents();
+                c.calcForces();
+                c.stepWorld(deltat);
+            }
+            c.recordFrame(i);
+            checkpointStep(c, data, i + 1, (i + 1) * (double)deltat);
+        }
+        if (recording) {
+            endRecording(c, data);
+        }
+        endCheckpoints(c, data, start, steps);
+        return;
+    }
+
+#ifndef HEADLESS
     Agent* a = new Agent(data["agents"][0u]);
     Render* r = Render::getInstance();
-    CrowdObject* cos = twoWalls(data["walls"][0u]);
+    Wall* cos = twoWalls(data["walls"][0u]);
     CrowdWorld c(data);
+    double time;
+    int start = restoreRun(c, data, time);
+    bool recording = beginRecording(c, data);
     
     while (!r->isInitialized()) {
         mysleep(10);
     }
     
-    for (int i = 0; i < steps; i++) {
+    for (int i = start; i < steps; i++) {
         c.updateAgents();
         c.calcForces();
         c.stepWorld(deltat);
+        c.recordFrame(i);
+        checkpointStep(c, data, i + 1, (i + 1) * (double)deltat);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
         c.print();
+#endif
         r->update(deltat);
         mysleep(10);
     }
+    if (recording) {
+        endRecording(c, data);
+    }
+    endCheckpoints(c, data, start, steps);
     
     delete a;
-    delete cos;
+    delete[] cos;
+#endif
 }
 
 void runORCASimulation(const Json::Value& data) {
@@ -198,27 +491,46 @@ void runORCASimulation(const Json::Value& data) {
         world.setORCAParameters(timeHorizon, neighborDist, maxNeighbors);
     }
     
-    Render* r = Render::getInstance();
-    while (!r->isInitialized()) {
-        mysleep(10);
+    double time;
+    int start = restoreRun(world, data, time);
+    world.setCurrentTime(time);
+    bool recording = beginRecording(world, data);
+#ifndef HEADLESS
+    bool headless = isHeadless(data);
+    Render* r = NULL;
+    if (!headless) {
+        r = Render::getInstance();
+        while (!r->isInitialized()) {
+            mysleep(10);
+        }
     }
+#endif
     
     int steps = data.get("steps", 1000).asInt();
     float deltaT = data.get("timeslice", 0.4f).asFloat();
     
     world.play();
     
-    for (int i = 0; i < steps && world.getIsPlaying(); ++i) {
+    for (int i = start; i < steps && world.getIsPlaying(); ++i) {
         world.step(deltaT);
-        r->update(deltaT);
-        mysleep(10);
+        world.recordFrame(i);
+        checkpointStep(world, data, i + 1, world.getCurrentTime());
+#ifndef HEADLESS
+        if (!headless) {
+            r->update(deltaT);
+            mysleep(10);
+        }
+#endif
         
         if (i % 100 == 0) {
-            std::cout << "Step " << i << "/" << steps << " (time: " 
-                      << world.getCurrentTime() << "s)" << std::endl;
+            LOG_INFO("Step " << i << "/" << steps << " (time: " << world.getCurrentTime() << "s)");
         }
     }
     
+    if (recording) {
+        endRecording(world, data);
+    }
+    endCheckpoints(world, data, start, steps);
     world.printSimulationStats();
 }
 
@@ -230,45 +542,111 @@ void runDatasetPlayback(const Json::Value& data) {
     std::string format = data["simulation"]["dataset"].get("format", "eth").asString();
     float frameRate = data["simulation"]["dataset"].get("frameRate", 2.5f).asFloat();
     float pixelToMeter = data["simulation"]["dataset"].get("pixelToMeter", 0.05f).asFloat();
+    bool stream = data["simulation"]["dataset"].get("stream", false).asBool();
+    int lookahead = data["simulation"]["dataset"].get("lookahead", 4).asInt();
     
     // Create enhanced world with dataset mode
     EnhancedCrowdWorld world;
+    world.setHeadless(isHeadless(data));
+    // Playback itself is serial; the threads go to the evaluation
+    world.setThreads(data.get("threads", 1).asInt());
     world.setMode(DATASET_PLAYBACK);
     world.setDatasetParameters(frameRate, pixelToMeter);
+    world.setDatasetStreaming(stream, lookahead);
     
     if (!world.loadDataset(filename, format)) {
-        std::cerr << "Failed to load dataset: " << filename << std::endl;
+        LOG_ERROR("Failed to load dataset: " << filename);
         return;
     }
     
-    Render* r = Render::getInstance();
-    while (!r->isInitialized()) {
-        mysleep(10);
+#ifndef HEADLESS
+    Render* r = NULL;
+    if (!world.isHeadless()) {
+        r = Render::getInstance();
+        while (!r->isInitialized()) {
+            mysleep(10);
+        }
     }
+#endif
     
     float deltaT = 1.0f / frameRate;
+#ifndef HEADLESS
     bool realtime = data["simulation"]["playback"].get("realtime", true).asBool();
     int sleepTime = realtime ? (int)(deltaT * 1000) : 10;
+#endif
     
     world.play();
     
     while (world.getIsPlaying()) {
         world.step(deltaT);
-        r->update(deltaT);
-        mysleep(sleepTime);
+#ifndef HEADLESS
+        if (r) {
+            r->update(deltaT);
+            mysleep(sleepTime);
+        }
+#endif
         
         if (world.getCurrentFrame() % 50 == 0) {
-            std::cout << "Frame " << world.getCurrentFrame() 
-                      << " (time: " << world.getCurrentTime() << "s)" << std::endl;
+            LOG_INFO("Frame " << world.getCurrentFrame() << " (time: " << world.getCurrentTime() << "s)");
         }
     }
     
     // Export results if configured
     if (data["analysis"].get("exportTrajectories", false).asBool()) {
         std::string outputFile = data["analysis"].get("outputFile", "output.json").asString();
-        world.exportTrajectories(outputFile);
-        std::cout << "Trajectories exported to: " << outputFile << std::endl;
+        if (world.exportTrajectories(outputFile)) {
+            std::cout << "Trajectories exported to: " << outputFile << std::endl;
+        }
+    }
+    
+    if (data["analysis"].get("calculateMetrics", false).asBool() &&
+        data["analysis"].isMember("groundTruthFile")) {
+        std::string truthFile = data["analysis"]["groundTruthFile"].asString();
+        world.compareWithGroundTruth(truthFile,
+                                     data["analysis"].get("groundTruthFormat", formatOf(truthFile)).asString(),
+                                     data["analysis"].get("collisionDistance", 0.2f).asFloat());
     }
     
     world.printSimulationStats();
 }
+
+// Observe-then-predict benchmark over every window of the dataset, with
+// "observed", "predicted" and "stride" from analysis.rollouts and the ORCA
+// parameters from the simulation section
+void runRollouts(const Json::Value& data) {
+    std::cout << "Starting rollouts..." << std::endl;
+    
+    const Json::Value& dataset = data["simulation"]["dataset"];
+    std::string filename = dataset["filename"].asString();
+    DatasetLoader loader;
+    loader.setFrameRate(dataset.get("frameRate", 2.5f).asFloat());
+    loader.setPixelToMeter(dataset.get("pixelToMeter", 0.05f).asFloat());
+    if (!loader.loadDataset(filename, dataset.get("format", "eth").asString())) {
+        LOG_ERROR("Failed to load dataset: " << filename);
+        return;
+    }
+    
+    const Json::Value& sim = data["simulation"];
+    const Json::Value& windows = data["analysis"]["rollouts"];
+    RolloutOptions options;
+    options.observed = windows.get("observed", 8).asInt();
+    options.predicted = windows.get("predicted", 12).asInt();
+    options.stride = windows.get("stride", 1).asInt();
+    options.radius = windows.get("radius", 0.2f).asFloat();
+    options.timeHorizon = sim.get("timeHorizon", 2.0f).asFloat();
+    options.neighborDist = sim.get("neighborDist", 10.0f).asFloat();
+    options.maxNeighbors = sim.get("maxNeighbors", 10).asInt();
+    options.collisionDistance = data["analysis"].get("collisionDistance", 0.2f).asFloat();
+    int threads = data.get("threads", 1).asInt();
+    std::unique_ptr<TaskScheduler> scheduler;
+    if (threads != 1) {
+        scheduler.reset(new TaskScheduler(threads));
+        options.scheduler = scheduler.get();
+    }
+    
+    RolloutHarness harness(options);
+    RolloutResult result = harness.run(loader.getTable());
+    std::cout << "Rollouts of " << options.observed << " observed and " << options.predicted
+              << " predicted frames:" << std::endl;
+    printRollouts(std::cout, result);
+}
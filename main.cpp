@@ -2,6 +2,8 @@
 #include "CrowdObject.h"
 #include "Wall.h"
 #include "CrowdWorld.h"
+#include "Render.h"
+#include "Log.h"
 #include <stdlib.h>
 #include <fstream> 
 #include <istream>
@@ -78,7 +80,9 @@ int main( int argc, char ** argv){
     c.updateAgents();
     c.calcForces();
     c.stepWorld(deltat);
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
     c.print();
+#endif
     r->update(deltat);
     mysleep( 10 );
   }
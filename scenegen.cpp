@@ -0,0 +1,373 @@
+// Generates large scenes for benchmark and scaling runs.
+//
+// Every scenario is sized from the agent count so crowd density stays about
+// the same from a hundred agents to a hundred thousand. Walls go under
+// "objects", so the output loads into CrowdWorld and EnhancedCrowdWorld in
+// social-force and ORCA mode alike. The same options and seed always give
+// the same file.
+//
+//   make scenegen
+//   ./scenegen corridor --agents 50000 --seed 7 --out corridor50k.json
+//   ./scenegen maze --agents 10000 --walls 0.6 --mode orca --out maze.json
+
+#include <json/value.h>
+#include <json/writer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+// Agents per square meter where a scenario places its crowd
+const float SPAWN_DENSITY = 0.5f;
+
+struct Options {
+    std::string scenario;
+    int agents = 1000;
+    float wallDensity = 0.3f;
+    unsigned seed = 1;
+    std::string mode = "social";
+    int steps = 400;
+    bool pretty = false;
+    std::string out;
+};
+
+struct Rect {
+    float x0, y0, x1, y1;
+    float width() const { return x1 - x0; }
+    float height() const { return y1 - y0; }
+};
+
+class SceneBuilder {
+public:
+    SceneBuilder(const Options& o) : options(o), rng(o.seed) {
+        scene["steps"] = options.steps;
+        scene["timeslice"] = orca() ? 0.25 : 0.5;
+        scene["agents"] = Json::Value(Json::arrayValue);
+        scene["objects"] = Json::Value(Json::arrayValue);
+        if (orca()) {
+            scene["simulation"]["mode"] = "orca";
+            scene["simulation"]["timeHorizon"] = 2.0;
+            scene["simulation"]["neighborDist"] = 5.0;
+            scene["simulation"]["maxNeighbors"] = 10;
+        }
+        // Recorded so a scene can be regenerated, ignored by the loaders
+        scene["scenario"]["name"] = options.scenario;
+        scene["scenario"]["agents"] = options.agents;
+        scene["scenario"]["wallDensity"] = options.wallDensity;
+        scene["scenario"]["seed"] = options.seed;
+    }
+
+    bool orca() const { return options.mode == "orca"; }
+
+    float uniform(float lo, float hi) {
+        return std::uniform_real_distribution<float>(lo, hi)(rng);
+    }
+
+    int uniformInt(int lo, int hi) {
+        return std::uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+    void wall(float x0, float y0, float x1, float y1) {
+        Json::Value w;
+        w["type"] = "wall";
+        w["start"].append(round(x0));
+        w["start"].append(round(y0));
+        w["end"].append(round(x1));
+        w["end"].append(round(y1));
+        scene["objects"].append(w);
+    }
+
+    // Closed outline of r, leaving out the sides whose bit is set in open
+    // (1 left, 2 right, 4 bottom, 8 top)
+    void outline(const Rect& r, int open = 0) {
+        if (!(open & 1)) wall(r.x0, r.y0, r.x0, r.y1);
+        if (!(open & 2)) wall(r.x1, r.y0, r.x1, r.y1);
+        if (!(open & 4)) wall(r.x0, r.y0, r.x1, r.y0);
+        if (!(open & 8)) wall(r.x0, r.y1, r.x1, r.y1);
+    }
+
+    // Short free-standing wall segments inside r, one per 40 square meters
+    // at density 1
+    void pillars(const Rect& r) {
+        int count = (int)(options.wallDensity * r.width() * r.height() / 40.0f);
+        for (int i = 0; i < count; ++i) {
+            float x = uniform(r.x0 + 1.0f, r.x1 - 1.0f);
+            float y = uniform(r.y0 + 1.0f, r.y1 - 1.0f);
+            float angle = uniform(0.0f, (float)M_PI);
+            float half = uniform(0.5f, 1.5f);
+            wall(x - std::cos(angle) * half, y - std::sin(angle) * half,
+                 x + std::cos(angle) * half, y + std::sin(angle) * half);
+        }
+    }
+
+    void agent(float x, float y, float gx, float gy) {
+        Json::Value a;
+        a["pos"].append(round(x));
+        a["pos"].append(round(y));
+        a["vel"].append(0.0);
+        a["vel"].append(0.0);
+        a["attractor"]["type"] = "attractor";
+        a["attractor"]["pos"].append(round(gx));
+        a["attractor"]["pos"].append(round(gy));
+        a["attractor"]["norm"].append(0.0);
+        a["attractor"]["norm"].append(0.0);
+        a["radius"] = round(uniform(0.25f, 0.35f));
+        a["mesh"] = "blue.mesh";
+        if (orca()) {
+            a["maxVel"] = round(uniform(1.0f, 1.4f));
+            a["timeHorizon"] = 2.0;
+            a["timeHorizonObst"] = 2.0;
+            a["neighborDist"] = 5.0;
+            a["maxNeighbors"] = 10;
+        } else {
+            a["atWeight"] = 0.5;
+            a["waWeight"] = 0.6;
+            a["obWeight"] = 0.5;
+            a["agWeight"] = 0.3;
+            a["accel"] = 0.2;
+            a["maxVel"] = 0.5;
+            a["visDist"] = 3.0;
+            a["visWid"] = 2.0;
+            a["pspace"] = 0.1;
+        }
+        scene["agents"].append(a);
+    }
+
+    // count agents on a jittered grid filling r, all heading for (gx, gy)
+    // give or take spread meters
+    void crowd(const Rect& r, int count, float gx, float gy, float spread) {
+        if (count <= 0) {
+            return;
+        }
+        int cols = std::max(1, (int)std::ceil(std::sqrt(count * r.width() / r.height())));
+        int rows = (count + cols - 1) / cols;
+        float dx = r.width() / cols, dy = r.height() / rows;
+        for (int i = 0; i < count; ++i) {
+            float x = r.x0 + (i % cols + 0.5f + uniform(-0.25f, 0.25f)) * dx;
+            float y = r.y0 + (i / cols + 0.5f + uniform(-0.25f, 0.25f)) * dy;
+            agent(x, y, gx + uniform(-spread, spread), gy + uniform(-spread, spread));
+        }
+    }
+
+    Json::Value& result() { return scene; }
+
+    const Options& options;
+
+private:
+    static double round(float v) {
+        return std::round(v * 1000.0) / 1000.0;
+    }
+
+    std::mt19937 rng;
+    Json::Value scene;
+};
+
+// Area that holds count agents at the spawn density
+float spawnArea(int count) {
+    return count / SPAWN_DENSITY;
+}
+
+// Two groups entering a long corridor from opposite ends
+void corridor(SceneBuilder& b) {
+    int n = b.options.agents;
+    float width = std::max(6.0f, std::sqrt((float)n) * 0.5f);
+    float spawnLength = spawnArea(n / 2 + 1) / width;
+    float middle = std::max(20.0f, width * 2.0f);
+    float half = spawnLength + middle / 2;
+
+    b.wall(-half, -width / 2, half, -width / 2);
+    b.wall(-half, width / 2, half, width / 2);
+    b.pillars(Rect{-middle / 2, -width / 2, middle / 2, width / 2});
+
+    Rect left{-half, -width / 2 + 0.5f, -middle / 2, width / 2 - 0.5f};
+    Rect right{middle / 2, -width / 2 + 0.5f, half, width / 2 - 0.5f};
+    b.crowd(left, n / 2, half + 2.0f, 0.0f, width / 2 - 1.0f);
+    b.crowd(right, n - n / 2, -half - 2.0f, 0.0f, width / 2 - 1.0f);
+}
+
+// Four groups crossing a junction of two corridors
+void crossing(SceneBuilder& b) {
+    int n = b.options.agents;
+    float width = std::max(6.0f, std::sqrt((float)n) * 0.5f);
+    float w = width / 2;
+    float arm = w + spawnArea(n / 4 + 1) / width + 4.0f;
+
+    // One L-shaped corner per quadrant
+    for (int sx = -1; sx <= 1; sx += 2) {
+        for (int sy = -1; sy <= 1; sy += 2) {
+            b.wall(sx * w, sy * w, sx * arm, sy * w);
+            b.wall(sx * w, sy * w, sx * w, sy * arm);
+        }
+    }
+    b.pillars(Rect{-w, -w, w, w});
+
+    float spawnFrom = w + 4.0f, inset = w - 0.5f, spread = w - 1.0f;
+    int quarter = n / 4;
+    b.crowd(Rect{-arm, -inset, -spawnFrom, inset}, quarter, arm + 2.0f, 0.0f, spread);
+    b.crowd(Rect{spawnFrom, -inset, arm, inset}, quarter, -arm - 2.0f, 0.0f, spread);
+    b.crowd(Rect{-inset, -arm, inset, -spawnFrom}, quarter, 0.0f, arm + 2.0f, spread);
+    b.crowd(Rect{-inset, spawnFrom, inset, arm}, n - 3 * quarter, 0.0f, -arm - 2.0f, spread);
+}
+
+// A full room emptying through a single door
+void bottleneck(SceneBuilder& b) {
+    int n = b.options.agents;
+    float side = std::sqrt(spawnArea(n)) + 4.0f;
+    float h = side / 2;
+    float door = std::max(1.5f, std::sqrt((float)n) * 0.05f);
+
+    Rect room{-h, -h, h, h};
+    b.outline(room, 2);
+    b.wall(h, -h, h, -door / 2);
+    b.wall(h, door / 2, h, h);
+    b.pillars(Rect{-h, -h, h - 4.0f, h});
+    b.crowd(Rect{-h + 1.0f, -h + 1.0f, h - 2.0f, h - 1.0f}, n, h + 6.0f, 0.0f, 0.5f);
+}
+
+// A grid of rooms; each wall between rooms exists with probability equal to
+// the wall density and always has a door, so every room stays reachable
+void maze(SceneBuilder& b) {
+    int n = b.options.agents;
+    const float cell = 8.0f, door = 2.0f;
+    int perCell = std::max(1, (int)(SPAWN_DENSITY * cell * cell * 0.25f));
+    int k = std::max(2, (int)std::ceil(std::sqrt((float)n / perCell)));
+    float h = k * cell / 2;
+
+    b.outline(Rect{-h, -h, h, h});
+    float gap = (cell - door) / 2;
+    for (int i = 0; i < k; ++i) {
+        for (int j = 1; j < k; ++j) {
+            float line = -h + j * cell, from = -h + i * cell;
+            if (b.uniform(0.0f, 1.0f) < b.options.wallDensity) {
+                b.wall(line, from, line, from + gap);
+                b.wall(line, from + cell - gap, line, from + cell);
+            }
+            if (b.uniform(0.0f, 1.0f) < b.options.wallDensity) {
+                b.wall(from, line, from + gap, line);
+                b.wall(from + cell - gap, line, from + cell, line);
+            }
+        }
+    }
+
+    // Agents start spread over the rooms and head for a random other room
+    int cells = k * k;
+    for (int c = 0; c < cells; ++c) {
+        int count = n / cells + (c < n % cells ? 1 : 0);
+        int goal = b.uniformInt(0, cells - 1);
+        float x0 = -h + (c % k) * cell, y0 = -h + (c / k) * cell;
+        float gx = -h + (goal % k + 0.5f) * cell, gy = -h + (goal / k + 0.5f) * cell;
+        b.crowd(Rect{x0 + 1.0f, y0 + 1.0f, x0 + cell - 1.0f, y0 + cell - 1.0f},
+                count, gx, gy, cell / 2 - 1.0f);
+    }
+}
+
+// An open square crossed in every direction, with kiosks in the way
+void plaza(SceneBuilder& b) {
+    int n = b.options.agents;
+    float h = std::sqrt(spawnArea(n)) * 0.7f + 5.0f;
+
+    b.outline(Rect{-h, -h, h, h});
+    int kiosks = (int)(b.options.wallDensity * 4 * h * h / 200.0f);
+    for (int i = 0; i < kiosks; ++i) {
+        float x = b.uniform(-h + 3.0f, h - 3.0f), y = b.uniform(-h + 3.0f, h - 3.0f);
+        b.outline(Rect{x - 1.0f, y - 1.0f, x + 1.0f, y + 1.0f});
+    }
+
+    float inner = h - 1.0f;
+    int side = std::max(1, (int)std::ceil(std::sqrt((float)n)));
+    float step = 2 * inner / side;
+    for (int i = 0; i < n; ++i) {
+        float x = -inner + (i % side + 0.5f + b.uniform(-0.25f, 0.25f)) * step;
+        float y = -inner + (i / side + 0.5f + b.uniform(-0.25f, 0.25f)) * step;
+        b.agent(x, y, b.uniform(-inner, inner), b.uniform(-inner, inner));
+    }
+}
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " <scenario> [options]" << std::endl
+              << "Scenarios: corridor, crossing, bottleneck, maze, plaza" << std::endl
+              << "  --agents <n>     number of agents (default 1000)" << std::endl
+              << "  --walls <d>      wall density, 0 to 1 (default 0.3)" << std::endl
+              << "  --seed <s>       random seed (default 1)" << std::endl
+              << "  --mode <mode>    social or orca agents (default social)" << std::endl
+              << "  --steps <n>      steps recorded in the scene (default 400)" << std::endl
+              << "  --pretty         indented JSON instead of one line" << std::endl
+              << "  --out <file>     write there instead of stdout" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--agents" && hasValue) {
+            options.agents = atoi(argv[++i]);
+        } else if (arg == "--walls" && hasValue) {
+            options.wallDensity = atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--mode" && hasValue) {
+            options.mode = argv[++i];
+        } else if (arg == "--steps" && hasValue) {
+            options.steps = atoi(argv[++i]);
+        } else if (arg == "--pretty") {
+            options.pretty = true;
+        } else if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else if (arg[0] != '-' && options.scenario.empty()) {
+            options.scenario = arg;
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    options.wallDensity = std::min(1.0f, std::max(0.0f, options.wallDensity));
+    if (options.agents < 1 || (options.mode != "social" && options.mode != "orca")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    SceneBuilder builder(options);
+    if (options.scenario == "corridor") {
+        corridor(builder);
+    } else if (options.scenario == "crossing") {
+        crossing(builder);
+    } else if (options.scenario == "bottleneck") {
+        bottleneck(builder);
+    } else if (options.scenario == "maze") {
+        maze(builder);
+    } else if (options.scenario == "plaza") {
+        plaza(builder);
+    } else {
+        std::cerr << "Unknown scenario: " << options.scenario << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string json;
+    if (options.pretty) {
+        json = Json::StyledWriter().write(builder.result());
+    } else {
+        json = Json::FastWriter().write(builder.result());
+    }
+    if (options.out.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream out(options.out.c_str());
+        if (!out) {
+            std::cerr << "Could not open file: " << options.out << std::endl;
+            return 1;
+        }
+        out << json;
+    }
+    std::cerr << options.scenario << ": " << builder.result()["agents"].size() << " agents, "
+              << builder.result()["objects"].size() << " walls" << std::endl;
+    return 0;
+}
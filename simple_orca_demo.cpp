@@ -107,9 +107,12 @@ int main(int argc, char** argv) {
     
     // Main simulation loop
     for (int i = 0; i < steps; ++i) {
-        // Update each ORCA agent
+        // Pick every new velocity first, then move everyone
         for (ORCAAgent* agent : orcaAgents) {
+            agent->updatePrefVelocity();
             agent->calculateORCAVelocity(allAgents, deltaT);
+        }
+        for (ORCAAgent* agent : orcaAgents) {
             agent->applyForces(deltaT);
         }
         
@@ -0,0 +1,154 @@
+// Checks of checkpoints (Checkpoint.h): a run stopped part way, saved,
+// restored into a fresh world and run on ends in exactly the state of a run
+// that was never interrupted. Both runs end with a checkpoint, and the two
+// files must be identical byte for byte. Covered: social force in place,
+// social force double buffered on several threads, and ORCA.
+//
+//   make test
+
+// EnhancedCrowdWorld.h brings in CrowdWorld.h, which has no include guard
+#include "EnhancedCrowdWorld.h"
+#include "TestSupport.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The social force agents start stopping for each other at about step 60,
+// so the run is cut after the shared random generator has been drawn from
+const int totalSteps = 150;
+const int stopAt = 95;
+const float deltaT = 0.2f;
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+Json::Value point(float x, float y) {
+    Json::Value p(Json::arrayValue);
+    p.append(x);
+    p.append(y);
+    return p;
+}
+
+// Two groups of six by six crossing each other around a wall, close enough
+// to push, stop and wait on one another
+Json::Value crossingScene(bool orca) {
+    Json::Value scene;
+    for (int group = 0; group < 2; ++group) {
+        for (int i = 0; i < 36; ++i) {
+            float x = (group ? 4.0f : -10.0f) + (i % 6) * 1.2f;
+            float y = -3.0f + (i / 6) * 1.2f;
+            Json::Value a;
+            a["pos"] = point(x, y);
+            a["vel"] = point(0.0f, 0.0f);
+            a["attractor"]["type"] = "attractor";
+            a["attractor"]["norm"] = point(0.0f, 0.0f);
+            a["attractor"]["pos"] = point(group ? -20.0f : 20.0f, y * 0.5f);
+            a["radius"] = 0.4f;
+            a["mesh"] = "blue.mesh";
+            if (orca) {
+                a["maxVel"] = 1.2f;
+                a["timeHorizon"] = 2.0f;
+                a["neighborDist"] = 6.0f;
+                a["maxNeighbors"] = 8;
+            } else {
+                a["agWeight"] = 0.75f;
+                a["atWeight"] = 0.5f;
+                a["waWeight"] = 0.8f;
+                a["obWeight"] = 0.5f;
+                a["faWieght"] = 0.0f;
+                a["accel"] = 0.2f;
+                a["maxVel"] = 1.0f;
+                a["visDist"] = 6.0f;
+                a["visWid"] = 2.0f;
+                a["pspace"] = 0.1f;
+            }
+            scene["agents"].append(a);
+        }
+    }
+    Json::Value wall;
+    wall["type"] = "wall";
+    wall["start"] = point(0.0f, -1.5f);
+    wall["end"] = point(0.0f, 1.5f);
+    scene["objects"].append(wall);
+    scene["headless"] = true;
+    if (orca) {
+        scene["simulation"]["mode"] = "orca";
+    }
+    return scene;
+}
+
+// Runs steps [from, to) of world, starting from the checkpoint restore if
+// one is named, and ends with a checkpoint at end
+template <typename World, typename Step>
+void run(World* world, Step step, const std::string& restore, int from, int to, const std::string& end) {
+    if (!restore.empty()) {
+        int64_t step0;
+        double time;
+        CHECK(world->restoreCheckpoint(restore, step0, time));
+        CHECK(step0 == from);
+        CHECK(time == from * (double)deltaT);
+    }
+    for (int i = from; i < to; ++i) {
+        step(*world);
+    }
+    CHECK(world->saveCheckpoint(end, to, to * (double)deltaT));
+    CHECK(world->finishCheckpoint());
+}
+
+template <typename Make, typename Step>
+void compareRuns(const char* name, Make make, Step step) {
+    std::string straight = tempPath(".snap");
+    std::string half = tempPath(".snap");
+    std::string resumed = tempPath(".snap");
+
+    std::unique_ptr<CrowdWorld> a(make());
+    run(a.get(), step, "", 0, totalSteps, straight);
+    std::unique_ptr<CrowdWorld> b(make());
+    run(b.get(), step, "", 0, stopAt, half);
+    std::unique_ptr<CrowdWorld> c(make());
+    run(c.get(), step, half, stopAt, totalSteps, resumed);
+
+    std::string x = readFile(straight), y = readFile(resumed), z = readFile(half);
+    CHECK(!x.empty());
+    if (x != y) {
+        std::cerr << name << ": resumed run differs from the straight one" << std::endl;
+        ++failures;
+    }
+    // The agents did move in the second part, so the check means something
+    CHECK(x.size() == z.size() && x != z);
+    remove(straight.c_str());
+    remove(half.c_str());
+    remove(resumed.c_str());
+}
+
+void socialStep(CrowdWorld& world) {
+    world.updateAgents();
+    world.calcForces();
+    world.stepWorld(deltaT);
+}
+
+}
+
+int main() {
+    compareRuns("social force", [] { return new CrowdWorld(crossingScene(false)); }, socialStep);
+    compareRuns("social force, 3 threads", [] {
+        Json::Value scene = crossingScene(false);
+        scene["threads"] = 3;
+        return new CrowdWorld(scene);
+    }, socialStep);
+    compareRuns("orca", [] {
+        EnhancedCrowdWorld* world = new EnhancedCrowdWorld(crossingScene(true));
+        world->play();
+        return world;
+    }, [](CrowdWorld& world) { static_cast<EnhancedCrowdWorld&>(world).step(deltaT); });
+
+    return finish("test_checkpoint");
+}
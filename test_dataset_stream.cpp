@@ -0,0 +1,124 @@
+// Checks of dataset streaming (DatasetStream.h): with a lookahead as long as
+// the dataset, a streamed file plays the same frames, positions and
+// velocities as the file loaded whole, whatever the block boundaries.
+//
+//   make test
+
+#include "DatasetLoader.h"
+#include "DatasetStream.h"
+#include "TestSupport.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+bool samePoint(const TrajectoryPoint& a, const TrajectoryPoint& b, bool velocities) {
+    return a.frameId == b.frameId && a.agentId == b.agentId && memcmp(&a.x, &b.x, sizeof(float)) == 0 &&
+           memcmp(&a.y, &b.y, sizeof(float)) == 0 &&
+           (!velocities || (memcmp(&a.vx, &b.vx, sizeof(float)) == 0 && memcmp(&a.vy, &b.vy, sizeof(float)) == 0));
+}
+
+// An ETH file of a bit over 2 MB, so the reader hands it over in several
+// blocks with lines cut across them. Pedestrians come and go, some leave
+// gaps in their tracks, and frame ids step by 10 with a few skipped
+std::string writeDataset() {
+    std::string path = tempPath(".txt");
+    std::ofstream out(path.c_str());
+    out << "# frame agent x y\n";
+    unsigned seed = 12345;
+    for (int f = 0; f < 24000; f += 10) {
+        if (f % 970 == 0) {
+            continue;
+        }
+        for (int a = 0; a < 48; ++a) {
+            int id = f / 400 * 7 + a;
+            seed = seed * 1103515245u + 12345u;
+            if ((seed >> 16) % 9 == 0) {
+                continue;
+            }
+            out << f << " " << id << " " << (f % 400) * 1.25f + a * 3.5f << " " << 300.0f - a * 17.25f + (seed >> 20) % 7
+                << "\n";
+        }
+    }
+    return path;
+}
+
+// Every frame the stream plays, compared with the loaded dataset
+int compareFrames(const std::string& path, int lookahead, bool velocities) {
+    DatasetLoader whole;
+    CHECK(whole.loadDataset(path, "eth"));
+    DatasetLoader streamed;
+    streamed.setStreaming(true, lookahead);
+    CHECK(streamed.loadDataset(path, "eth"));
+    CHECK(streamed.isStreaming());
+
+    int frames = 0;
+    size_t points = 0;
+    while (streamed.hasNextFrame()) {
+        int f = streamed.getCurrentFrame();
+        FrameView a = whole.getFrameView(f);
+        FrameView b = streamed.getFrameView(f);
+        CHECK(a.size() == b.size());
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+            CHECK(samePoint(a[i], b[i], velocities));
+        }
+        points += b.size();
+        ++frames;
+        streamed.nextFrame();
+    }
+    CHECK(streamed.getMaxFrame() == whole.getMaxFrame());
+    CHECK(points == whole.getTable().numPoints());
+    return frames;
+}
+
+// Playing again after a rewind gives the first frames back
+void testRewind(const std::string& path) {
+    DatasetLoader streamed;
+    streamed.setStreaming(true, 4);
+    CHECK(streamed.loadDataset(path, "eth"));
+    std::vector<TrajectoryPoint> first = streamed.getFrameData(10);
+    for (int i = 0; i < 5000; ++i) {
+        streamed.nextFrame();
+    }
+    streamed.reset();
+    std::vector<TrajectoryPoint> again = streamed.getFrameData(10);
+    CHECK(!first.empty());
+    CHECK(first.size() == again.size());
+    for (size_t i = 0; i < first.size() && i < again.size(); ++i) {
+        CHECK(samePoint(first[i], again[i], true));
+    }
+}
+
+// A file that opens but cannot be read ends the window with an error
+// rather than looking like an empty dataset
+void testReadError() {
+    std::string dir = tempPath("");
+    remove(dir.c_str());
+    CHECK(mkdir(dir.c_str(), 0700) == 0);
+    DatasetStream stream;
+    if (stream.open(dir, 2.5f, 0.05f, 4)) {
+        stream.advance(0);
+        CHECK(!stream.getError().empty());
+    }
+    rmdir(dir.c_str());
+}
+
+}
+
+int main() {
+    std::string path = writeDataset();
+    // Longer than the dataset: nothing is cut off, velocities included
+    int frames = compareFrames(path, 100000, true);
+    CHECK(frames == 23991);
+    // A short window still plays every position
+    compareFrames(path, 1, false);
+    testRewind(path);
+    testReadError();
+    remove(path.c_str());
+    return finish("test_dataset_stream");
+}
@@ -0,0 +1,151 @@
+// Checks of scoring (Evaluation.h) and rollouts (RolloutHarness.h) on
+// tables small enough to work out by hand: which points pair up, ADE, FDE
+// and the crowd statistics, the same for any number of threads, and
+// rollouts of pedestrians whose futures are known in closed form.
+//
+//   make test
+
+#include "Evaluation.h"
+#include "RolloutHarness.h"
+#include "TaskScheduler.h"
+#include "TrajectoryFile.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+bool near(double a, double b) {
+    return std::fabs(a - b) <= 1e-4 * std::max(1.0, std::fabs(b));
+}
+
+bool sameResult(const EvaluationResult& a, const EvaluationResult& b) {
+    return a.matchedPoints == b.matchedPoints && a.predictedPoints == b.predictedPoints &&
+           a.groundTruthPoints == b.groundTruthPoints && a.matchedAgents == b.matchedAgents &&
+           a.ade == b.ade && a.fde == b.fde && a.agentFrames == b.agentFrames && a.collisions == b.collisions &&
+           a.collisionRate == b.collisionRate && a.minDistance == b.minDistance &&
+           a.meanMinDistance == b.meanMinDistance;
+}
+
+// Ground truth: agent 1 walks along x, agent 2 up the y axis from (0, 10),
+// agent 5 is never predicted. The prediction is off by (3, 4) for agent 1
+// at frame 2 and by (0, 2) for agent 2 at frame 1, predicts agent 2 one
+// frame past its truth, and adds agent 9, whom the truth never saw
+void testPairing() {
+    std::vector<TrajectoryPoint> truth;
+    truth.push_back(makePoint(0, 1, 0.0f, 0.0f));
+    truth.push_back(makePoint(1, 1, 1.0f, 0.0f));
+    truth.push_back(makePoint(2, 1, 2.0f, 0.0f));
+    truth.push_back(makePoint(0, 2, 0.0f, 10.0f));
+    truth.push_back(makePoint(1, 2, 0.0f, 11.0f));
+    truth.push_back(makePoint(1, 5, 50.0f, 50.0f));
+    std::vector<TrajectoryPoint> predicted;
+    predicted.push_back(makePoint(0, 1, 0.0f, 0.0f));
+    predicted.push_back(makePoint(1, 1, 1.0f, 0.0f));
+    predicted.push_back(makePoint(2, 1, 5.0f, 4.0f));
+    predicted.push_back(makePoint(1, 2, 0.0f, 13.0f));
+    predicted.push_back(makePoint(2, 2, 0.0f, 14.0f));
+    predicted.push_back(makePoint(1, 9, 1.0f, 0.1f));
+    TrajectoryFile p, g;
+    CHECK(p.build(predicted, 2.5f, 1.0f));
+    CHECK(g.build(truth, 2.5f, 1.0f));
+
+    EvaluationResult r = evaluateTrajectories(p, g);
+    CHECK(r.predictedPoints == 6);
+    CHECK(r.groundTruthPoints == 6);
+    CHECK(r.matchedPoints == 4);
+    CHECK(r.matchedAgents == 2);
+    // (0 + 0 + 5 + 2) / 4, and (5 + 2) / 2 at each agent's last pair
+    CHECK(r.ade == 1.75);
+    CHECK(r.fde == 3.5);
+
+    // Crowd statistics of the prediction. Frame 0 has one agent and does
+    // not count. Frame 1: agents 1 and 9 are 0.1 apart, and agent 2 is
+    // sqrt(1 + 12.9^2) from agent 9. Frame 2: agents 1 and 2 are
+    // sqrt(25 + 100) apart. Collisions count agents, one per frame
+    CHECK(r.agentFrames == 5);
+    CHECK(r.collisions == 2);
+    CHECK(r.collisionRate == 0.4);
+    CHECK(near(r.minDistance, 0.1));
+    double far = std::sqrt(125.0);
+    CHECK(near(r.meanMinDistance, (0.1 + 0.1 + std::sqrt(1.0 + 12.9 * 12.9) + far + far) / 5));
+
+    // No threads, or three: the same result to the last bit
+    TaskScheduler scheduler(3);
+    EvaluationOptions threaded;
+    threaded.scheduler = &scheduler;
+    CHECK(sameResult(r, evaluateTrajectories(p, g, threaded)));
+
+    // Wide enough to take in every pair
+    EvaluationOptions wide;
+    wide.collisionDistance = 13.5f;
+    EvaluationResult w = evaluateTrajectories(p, g, wide);
+    CHECK(w.collisions == 5);
+
+    EvaluationResult own = measureCrowd(g);
+    CHECK(own.matchedPoints == 0 && own.ade == 0.0);
+    CHECK(own.agentFrames == 5);
+    CHECK(own.collisions == 0);
+}
+
+// Pedestrians far apart walking at constant velocity are predicted
+// exactly; one that turns a right angle just as the prediction starts is
+// off by s * step * sqrt(2) after s steps
+void testRollouts() {
+    const int frames = 40;
+    const float step = 0.5f;
+    std::vector<TrajectoryPoint> points;
+    for (int f = 0; f < frames; ++f) {
+        points.push_back(makePoint(f, 1, f * step, 0.0f));
+        points.push_back(makePoint(f, 2, 100.0f, 100.0f - f * step * 0.5f));
+    }
+    TrajectoryFile straight;
+    CHECK(straight.build(points, 2.5f, 1.0f));
+
+    RolloutOptions options;
+    options.maxNeighbors = 0;
+    RolloutHarness harness(options);
+    RolloutResult r = harness.run(straight);
+    CHECK(r.windows == frames - 20 + 1);
+    CHECK(r.rollouts == r.windows);
+    CHECK(r.scores.matchedAgents == 2 * r.windows);
+    CHECK(r.scores.matchedPoints == (size_t)(2 * 12 * r.windows));
+    CHECK(r.scores.ade < 1e-4);
+    CHECK(r.scores.fde < 1e-4);
+
+    options.stride = 5;
+    RolloutHarness strided(options);
+    CHECK(strided.run(straight).windows == (frames - 20) / 5 + 1);
+
+    // One window: 8 frames along x, then 12 along y
+    std::vector<TrajectoryPoint> turn;
+    for (int f = 0; f < 20; ++f) {
+        float x = std::min(f, 7) * step;
+        float y = std::max(0, f - 7) * step;
+        turn.push_back(makePoint(f, 3, x, y));
+    }
+    TrajectoryFile turning;
+    CHECK(turning.build(turn, 2.5f, 1.0f));
+    RolloutHarness one((RolloutOptions()));
+    RolloutResult t = one.run(turning);
+    CHECK(t.windows == 1 && t.rollouts == 1);
+    // Mean of s for s = 1 .. 12 is 6.5
+    CHECK(near(t.scores.ade, 6.5 * step * std::sqrt(2.0)));
+    CHECK(near(t.scores.fde, 12 * step * std::sqrt(2.0)));
+
+    // Thread count does not change the scores
+    TaskScheduler scheduler(3);
+    options.stride = 1;
+    options.scheduler = &scheduler;
+    RolloutHarness threaded(options);
+    CHECK(sameResult(r.scores, threaded.run(straight).scores));
+}
+
+}
+
+int main() {
+    testPairing();
+    testRollouts();
+    return finish("test_evaluation");
+}
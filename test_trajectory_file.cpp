@@ -0,0 +1,157 @@
+// Checks of the binary trajectory format (TrajectoryFile.h): a table saved
+// and mapped back is the same table, bit for bit, and a text dataset
+// converted to binary loads to the same points and velocities as the text.
+//
+//   make test
+
+#include "DatasetLoader.h"
+#include "TrajectoryFile.h"
+#include "TestSupport.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same column contents, floats compared by their bits
+bool sameColumns(const TrajectoryFile& a, const TrajectoryFile& b) {
+    if (a.numPoints() != b.numPoints()) {
+        return false;
+    }
+    const PointColumns& p = a.getColumns();
+    const PointColumns& q = b.getColumns();
+    size_t n = a.numPoints();
+    return memcmp(p.frame, q.frame, n * sizeof(int32_t)) == 0 &&
+           memcmp(p.agent, q.agent, n * sizeof(int32_t)) == 0 &&
+           memcmp(p.x, q.x, n * sizeof(float)) == 0 && memcmp(p.y, q.y, n * sizeof(float)) == 0 &&
+           memcmp(p.vx, q.vx, n * sizeof(float)) == 0 && memcmp(p.vy, q.vy, n * sizeof(float)) == 0;
+}
+
+bool sameIndexes(const TrajectoryFile& a, const TrajectoryFile& b) {
+    if (a.numAgents() != b.numAgents() || a.firstFrame() != b.firstFrame() || a.numFrames() != b.numFrames()) {
+        return false;
+    }
+    for (int f = a.firstFrame(); f < a.firstFrame() + a.numFrames(); ++f) {
+        if (a.frame(f).size() != b.frame(f).size()) {
+            return false;
+        }
+    }
+    for (int k = 0; k < a.numAgents(); ++k) {
+        if (a.agentId(k) != b.agentId(k) || a.agentSize(k) != b.agentSize(k) ||
+            memcmp(a.agentPointIndices(k), b.agentPointIndices(k), a.agentSize(k) * sizeof(uint32_t)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Points given out of order come back ordered by frame, then agent id,
+// and survive a save and open unchanged
+void testRoundTrip() {
+    std::vector<TrajectoryPoint> points;
+    points.push_back(makePoint(12, 7, 1.5f, -2.0f));
+    points.push_back(makePoint(10, 7, 1.0f, -2.5f));
+    points.push_back(makePoint(10, -3, 0.25f, 4.0f));
+    points.push_back(makePoint(14, 7, 2.0f, -1.5f));
+    points.push_back(makePoint(10, 42, 9.0f, 9.0f));
+    points.push_back(makePoint(14, -3, 0.75f, 3.0f));
+    TrajectoryFile built;
+    CHECK(built.build(points, 2.5f, 0.05f));
+    CHECK(built.numPoints() == 6);
+    CHECK(built.numAgents() == 3);
+    CHECK(built.firstFrame() == 10);
+    CHECK(built.numFrames() == 5);
+    CHECK(built.frame(11).empty());
+    CHECK(built.frame(10).size() == 3);
+
+    const PointColumns& c = built.getColumns();
+    const int frames[] = { 10, 10, 10, 12, 14, 14 };
+    const int agents[] = { -3, 7, 42, 7, -3, 7 };
+    for (int i = 0; i < 6; ++i) {
+        CHECK(c.frame[i] == frames[i]);
+        CHECK(c.agent[i] == agents[i]);
+    }
+
+    size_t index;
+    CHECK(built.findPoint(7, 12, index) && c.x[index] == 1.5f);
+    CHECK(!built.findPoint(42, 12, index));
+    CHECK(built.nextPoint(7, 10, index) && c.frame[index] == 12);
+    CHECK(built.nextPoint(-3, 10, index) && c.frame[index] == 14);
+    CHECK(!built.nextPoint(42, 10, index));
+
+    std::string path = tempPath(".traj");
+    CHECK(built.save(path));
+    TrajectoryFile mapped;
+    CHECK(mapped.open(path));
+    CHECK(mapped.frameRate() == 2.5f);
+    CHECK(mapped.pixelToMeter() == 0.05f);
+    CHECK(sameColumns(built, mapped));
+    CHECK(sameIndexes(built, mapped));
+    remove(path.c_str());
+}
+
+// A text dataset and its binary conversion load to the same table, with
+// the velocities worked out at conversion time
+void testConversion() {
+    std::string text = tempPath(".txt");
+    std::ofstream out(text.c_str());
+    out << "# frame agent x y\n";
+    for (int f = 0; f < 200; f += 10) {
+        for (int a = 1; a <= 5; ++a) {
+            // Agent 3 is away for a while, so its track has a gap
+            if (a == 3 && f >= 60 && f < 100) {
+                continue;
+            }
+            out << f << " " << a << " " << 100 + a * 37 + f * a << " " << 250 - f * 2 + a << "\n";
+        }
+    }
+    out.close();
+
+    DatasetLoader fromText;
+    CHECK(fromText.loadDataset(text, "eth"));
+    std::string binary = tempPath(".traj");
+    CHECK(fromText.exportToBinary(binary));
+    DatasetLoader fromBinary;
+    CHECK(fromBinary.loadDataset(binary, "binary"));
+    CHECK(fromText.getTable().numPoints() == 96);
+    CHECK(sameColumns(fromText.getTable(), fromBinary.getTable()));
+    CHECK(sameIndexes(fromText.getTable(), fromBinary.getTable()));
+    CHECK(fromBinary.getFrameRate() == fromText.getFrameRate());
+    remove(text.c_str());
+    remove(binary.c_str());
+}
+
+// Files that are not trajectory files, or are cut short, are refused
+void testRejects() {
+    std::string path = tempPath(".traj");
+    std::ofstream(path.c_str()) << "0 1 400 300\n";
+    TrajectoryFile file;
+    CHECK(!file.open(path));
+    CHECK(!file.getError().empty());
+    CHECK(file.numPoints() == 0);
+
+    std::vector<TrajectoryPoint> points;
+    for (int f = 0; f < 50; ++f) {
+        points.push_back(makePoint(f, 1, f * 0.5f, 0.0f));
+    }
+    TrajectoryFile built;
+    CHECK(built.build(points, 2.5f, 1.0f));
+    CHECK(built.save(path));
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream(path.c_str(), std::ios::binary | std::ios::trunc).write(image.data(), image.size() / 2);
+    CHECK(!file.open(path));
+    remove(path.c_str());
+}
+
+}
+
+int main() {
+    testRoundTrip();
+    testConversion();
+    testRejects();
+    return finish("test_trajectory_file");
+}
@@ -13,8 +13,8 @@ float v2fDot( v2f v1, v2f v2){
 
 float v2fLen( v2f v ) {
   
-  float aSquared = pow( v[0], 2);
-  float bSquared = pow( v[1], 2);
+  float aSquared = v[0] * v[0];
+  float bSquared = v[1] * v[1];
 
   if( aSquared + bSquared <= 0.0){
     return 0.0;